@@ -0,0 +1,70 @@
+#include "bench_alloc.h"
+#include <stddef.h>
+
+static uint64_t alloc_count;
+static int64_t live_count;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    void *ptr = __real_malloc(size);
+    if (ptr != NULL)
+    {
+        __atomic_fetch_add(&live_count, 1, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    void *ptr = __real_calloc(count, size);
+    if (ptr != NULL)
+    {
+        __atomic_fetch_add(&live_count, 1, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    // growing a buffer costs like an allocation, shrinking to nothing does not count
+    if (size > 0)
+    {
+        __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    }
+    void *moved = __real_realloc(ptr, size);
+    if (ptr == NULL && moved != NULL)
+    {
+        __atomic_fetch_add(&live_count, 1, __ATOMIC_RELAXED);
+    }
+    else if (ptr != NULL && size == 0)
+    {
+        __atomic_fetch_sub(&live_count, 1, __ATOMIC_RELAXED);
+    }
+    return moved;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        __atomic_fetch_sub(&live_count, 1, __ATOMIC_RELAXED);
+    }
+    __real_free(ptr);
+}
+
+uint64_t bench_alloc_count(void)
+{
+    return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
+
+int64_t bench_alloc_live(void)
+{
+    return __atomic_load_n(&live_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+    // Heap allocations since start, counted by wrapping malloc, calloc and realloc at link time.
+    // Allocations libc makes for itself (strdup, asprintf, stdio) are not seen.
+    uint64_t bench_alloc_count(void);
+    // Allocations not freed yet, only differences between two calls mean something: a pointer
+    // libc allocated for itself is still seen when it is freed.
+    int64_t bench_alloc_live(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,360 @@
+// Host benchmark against server/sio_stand_in.py: emits/sec, inbound messages/sec, round trip
+// latency and heap allocations per message, for every transport and payload size.
+//
+//   SIO_BENCH_SERVER       host:port of the stand-in server, 127.0.0.1:8080
+//   SIO_BENCH_MESSAGES     emits and inbound messages per run, 2000
+//   SIO_BENCH_ROUND_TRIPS  echo round trips per run, one at a time, 500
+
+#include <bench_alloc.h>
+
+#include <sio_client.h>
+#include <sio_emit.h>
+#include <sio_event_view.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "[sio:bench]";
+
+#define BENCH_DEFAULT_SERVER "127.0.0.1:8080"
+#define BENCH_DEFAULT_MESSAGES 2000
+#define BENCH_DEFAULT_ROUND_TRIPS 500
+#define BENCH_CONNECT_TIMEOUT_MS 10000
+#define BENCH_REPLY_TIMEOUT_MS 30000 /* per echo, sync ack or flood */
+
+static const size_t payload_sizes[] = {16, 256, 1024, 4096};
+static const sio_transport_t transports[] = {SIO_TRANSPORT_POLLING, SIO_TRANSPORT_WEBSOCKETS};
+
+typedef struct
+{
+    const char *server;
+    uint32_t messages;
+    uint32_t round_trips;
+} bench_params_t;
+
+// one client, one transport and payload size
+typedef struct
+{
+    SemaphoreHandle_t done; /* given on connect, per echo, on the sync ack and once the flood is in */
+    uint32_t flood_received;
+    uint32_t flood_expected;
+    int64_t *latencies_us;
+    uint32_t latency_count;
+    int64_t sink_count; /* bench_sink events the server got, -1 without an ack */
+} bench_run_t;
+
+typedef struct
+{
+    double emits_per_sec;
+    double inbound_per_sec;
+    int64_t p50_us;
+    int64_t p99_us;
+    int64_t p999_us;
+    double allocs_per_emit;
+    double allocs_per_inbound;
+    double allocs_per_round_trip;
+} bench_result_t;
+
+static uint32_t env_u32(const char *name, uint32_t fallback)
+{
+    const char *value = getenv(name);
+    return value == NULL ? fallback : (uint32_t)strtoul(value, NULL, 10);
+}
+
+static void on_client_event(void *handler_arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    bench_run_t *run = (bench_run_t *)handler_arg;
+    sio_event_data_t *data = (sio_event_data_t *)event_data;
+
+    if (event_id == SIO_EVENT_NAMESPACE_CONNECTED && data->namespace_id == 0)
+    {
+        xSemaphoreGive(run->done);
+    }
+    // the packets belong to the receiver
+    if (data->packets_pointer != NULL)
+    {
+        free_packet_arr(&data->packets_pointer);
+    }
+}
+
+static void on_echo(sio_client_id_t client_id, const Packet_t *packet, const sio_event_view_t *view, void *ctx)
+{
+    bench_run_t *run = (bench_run_t *)ctx;
+    int64_t sent_us;
+    if (view->arg_count < 1 || sio_arg_get_int(&view->args[0], &sent_us) != ESP_OK)
+    {
+        return;
+    }
+    // one echo is in flight at a time
+    run->latencies_us[run->latency_count++] = esp_timer_get_time() - sent_us;
+    xSemaphoreGive(run->done);
+}
+
+static void on_flood(sio_client_id_t client_id, const Packet_t *packet, const sio_event_view_t *view, void *ctx)
+{
+    bench_run_t *run = (bench_run_t *)ctx;
+    if (__atomic_add_fetch(&run->flood_received, 1, __ATOMIC_RELAXED) == run->flood_expected)
+    {
+        xSemaphoreGive(run->done);
+    }
+}
+
+static void on_sync_ack(sio_client_id_t client_id, sio_ack_status_t status, const Packet_t *ack, void *user_arg)
+{
+    bench_run_t *run = (bench_run_t *)user_arg;
+    sio_event_view_t view;
+    run->sink_count = -1;
+    if (status == SIO_ACK_RECEIVED && sio_event_view_parse(&view, ack) == ESP_OK && view.arg_count > 0)
+    {
+        sio_arg_get_int(&view.args[0], &run->sink_count);
+    }
+    xSemaphoreGive(run->done);
+}
+
+static esp_err_t emit_payload(sio_client_id_t id, const char *event, int64_t value, const char *payload)
+{
+    sio_emit_t emit;
+    sio_emit_begin(&emit, id, 0, event);
+    sio_emit_int(&emit, value);
+    sio_emit_string(&emit, payload);
+    return sio_emit_send(&emit);
+}
+
+static double per_sec(uint64_t count, int64_t elapsed_us)
+{
+    return elapsed_us > 0 ? count * 1e6 / elapsed_us : 0;
+}
+
+// fire and forget, the sync ack tells how many made it and when the last one did
+static esp_err_t bench_emits(sio_client_id_t id, bench_run_t *run, const bench_params_t *params,
+                             const char *payload, bench_result_t *result)
+{
+    uint64_t allocs = bench_alloc_count();
+    int64_t start = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < params->messages; i++)
+    {
+        esp_err_t err = emit_payload(id, "bench_sink", i, payload);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Emit %u failed: %s", (unsigned)i, esp_err_to_name(err));
+            return err;
+        }
+    }
+    esp_err_t err = sio_send_string_ack(id, "bench_sync", "0", on_sync_ack, run, BENCH_REPLY_TIMEOUT_MS);
+    if (err != ESP_OK || xSemaphoreTake(run->done, pdMS_TO_TICKS(BENCH_REPLY_TIMEOUT_MS * 2)) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "No sync ack");
+        return err != ESP_OK ? err : ESP_ERR_TIMEOUT;
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    if (run->sink_count != params->messages)
+    {
+        ESP_LOGE(TAG, "Server got %lld of %u emits", (long long)run->sink_count, (unsigned)params->messages);
+        return ESP_FAIL;
+    }
+    result->emits_per_sec = per_sec(params->messages, elapsed);
+    result->allocs_per_emit = (double)(bench_alloc_count() - allocs) / params->messages;
+    return ESP_OK;
+}
+
+static int compare_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank, permille of the sorted samples
+static int64_t percentile(const int64_t *sorted, uint32_t count, uint32_t permille)
+{
+    uint64_t rank = ((uint64_t)count * permille + 999) / 1000;
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+static esp_err_t bench_round_trips(sio_client_id_t id, bench_run_t *run, const bench_params_t *params,
+                                   const char *payload, bench_result_t *result)
+{
+    uint64_t allocs = bench_alloc_count();
+    run->latency_count = 0;
+
+    for (uint32_t i = 0; i < params->round_trips; i++)
+    {
+        esp_err_t err = emit_payload(id, "bench_echo", esp_timer_get_time(), payload);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Echo %u failed: %s", (unsigned)i, esp_err_to_name(err));
+            return err;
+        }
+        if (xSemaphoreTake(run->done, pdMS_TO_TICKS(BENCH_REPLY_TIMEOUT_MS)) != pdTRUE)
+        {
+            ESP_LOGE(TAG, "Echo %u timed out", (unsigned)i);
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+
+    qsort(run->latencies_us, run->latency_count, sizeof(int64_t), compare_i64);
+    result->p50_us = percentile(run->latencies_us, run->latency_count, 500);
+    result->p99_us = percentile(run->latencies_us, run->latency_count, 990);
+    result->p999_us = percentile(run->latencies_us, run->latency_count, 999);
+    result->allocs_per_round_trip = (double)(bench_alloc_count() - allocs) / params->round_trips;
+    return ESP_OK;
+}
+
+// the server sends all of them at once, measured until the last one reached its handler
+static esp_err_t bench_inbound(sio_client_id_t id, bench_run_t *run, const bench_params_t *params,
+                               size_t payload_size, bench_result_t *result)
+{
+    run->flood_received = 0;
+    run->flood_expected = params->messages;
+    uint64_t allocs = bench_alloc_count();
+    int64_t start = esp_timer_get_time();
+
+    sio_emit_t emit;
+    sio_emit_begin(&emit, id, 0, "bench_flood");
+    sio_emit_int(&emit, params->messages);
+    sio_emit_int(&emit, payload_size);
+    esp_err_t err = sio_emit_send(&emit);
+    if (err != ESP_OK || xSemaphoreTake(run->done, pdMS_TO_TICKS(BENCH_REPLY_TIMEOUT_MS)) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Flood incomplete, %u of %u", (unsigned)run->flood_received, (unsigned)params->messages);
+        return err != ESP_OK ? err : ESP_ERR_TIMEOUT;
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    result->inbound_per_sec = per_sec(params->messages, elapsed);
+    result->allocs_per_inbound = (double)(bench_alloc_count() - allocs) / params->messages;
+    return ESP_OK;
+}
+
+static esp_err_t bench_run(const bench_params_t *params, sio_transport_t transport, size_t payload_size,
+                           bench_result_t *result)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+    sio_client_id_t id = -1;
+    bool registered = false;
+    bench_run_t run = {0};
+
+    char *payload = malloc(payload_size + 1);
+    run.done = xSemaphoreCreateBinary();
+    run.latencies_us = calloc(params->round_trips, sizeof(int64_t));
+    if (payload == NULL || run.done == NULL || run.latencies_us == NULL)
+    {
+        goto cleanup;
+    }
+    memset(payload, 'x', payload_size);
+    payload[payload_size] = '\0';
+
+    sio_client_config_t config = {
+        .server_address = params->server,
+        .base_mac = "00:00:00:00:00:00",
+        .transport = transport,
+        .upgrade_transport = false,
+    };
+    id = sio_client_init(&config);
+    if (id < 0)
+    {
+        err = ESP_FAIL;
+        goto cleanup;
+    }
+
+    err = esp_event_handler_register(SIO_EVENT, ESP_EVENT_ANY_ID, on_client_event, &run);
+    if (err != ESP_OK)
+    {
+        goto cleanup;
+    }
+    registered = true;
+    sio_on(id, "bench_echo", on_echo, &run);
+    sio_on(id, "bench_flood", on_flood, &run);
+
+    err = sio_client_begin(id);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to connect to %s: %s", params->server, esp_err_to_name(err));
+        goto cleanup;
+    }
+    if (xSemaphoreTake(run.done, pdMS_TO_TICKS(BENCH_CONNECT_TIMEOUT_MS)) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Namespace connect timed out");
+        err = ESP_ERR_TIMEOUT;
+        goto cleanup;
+    }
+
+    err = bench_emits(id, &run, params, payload, result);
+    if (err == ESP_OK)
+    {
+        err = bench_round_trips(id, &run, params, payload, result);
+    }
+    if (err == ESP_OK)
+    {
+        err = bench_inbound(id, &run, params, payload_size, result);
+    }
+
+cleanup:
+    if (id >= 0)
+    {
+        if (sio_client_is_connected(id))
+        {
+            sio_client_close(id);
+        }
+        sio_client_destroy(id);
+    }
+    if (registered)
+    {
+        esp_event_handler_unregister(SIO_EVENT, ESP_EVENT_ANY_ID, on_client_event);
+    }
+    if (run.done != NULL)
+    {
+        vSemaphoreDelete(run.done);
+    }
+    free(run.latencies_us);
+    free(payload);
+    return err;
+}
+
+void app_main(void)
+{
+    bench_params_t params = {
+        .server = getenv("SIO_BENCH_SERVER") != NULL ? getenv("SIO_BENCH_SERVER") : BENCH_DEFAULT_SERVER,
+        .messages = env_u32("SIO_BENCH_MESSAGES", BENCH_DEFAULT_MESSAGES),
+        .round_trips = env_u32("SIO_BENCH_ROUND_TRIPS", BENCH_DEFAULT_ROUND_TRIPS),
+    };
+    if (params.messages == 0 || params.round_trips == 0)
+    {
+        ESP_LOGE(TAG, "SIO_BENCH_MESSAGES and SIO_BENCH_ROUND_TRIPS must be at least 1");
+        exit(2);
+    }
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    printf("server %s, %u messages, %u round trips\n", params.server, (unsigned)params.messages,
+           (unsigned)params.round_trips);
+    printf("%-9s %7s %10s %10s %9s %9s %9s %11s %11s %11s\n", "transport", "payload", "emits/s", "inbound/s",
+           "rtt p50us", "p99us", "p99.9us", "allocs/emit", "allocs/in", "allocs/rtt");
+
+    int failures = 0;
+    for (size_t t = 0; t < sizeof(transports) / sizeof(transports[0]); t++)
+    {
+        const char *name = transports[t] == SIO_TRANSPORT_POLLING ? SIO_TRANSPORT_POLLING_STRING : SIO_TRANSPORT_WEBSOCKETS_STRING;
+        for (size_t s = 0; s < sizeof(payload_sizes) / sizeof(payload_sizes[0]); s++)
+        {
+            bench_result_t result = {0};
+            esp_err_t err = bench_run(&params, transports[t], payload_sizes[s], &result);
+            if (err != ESP_OK)
+            {
+                printf("%-9s %7zu failed: %s\n", name, payload_sizes[s], esp_err_to_name(err));
+                failures++;
+                continue;
+            }
+            printf("%-9s %7zu %10.0f %10.0f %9lld %9lld %9lld %11.2f %11.2f %11.2f\n", name, payload_sizes[s],
+                   result.emits_per_sec, result.inbound_per_sec, (long long)result.p50_us, (long long)result.p99_us,
+                   (long long)result.p999_us, result.allocs_per_emit, result.allocs_per_inbound,
+                   result.allocs_per_round_trip);
+        }
+    }
+
+    fflush(stdout);
+    exit(failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Compares two runs of sio_parser_bench, per corpus file and function.
+
+    python3 compare.py before.jsonl after.jsonl
+
+Changes in ns/packet below --threshold percent are shown but not flagged, single
+runs on a desktop easily move that much.
+"""
+
+import argparse
+import json
+
+
+def load(path):
+    results, config = {}, None
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith("{"):
+                continue
+            record = json.loads(line)
+            if record["bench"] == "config":
+                config = record
+            else:
+                results[(record["bench"], record["corpus"])] = record
+    return config, results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("before")
+    parser.add_argument("after")
+    parser.add_argument("--threshold", type=float, default=5.0, help="percent")
+    args = parser.parse_args()
+
+    config_before, before = load(args.before)
+    config_after, after = load(args.after)
+    if config_before != config_after:
+        print("configs differ: %s -> %s" % (config_before, config_after))
+
+    print("%-6s %-22s %12s %12s %8s %10s %10s" % ("bench", "corpus", "ns/pkt old", "ns/pkt new", "change", "allocs old", "allocs new"))
+    for key in sorted(set(before) | set(after)):
+        old, new = before.get(key), after.get(key)
+        if old is None or new is None:
+            print("%-6s %-22s %s" % (key[0], key[1], "only in " + ("after" if old is None else "before")))
+            continue
+        change = (new["ns_per_packet"] / old["ns_per_packet"] - 1) * 100 if old["ns_per_packet"] else 0.0
+        flag = ""
+        if abs(change) >= args.threshold:
+            flag = " slower" if change > 0 else " faster"
+        if new["allocs_per_packet"] != old["allocs_per_packet"]:
+            flag += " allocs"
+        print("%-6s %-22s %12.1f %12.1f %+7.1f%% %10.3f %10.3f%s" % (
+            key[0], key[1], old["ns_per_packet"], new["ns_per_packet"], change,
+            old["allocs_per_packet"], new["allocs_per_packet"], flag))
+
+
+if __name__ == "__main__":
+    main()
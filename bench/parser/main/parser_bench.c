@@ -0,0 +1,387 @@
+// Parser and framing microbenchmarks, one json line per corpus file and function:
+//
+//   split  polling bodies fed to http_rx_context_feed in MAX_HTTP_RECV_BUFFER pieces like
+//          HTTP_EVENT_ON_DATA does, record splitting and parse_packet included
+//   parse  parse_packet on records that are already split
+//   build  alloc_event_message / alloc_ack_message / alloc_binary_message for the events
+//          and acks of the corpus file, the outbound side
+//
+// The corpus directory holds polling response bodies (*.eio), records separated by 0x1e
+// exactly as on the wire. Captured bodies can be dropped in as they are.
+//
+//   SIO_PARSER_BENCH_CORPUS  corpus directory, defaults to bench/parser/corpus
+//   SIO_PARSER_BENCH_MIN_MS  length of one measured round, 200
+
+#include <bench_alloc.h>
+
+#include <internal/http_handlers.h>
+#include <internal/sio_packet.h>
+#include <sio_client.h>
+#include <sio_event_view.h>
+#include <esp_log.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *TAG = "[sio:parser_bench]";
+
+#define BENCH_ROUNDS 5 /* the median round is reported */
+#define BENCH_DEFAULT_MIN_MS 200
+#define BENCH_MAX_CORPUS_FILES 64
+#define BENCH_MAX_NAME 48
+
+// inputs for the builders, taken from one event or ack of the corpus
+typedef struct
+{
+    sio_packet_t type;
+    char *nsp;   // NULL for the root namespace
+    char *event; // NULL for acks
+    char *json;  // arguments without the surrounding brackets
+    int32_t ack_id;
+    uint8_t attachments;
+} bench_message_t;
+
+typedef struct
+{
+    char name[BENCH_MAX_NAME];
+    char *body;
+    size_t len;
+
+    // the body split at every separator, terminated like the splitter leaves records
+    size_t record_count;
+    size_t *record_offsets;
+    size_t *record_lens;
+    char *records;
+    sio_rx_buffer_t *scratch; // parse_packet decodes binary records in place
+
+    bench_message_t *messages;
+    size_t message_count;
+    size_t message_bytes; // bytes the builders produce per pass
+} corpus_entry_t;
+
+typedef void (*bench_pass_t)(corpus_entry_t *entry);
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void pass_split(corpus_entry_t *entry)
+{
+    sio_http_rx_context_t context = {0};
+    for (size_t offset = 0; offset < entry->len; offset += MAX_HTTP_RECV_BUFFER)
+    {
+        size_t len = entry->len - offset < MAX_HTTP_RECV_BUFFER ? entry->len - offset : MAX_HTTP_RECV_BUFFER;
+        http_rx_context_feed(&context, entry->body + offset, len, entry->len);
+    }
+    http_rx_context_finish(&context);
+    http_rx_context_reset(&context);
+}
+
+static void pass_parse(corpus_entry_t *entry)
+{
+    // restoring the records is part of the pass, one memcpy per body
+    memcpy(entry->scratch->data, entry->records, entry->len + 1);
+    for (size_t i = 0; i < entry->record_count; i++)
+    {
+        Packet_t packet = {
+            .data = entry->scratch->data + entry->record_offsets[i],
+            .len = entry->record_lens[i],
+            .rx_buffer = entry->scratch,
+            .ack_id = -1,
+        };
+        parse_packet(&packet);
+    }
+}
+
+static Packet_t *build_message(const bench_message_t *message)
+{
+    switch (message->type)
+    {
+    case SIO_PACKET_ACK:
+        return alloc_ack_message(message->nsp, message->json, message->ack_id);
+    case SIO_PACKET_BINARY_EVENT:
+        return alloc_binary_message(message->nsp, message->json, message->event, message->attachments);
+    default:
+        return alloc_event_message(message->nsp, message->json, message->event, message->ack_id);
+    }
+}
+
+static void pass_build(corpus_entry_t *entry)
+{
+    for (size_t i = 0; i < entry->message_count; i++)
+    {
+        Packet_t *packet = build_message(&entry->messages[i]);
+        if (packet != NULL)
+        {
+            free_packet(&packet);
+        }
+    }
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Doubles the iterations until a round lasts min_ms, then reports the median of BENCH_ROUNDS rounds.
+// Allocations come from one extra pass, they do not vary between passes.
+static void bench(const char *bench_name, corpus_entry_t *entry, bench_pass_t pass, size_t packets, size_t bytes,
+                  uint64_t min_ns)
+{
+    pass(entry); // warm up the pools
+
+    uint64_t allocs = bench_alloc_count();
+    pass(entry);
+    allocs = bench_alloc_count() - allocs;
+
+    uint64_t iterations = 1;
+    while (true)
+    {
+        uint64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            pass(entry);
+        }
+        if (now_ns() - start >= min_ns)
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    double ns_per_pass[BENCH_ROUNDS];
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        uint64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            pass(entry);
+        }
+        ns_per_pass[round] = (double)(now_ns() - start) / iterations;
+    }
+    qsort(ns_per_pass, BENCH_ROUNDS, sizeof(double), compare_double);
+    double median = ns_per_pass[BENCH_ROUNDS / 2];
+
+    printf("{\"bench\":\"%s\",\"corpus\":\"%s\",\"packets\":%zu,\"bytes\":%zu,\"iterations\":%llu,"
+           "\"ns_per_packet\":%.1f,\"bytes_per_sec\":%.0f,\"allocs_per_packet\":%.3f}\n",
+           bench_name, entry->name, packets, bytes, (unsigned long long)iterations, median / packets,
+           bytes * 1e9 / median, (double)allocs / packets);
+    fflush(stdout);
+}
+
+static char *dup_span(const char *start, size_t len)
+{
+    char *copy = malloc(len + 1);
+    if (copy != NULL)
+    {
+        memcpy(copy, start, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+// the json arguments of an event or ack without the array brackets and the event name
+static bool message_from_packet(const Packet_t *packet, bench_message_t *message)
+{
+    sio_event_view_t view;
+    if (packet->eio_type != EIO_PACKET_MESSAGE || sio_event_view_parse(&view, packet) != ESP_OK)
+    {
+        return false;
+    }
+    if (packet->sio_type != SIO_PACKET_EVENT && packet->sio_type != SIO_PACKET_ACK &&
+        packet->sio_type != SIO_PACKET_BINARY_EVENT)
+    {
+        return false;
+    }
+
+    const char *args = packet->json_start + 1;
+    if (view.event != NULL)
+    {
+        args = view.event + view.event_len + 1; // past the closing quote
+        if (*args == ',')
+        {
+            args++;
+        }
+    }
+    const char *end = packet->data + packet->len;
+    while (end > args && end[-1] != ']')
+    {
+        end--;
+    }
+    if (end == args)
+    {
+        return false;
+    }
+
+    memset(message, 0, sizeof(bench_message_t));
+    message->type = packet->sio_type;
+    message->ack_id = packet->ack_id;
+    message->attachments = packet->attachments_expected;
+    message->json = dup_span(args, end - 1 - args);
+    message->nsp = packet->nsp == NULL ? NULL : dup_span(packet->nsp, packet->nsp_len);
+    message->event = view.event == NULL ? NULL : dup_span(view.event, view.event_len);
+    return message->json != NULL;
+}
+
+static esp_err_t corpus_prepare(corpus_entry_t *entry)
+{
+    entry->record_count = 1;
+    for (size_t i = 0; i < entry->len; i++)
+    {
+        entry->record_count += entry->body[i] == ASCII_RS;
+    }
+    entry->record_offsets = calloc(entry->record_count, sizeof(size_t));
+    entry->record_lens = calloc(entry->record_count, sizeof(size_t));
+    entry->records = malloc(entry->len + 1);
+    entry->scratch = malloc(sizeof(sio_rx_buffer_t) + entry->len + 1);
+    if (entry->record_offsets == NULL || entry->record_lens == NULL || entry->records == NULL || entry->scratch == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    memcpy(entry->records, entry->body, entry->len);
+    entry->records[entry->len] = '\0';
+    size_t record = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= entry->len; i++)
+    {
+        if (i == entry->len || entry->records[i] == ASCII_RS)
+        {
+            entry->records[i] = '\0';
+            entry->record_offsets[record] = start;
+            entry->record_lens[record] = i - start;
+            record++;
+            start = i + 1;
+        }
+    }
+    memset(entry->scratch, 0, sizeof(sio_rx_buffer_t));
+    entry->scratch->refcount = 1;
+    entry->scratch->capacity = entry->len;
+    entry->scratch->len = entry->len;
+
+    // the builders get what the parser found, one message per event and ack
+    sio_http_rx_context_t context = {0};
+    if (http_rx_context_feed(&context, entry->body, entry->len, entry->len) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+    http_rx_context_finish(&context);
+    int count = get_array_size(context.packets);
+    entry->messages = calloc(count > 0 ? count : 1, sizeof(bench_message_t));
+    if (entry->messages == NULL)
+    {
+        http_rx_context_reset(&context);
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (message_from_packet(context.packets[i], &entry->messages[entry->message_count]))
+        {
+            Packet_t *built = build_message(&entry->messages[entry->message_count]);
+            if (built != NULL)
+            {
+                entry->message_bytes += built->len;
+                free_packet(&built);
+                entry->message_count++;
+            }
+        }
+    }
+    http_rx_context_reset(&context);
+    return ESP_OK;
+}
+
+static esp_err_t corpus_load(const char *dir, const char *file_name, corpus_entry_t *entry)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, file_name);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return ESP_FAIL;
+    }
+
+    memset(entry, 0, sizeof(corpus_entry_t));
+    size_t name_len = strlen(file_name) - strlen(".eio");
+    snprintf(entry->name, sizeof(entry->name), "%.*s", (int)name_len, file_name);
+
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    entry->body = malloc(len > 0 ? len : 1);
+    entry->len = entry->body == NULL || len <= 0 ? 0 : fread(entry->body, 1, len, file);
+    fclose(file);
+
+    if (entry->len == 0)
+    {
+        ESP_LOGE(TAG, "%s is empty or unreadable", path);
+        return ESP_FAIL;
+    }
+    return corpus_prepare(entry);
+}
+
+static int compare_name(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+void app_main(void)
+{
+    const char *dir = getenv("SIO_PARSER_BENCH_CORPUS") != NULL ? getenv("SIO_PARSER_BENCH_CORPUS") : SIO_PARSER_BENCH_CORPUS_DIR;
+    const char *min_ms = getenv("SIO_PARSER_BENCH_MIN_MS");
+    uint64_t min_ns = (min_ms != NULL ? strtoull(min_ms, NULL, 10) : BENCH_DEFAULT_MIN_MS) * 1000000ull;
+
+    DIR *corpus = opendir(dir);
+    if (corpus == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot open corpus directory %s", dir);
+        exit(2);
+    }
+    // sorted, the output of two runs lines up
+    char *names[BENCH_MAX_CORPUS_FILES];
+    size_t name_count = 0;
+    struct dirent *dirent;
+    while ((dirent = readdir(corpus)) != NULL && name_count < BENCH_MAX_CORPUS_FILES)
+    {
+        size_t len = strlen(dirent->d_name);
+        if (len > strlen(".eio") && len - strlen(".eio") < BENCH_MAX_NAME &&
+            strcmp(dirent->d_name + len - strlen(".eio"), ".eio") == 0)
+        {
+            names[name_count++] = strdup(dirent->d_name);
+        }
+    }
+    closedir(corpus);
+    qsort(names, name_count, sizeof(char *), compare_name);
+
+    printf("{\"bench\":\"config\",\"chunk\":%d,\"packet_pool\":%d,\"batch_pool\":%d,\"batch_capacity\":%d,"
+           "\"rx_buffer_pool\":%d,\"rounds\":%d,\"min_ms\":%llu}\n",
+           MAX_HTTP_RECV_BUFFER, CONFIG_SIO_PACKET_POOL_SIZE, CONFIG_SIO_BATCH_POOL_SIZE, CONFIG_SIO_BATCH_POOL_CAPACITY,
+           CONFIG_SIO_RX_BUFFER_POOL_SIZE, BENCH_ROUNDS, (unsigned long long)(min_ns / 1000000));
+
+    int failures = 0;
+    for (size_t i = 0; i < name_count; i++)
+    {
+        corpus_entry_t entry;
+        if (corpus_load(dir, names[i], &entry) != ESP_OK)
+        {
+            failures++;
+            continue;
+        }
+        bench("split", &entry, pass_split, entry.record_count, entry.len, min_ns);
+        bench("parse", &entry, pass_parse, entry.record_count, entry.len, min_ns);
+        if (entry.message_count > 0)
+        {
+            bench("build", &entry, pass_build, entry.message_count, entry.message_bytes, min_ns);
+        }
+        // the process ends right after, the entries are not freed
+    }
+
+    exit(failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,373 @@
+#!/usr/bin/env python3
+"""Engine.IO v4 / Socket.IO v4 stand-in server for the host benchmark.
+
+Only the standard library, only what the benchmark needs: polling with long
+polls, websockets (direct or upgraded from polling), namespace connects, acks
+and the bench_* events below. Every namespace behaves the same.
+
+    bench_sink  [seq, payload]  counted, nothing is sent back
+    bench_sync  (with ack)      acked with the number of bench_sink events since the last sync
+    bench_echo  [...]           sent back unchanged as bench_echo
+    bench_flood [count, size]   answered with count bench_flood [seq, payload] events
+    bench_stream [count, interval_ms, size]
+                                answered with count bench_stream [seq, payload] events, one per interval
+
+Any other event that wants an ack gets an empty one.
+
+    python3 sio_stand_in.py --port 8080
+"""
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import json
+import secrets
+import signal
+import sys
+from urllib.parse import parse_qs, urlsplit
+
+RECORD_SEPARATOR = "\x1e"
+WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC11B65"
+
+OP_CONTINUATION = 0x0
+OP_TEXT = 0x1
+OP_BINARY = 0x2
+OP_CLOSE = 0x8
+OP_PING = 0x9
+OP_PONG = 0xA
+
+
+class Session:
+    def __init__(self, server, websocket):
+        self.server = server
+        # engine.io sids are 20 characters, the client keeps it as it comes
+        self.sid = base64.urlsafe_b64encode(secrets.token_bytes(15)).decode()
+        self.outbox = []
+        self.outbox_ready = asyncio.Event()
+        self.websocket = websocket  # writer once the session runs on a websocket
+        self.poll_pending = False
+        self.closed = False
+        self.sink_count = 0
+        self.ping_task = asyncio.ensure_future(self.ping_loop())
+
+    def open_packet(self):
+        upgrades = [] if self.websocket is not None else ["websocket"]
+        return "0" + json.dumps({
+            "sid": self.sid,
+            "upgrades": upgrades,
+            "pingInterval": self.server.ping_interval,
+            "pingTimeout": self.server.ping_timeout,
+            "maxPayload": self.server.max_payload,
+        }, separators=(",", ":"))
+
+    async def ping_loop(self):
+        while not self.closed:
+            await asyncio.sleep(self.server.ping_interval / 1000)
+            self.send("2")
+
+    def send(self, packet):
+        self.send_many([packet])
+
+    def send_many(self, packets):
+        if self.closed:
+            return
+        if self.websocket is not None:
+            self.websocket.write(b"".join(encode_frame(OP_TEXT, p.encode()) for p in packets))
+        else:
+            self.outbox.extend(packets)
+            self.outbox_ready.set()
+
+    def take_outbox(self):
+        # one poll carries at most maxPayload bytes, the rest waits for the next one
+        taken, size = [], 0
+        while self.outbox and (not taken or size + len(self.outbox[0]) + 1 <= self.server.max_payload):
+            packet = self.outbox.pop(0)
+            taken.append(packet)
+            size += len(packet) + 1
+        if not self.outbox:
+            self.outbox_ready.clear()
+        return RECORD_SEPARATOR.join(taken)
+
+    async def stream(self, prefix, count, interval_ms, size):
+        # one event per poll, the client's receive cycle without anything to send
+        filler = "x" * size
+        for i in range(count):
+            await asyncio.sleep(interval_ms / 1000)
+            self.send("42%s[\"bench_stream\",%d,\"%s\"]" % (prefix, i, filler))
+
+    def close(self):
+        if self.closed:
+            return
+        self.closed = True
+        self.ping_task.cancel()
+        self.outbox_ready.set()  # ends a pending poll
+        self.server.sessions.pop(self.sid, None)
+
+    # engine.io packet from either transport
+    def on_packet(self, packet):
+        if not packet:
+            return
+        kind, body = packet[0], packet[1:]
+        if kind == "1":
+            self.close()
+        elif kind == "4":
+            self.on_socketio(body)
+        # pongs, noops and upgrade packets need no answer
+
+    def on_socketio(self, body):
+        if not body:
+            return
+        kind, rest = body[0], body[1:]
+        nsp = ""
+        if rest.startswith("/"):
+            end = rest.find(",")
+            nsp, rest = (rest, "") if end < 0 else (rest[:end], rest[end + 1:])
+        prefix = nsp + "," if nsp and nsp != "/" else ""
+
+        if kind == "0":
+            self.send("40" + prefix + json.dumps({"sid": self.sid}, separators=(",", ":")))
+            return
+        if kind != "2":
+            return  # disconnects and acks from the client need no answer
+
+        digits = 0
+        while digits < len(rest) and rest[digits].isdigit():
+            digits += 1
+        ack_id, payload = rest[:digits], rest[digits:]
+        try:
+            args = json.loads(payload)
+        except ValueError:
+            print("bad event payload: %r" % payload[:80], file=sys.stderr)
+            return
+        event = args[0] if args else None
+
+        if event == "bench_sink":
+            self.sink_count += 1
+        elif event == "bench_echo":
+            self.send("42" + prefix + payload)
+        elif event == "bench_flood":
+            count, size = int(args[1]), int(args[2])
+            filler = "x" * size
+            self.send_many(["42%s[\"bench_flood\",%d,\"%s\"]" % (prefix, i, filler) for i in range(count)])
+        elif event == "bench_stream":
+            asyncio.ensure_future(self.stream(prefix, int(args[1]), int(args[2]), int(args[3])))
+
+        if ack_id:
+            reply = "[]"
+            if event == "bench_sync":
+                reply = "[%d]" % self.sink_count
+                self.sink_count = 0
+            self.send("43" + prefix + ack_id + reply)
+
+
+class Server:
+    def __init__(self, args):
+        self.path = args.path.rstrip("/") + "/"
+        self.ping_interval = args.ping_interval
+        self.ping_timeout = args.ping_timeout
+        self.max_payload = args.max_payload
+        self.sessions = {}
+
+    async def handle_connection(self, reader, writer):
+        try:
+            # http keep-alive, the posting client reuses its connection
+            while True:
+                request = await read_request(reader)
+                if request is None:
+                    break
+                method, target, headers, body = request
+                url = urlsplit(target)
+                query = {k: v[0] for k, v in parse_qs(url.query).items()}
+
+                if url.path.rstrip("/") + "/" != self.path or query.get("EIO") != "4":
+                    write_response(writer, 400, "bad request")
+                elif headers.get("upgrade", "").lower() == "websocket":
+                    await self.handle_websocket(reader, writer, headers, query)
+                    break
+                elif method == "GET":
+                    await self.handle_poll(writer, query)
+                elif method == "POST":
+                    self.handle_post(writer, query, body)
+                else:
+                    write_response(writer, 405, "method not allowed")
+                await writer.drain()
+        except (ConnectionError, asyncio.IncompleteReadError):
+            pass
+        finally:
+            writer.close()
+
+    async def handle_poll(self, writer, query):
+        sid = query.get("sid")
+        if sid is None:
+            session = Session(self, None)
+            self.sessions[session.sid] = session
+            write_response(writer, 200, session.open_packet())
+            return
+
+        session = self.sessions.get(sid)
+        if session is None or session.poll_pending:
+            write_response(writer, 400, "unknown session or overlapping poll")
+            return
+        session.poll_pending = True
+        try:
+            await session.outbox_ready.wait()
+        finally:
+            session.poll_pending = False
+        if session.closed:
+            write_response(writer, 200, "1")
+        elif session.websocket is not None:
+            write_response(writer, 200, "6")  # upgraded meanwhile
+        else:
+            write_response(writer, 200, session.take_outbox())
+
+    def handle_post(self, writer, query, body):
+        session = self.sessions.get(query.get("sid"))
+        if session is None:
+            write_response(writer, 400, "unknown session")
+            return
+        for packet in body.decode("utf-8", "replace").split(RECORD_SEPARATOR):
+            session.on_packet(packet)
+        write_response(writer, 200, "ok")
+
+    async def handle_websocket(self, reader, writer, headers, query):
+        sid = query.get("sid")
+        session = self.sessions.get(sid) if sid is not None else None
+        if sid is not None and session is None:
+            write_response(writer, 400, "unknown session")
+            return
+
+        accept = base64.b64encode(hashlib.sha1((headers["sec-websocket-key"] + WEBSOCKET_GUID).encode()).digest())
+        writer.write(b"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                     b"Sec-WebSocket-Accept: " + accept + b"\r\n\r\n")
+
+        if session is None:
+            session = Session(self, writer)
+            self.sessions[session.sid] = session
+            writer.write(encode_frame(OP_TEXT, session.open_packet().encode()))
+
+        try:
+            async for opcode, payload in read_frames(reader):
+                if opcode == OP_CLOSE:
+                    writer.write(encode_frame(OP_CLOSE, payload[:2]))
+                    break
+                if opcode == OP_PING:
+                    writer.write(encode_frame(OP_PONG, payload))
+                elif opcode == OP_TEXT:
+                    packet = payload.decode("utf-8", "replace")
+                    if packet == "2probe":
+                        writer.write(encode_frame(OP_TEXT, b"3probe"))
+                    elif packet == "5" and session.websocket is None:
+                        # the upgrade is done, what the polling side still had goes out here
+                        pending = session.outbox
+                        session.outbox = []
+                        session.websocket = writer
+                        session.outbox_ready.set()  # the pending poll ends with a noop
+                        session.send_many(pending)
+                    else:
+                        session.on_packet(packet)
+                # binary attachments are not part of the benchmark
+                await writer.drain()
+        finally:
+            if session.websocket is writer:
+                session.close()
+
+
+async def read_request(reader):
+    try:
+        head = await reader.readuntil(b"\r\n\r\n")
+    except asyncio.IncompleteReadError:
+        return None
+    lines = head.decode("latin-1").split("\r\n")
+    method, target, _ = lines[0].split(" ", 2)
+    headers = {}
+    for line in lines[1:]:
+        if ":" in line:
+            name, value = line.split(":", 1)
+            headers[name.strip().lower()] = value.strip()
+
+    body = b""
+    if headers.get("transfer-encoding", "").lower() == "chunked":
+        chunks = []
+        while True:
+            size = int((await reader.readuntil(b"\r\n")).split(b";")[0], 16)
+            chunk = await reader.readexactly(size + 2)
+            if size == 0:
+                break
+            chunks.append(chunk[:-2])
+        body = b"".join(chunks)
+    elif "content-length" in headers:
+        body = await reader.readexactly(int(headers["content-length"]))
+    return method, target, headers, body
+
+
+def write_response(writer, status, text):
+    body = text.encode()
+    reason = {200: "OK", 400: "Bad Request", 405: "Method Not Allowed"}[status]
+    writer.write(("HTTP/1.1 %d %s\r\nContent-Type: text/plain; charset=UTF-8\r\nContent-Length: %d\r\n"
+                  "Connection: keep-alive\r\n\r\n" % (status, reason, len(body))).encode() + body)
+
+
+def encode_frame(opcode, payload):
+    length = len(payload)
+    if length < 126:
+        header = bytes([0x80 | opcode, length])
+    elif length < 1 << 16:
+        header = bytes([0x80 | opcode, 126]) + length.to_bytes(2, "big")
+    else:
+        header = bytes([0x80 | opcode, 127]) + length.to_bytes(8, "big")
+    return header + payload
+
+
+async def read_frames(reader):
+    message_opcode, fragments = None, []
+    while True:
+        first, second = await reader.readexactly(2)
+        fin, opcode = first & 0x80, first & 0x0F
+        length = second & 0x7F
+        if length == 126:
+            length = int.from_bytes(await reader.readexactly(2), "big")
+        elif length == 127:
+            length = int.from_bytes(await reader.readexactly(8), "big")
+        mask = await reader.readexactly(4) if second & 0x80 else None
+        payload = await reader.readexactly(length)
+        if mask is not None:
+            payload = bytes(b ^ mask[i & 3] for i, b in enumerate(payload))
+
+        if opcode >= OP_CLOSE:
+            yield opcode, payload  # control frames come between fragments
+            if opcode == OP_CLOSE:
+                return
+            continue
+        if opcode != OP_CONTINUATION:
+            message_opcode, fragments = opcode, []
+        fragments.append(payload)
+        if fin:
+            yield message_opcode, b"".join(fragments)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--path", default="/socket.io")
+    # short, a closing polling client waits for its last long poll to come back
+    parser.add_argument("--ping-interval", type=int, default=2000, help="ms")
+    parser.add_argument("--ping-timeout", type=int, default=20000, help="ms")
+    parser.add_argument("--max-payload", type=int, default=1000000, help="bytes per polling response")
+    args = parser.parse_args()
+
+    loop = asyncio.new_event_loop()
+    server = Server(args)
+    listener = loop.run_until_complete(asyncio.start_server(server.handle_connection, args.host, args.port))
+    print("listening on %s:%d" % (args.host, args.port), flush=True)
+    loop.add_signal_handler(signal.SIGTERM, loop.stop)
+    try:
+        loop.run_forever()
+    except KeyboardInterrupt:
+        pass
+    listener.close()
+
+
+if __name__ == "__main__":
+    main()
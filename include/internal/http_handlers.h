@@ -5,14 +5,35 @@ extern "C"
 #endif
 
 #include "esp_http_client.h"
+#include <internal/sio_packet.h>
+#include <internal/sio_metrics.h>
 
-#define ASCII_RS ' '
-#define ASCII_RS_STRING " "
+#define ASCII_RS '\x1e'
+#define ASCII_RS_STRING "\x1e"
 #define ASCII_RS_INDEX = 30
 
-    esp_err_t http_client_polling_get_handler(esp_http_client_event_t *evt);
+    // Receive state of one http client, handed to the handlers as user_data.
+    // Every connection has its own so they can all receive at the same time.
+    typedef struct
+    {
+        sio_rx_parser_t parser;
+        PacketPointerArray_t packets; // packets of the last response, taken over by whoever performed the request
+        Packet_t *binary_pending;     // binary event whose attachments did not all arrive yet
+
+        sio_record_filter_t record_filter; // handed to the parser of every response
+        void *record_filter_arg;
+        size_t records_dropped; // records of the last response the filter dropped
+
+        sio_metrics_recorder_t *metrics; // counts the body bytes, NULL for none
+    } sio_http_rx_context_t;
 
-    esp_err_t http_client_polling_post_handler(esp_http_client_event_t *evt);
+    void http_rx_context_reset(sio_http_rx_context_t *context);
+    // Body bytes of the current response, content_length -1 if not known up front
+    esp_err_t http_rx_context_feed(sio_http_rx_context_t *context, const char *data, size_t len, int64_t content_length);
+    // Ends the current response, its packets are left in context->packets
+    void http_rx_context_finish(sio_http_rx_context_t *context);
+
+    esp_err_t http_client_polling_get_handler(esp_http_client_event_t *evt);
 
 #ifdef __cplusplus
 }
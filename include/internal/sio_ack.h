@@ -0,0 +1,71 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "sdkconfig.h"
+#include <sio_types.h>
+#include <internal/sio_packet.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define SIO_MAX_PENDING_ACKS CONFIG_SIO_MAX_PENDING_ACKS
+#define SIO_ACK_TICK_MS 100     /* timeout resolution */
+#define SIO_ACK_WHEEL_SLOTS 32  /* one wheel turn is SIO_ACK_TICK_MS * SIO_ACK_WHEEL_SLOTS */
+
+    // ack is the 43/46 packet on SIO_ACK_RECEIVED, NULL otherwise. Runs in the task that received
+    // the ack or in the esp_timer task, it must not block.
+    typedef void (*sio_ack_cb_t)(sio_client_id_t client_id, sio_ack_status_t status, const Packet_t *ack, void *user_arg);
+
+    typedef struct
+    {
+        sio_ack_cb_t cb; // NULL if the slot is free
+        void *user_arg;
+        uint32_t id;
+        uint16_t rounds;   // wheel turns left before the timeout
+        bool expired;      // taken off the wheel, callback about to run
+        int16_t prev;      // bucket chain, -1 ends it
+        int16_t next;
+    } sio_ack_slot_t;
+
+    // Pending acks of one client. An id always lives in slot id % SIO_MAX_PENDING_ACKS so an
+    // incoming ack is found without searching, the timeouts hang in a timing wheel driven by one
+    // esp_timer that only runs while acks are pending.
+    typedef struct
+    {
+        sio_client_id_t client_id;
+        SemaphoreHandle_t lock;
+        esp_timer_handle_t timer;
+        bool timer_running;
+        bool ticking;                // a tick runs, possibly in a callback without the lock
+        bool closing;                // set by ack_table_deinit, ticks return right away
+        SemaphoreHandle_t tick_done; // given by a tick that ends while closing
+
+        uint32_t next_id;
+        uint16_t pending;
+        uint16_t cursor; // wheel bucket of the current tick
+        int16_t buckets[SIO_ACK_WHEEL_SLOTS];
+        sio_ack_slot_t slots[SIO_MAX_PENDING_ACKS];
+    } sio_ack_table_t;
+
+    esp_err_t ack_table_init(sio_ack_table_t *table, sio_client_id_t client_id);
+    // cancels everything still pending and waits for a running tick, not from an ack callback
+    void ack_table_deinit(sio_ack_table_t *table);
+
+    // reserves an id, cb fires exactly once: on the ack, the timeout or a cancel
+    esp_err_t ack_table_register(sio_ack_table_t *table, sio_ack_cb_t cb, void *user_arg, uint32_t timeout_ms, uint32_t *id_p);
+    // drops a registration without calling it, for emits that never went out
+    void ack_table_forget(sio_ack_table_t *table, uint32_t id);
+    void ack_table_cancel_all(sio_ack_table_t *table);
+
+    // fires and frees all acks in the array, *arr_p becomes NULL if nothing is left
+    void ack_table_take_acks(sio_ack_table_t *table, PacketPointerArray_t *arr_p);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "sdkconfig.h"
+#include <sio_types.h>
+#include <internal/sio_packet.h>
+#include <esp_err.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define SIO_DISPATCH_QUEUE_LEN CONFIG_SIO_DISPATCH_QUEUE_LEN
+
+    typedef struct
+    {
+        uint32_t posted;     /* events handed to the esp_event loop */
+        uint32_t dropped;    /* message batches lost to the overflow policy or a failed post */
+        uint32_t high_water; /* most events ever waiting in the queue */
+        uint32_t queued;     /* events waiting right now */
+    } sio_dispatch_stats_t;
+
+    typedef struct
+    {
+        sio_event_t event;
+        sio_namespace_id_t nsp;
+        PacketPointerArray_t packets;
+    } sio_dispatch_item_t;
+
+    // Events of one client on their way to the esp_event loop. The network side only touches
+    // a bounded ring under a spinlock, a task of its own waits on the event loop.
+    typedef struct
+    {
+        sio_client_id_t client_id;
+        sio_overflow_policy_t policy; // applies to message batches, state events always wait for room
+
+        portMUX_TYPE lock;
+        sio_dispatch_item_t items[SIO_DISPATCH_QUEUE_LEN];
+        uint16_t head;
+        uint16_t count;
+        bool stopping;
+        sio_dispatch_stats_t stats;
+
+        TaskHandle_t task;
+        SemaphoreHandle_t space;   // given whenever the task took an item, wakes blocked posters
+        SemaphoreHandle_t stopped; // given by the task on its way out
+    } sio_dispatch_queue_t;
+
+    esp_err_t dispatch_queue_init(sio_dispatch_queue_t *dispatch, sio_client_id_t client_id, sio_overflow_policy_t policy);
+    // stops the task, events still queued are dropped
+    void dispatch_queue_deinit(sio_dispatch_queue_t *dispatch);
+
+    // Queues event for the event loop, takes ownership of packets (NULL for none)
+    void dispatch_queue_post(sio_dispatch_queue_t *dispatch, sio_event_t event, sio_namespace_id_t nsp, PacketPointerArray_t packets);
+
+    void dispatch_queue_get_stats(sio_dispatch_queue_t *dispatch, sio_dispatch_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
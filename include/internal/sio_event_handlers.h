@@ -0,0 +1,66 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "sdkconfig.h"
+#include <sio_types.h>
+#include <sio_event_view.h>
+#include <internal/sio_packet.h>
+
+#include "freertos/FreeRTOS.h"
+
+#define SIO_MAX_EVENT_HANDLERS CONFIG_SIO_MAX_EVENT_HANDLERS
+#define SIO_EVENT_HANDLER_SLOTS (SIO_MAX_EVENT_HANDLERS * 2) /* open addressing stays at most half full */
+#define SIO_MAX_EVENT_NAME_LEN 32
+
+    // Runs in the receiving task, the packet and the view are gone once it returns
+    typedef void (*sio_on_handler_t)(sio_client_id_t client_id, const Packet_t *packet, const sio_event_view_t *view, void *ctx);
+
+    typedef enum
+    {
+        SIO_HANDLER_SLOT_EMPTY = 0,
+        SIO_HANDLER_SLOT_USED,
+        SIO_HANDLER_SLOT_DELETED /* keeps probe chains intact after sio_off */
+    } sio_handler_slot_state_t;
+
+    typedef struct
+    {
+        sio_handler_slot_state_t state;
+        uint32_t hash;
+        sio_namespace_id_t nsp;
+        uint8_t name_len;
+        char name[SIO_MAX_EVENT_NAME_LEN]; // json escaped, compared against the raw bytes on the wire
+        sio_on_handler_t handler;
+        void *ctx;
+    } sio_handler_slot_t;
+
+    // Event name -> handler hash table of one client, linear probing
+    typedef struct
+    {
+        portMUX_TYPE lock;
+        uint16_t count;
+        sio_handler_slot_t slots[SIO_EVENT_HANDLER_SLOTS];
+    } sio_event_handler_table_t;
+
+    void event_handler_table_init(sio_event_handler_table_t *table);
+    // replaces the handler if the event already has one
+    esp_err_t event_handler_table_add(sio_event_handler_table_t *table, sio_namespace_id_t nsp, const char *event,
+                                      sio_on_handler_t handler, void *ctx);
+    esp_err_t event_handler_table_remove(sio_event_handler_table_t *table, sio_namespace_id_t nsp, const char *event);
+    // no handlers means events are still posted on the event loop
+    bool event_handler_table_is_empty(sio_event_handler_table_t *table);
+
+    // Record filter for the parser (arg is the sio_client_t *): once handlers are registered,
+    // plain events without one are dropped before they become packets.
+    bool event_handler_accept_record(const char *record, size_t len, void *arg);
+
+    // Calls the handler of an event packet, false if it has none. The caller keeps the packet.
+    bool event_handler_table_dispatch(sio_event_handler_table_t *table, sio_client_id_t client_id,
+                                      sio_namespace_id_t nsp, const Packet_t *packet);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <esp_err.h>
+#include <esp_timer.h>
+
+#include "freertos/FreeRTOS.h"
+
+    // runs in the esp_timer task, it must not block
+    typedef void (*sio_heartbeat_expired_cb_t)(void *arg);
+
+    // Watchdog over the server pings of one session. A ping only stores its time, the one-shot
+    // timer checks the deadline when it fires and re-arms itself for whatever is left of it.
+    typedef struct
+    {
+        esp_timer_handle_t timer;
+        portMUX_TYPE lock;
+        uint32_t window_ms; // ping interval + ping timeout of the session, 0 while stopped
+        int64_t last_ping_us;
+
+        sio_heartbeat_expired_cb_t expired_cb;
+        void *arg;
+    } sio_heartbeat_t;
+
+    esp_err_t heartbeat_init(sio_heartbeat_t *heartbeat, sio_heartbeat_expired_cb_t expired_cb, void *arg);
+    void heartbeat_deinit(sio_heartbeat_t *heartbeat);
+
+    // session opened, expects the first ping within interval + timeout
+    void heartbeat_start(sio_heartbeat_t *heartbeat, uint32_t ping_interval_ms, uint32_t ping_timeout_ms);
+    void heartbeat_ping(sio_heartbeat_t *heartbeat);
+    void heartbeat_stop(sio_heartbeat_t *heartbeat);
+
+#ifdef __cplusplus
+}
+#endif
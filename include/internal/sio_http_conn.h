@@ -0,0 +1,100 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <internal/http_handlers.h>
+
+#include "freertos/FreeRTOS.h"
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#define SIO_HTTP_REQUEST_SIZE 512 /* request line and headers */
+#define SIO_HTTP_HEAD_SIZE 1024   /* response status line and headers */
+
+    typedef enum
+    {
+        SIO_HTTP_IDLE = 0,   /* no request in flight, the socket may be kept alive */
+        SIO_HTTP_CONNECTING, /* non-blocking connect in flight */
+        SIO_HTTP_SENDING,    /* request head and body partly written */
+        SIO_HTTP_HEAD,       /* waiting for status line and headers */
+        SIO_HTTP_BODY        /* body streaming into the receive context */
+    } sio_http_state_t;
+
+    typedef enum
+    {
+        SIO_HTTP_CHUNK_SIZE = 0, /* hex size line */
+        SIO_HTTP_CHUNK_DATA,
+        SIO_HTTP_CHUNK_DATA_END, /* CRLF after the data */
+        SIO_HTTP_CHUNK_TRAILER   /* after the last chunk, up to the empty line */
+    } sio_http_chunk_state_t;
+
+    // One keep-alive http/1.1 connection over a non-blocking socket, a request at a time. The
+    // request head is built once when the connection opens, requests and responses go through
+    // fixed buffers and never touch the heap. No lock, whoever owns the connection drives it.
+    typedef struct
+    {
+        sio_http_state_t state;
+        int fd;
+        bool reused; // the request went out on the socket of the last one
+        bool retried;
+        struct sockaddr_storage addr;
+        socklen_t addr_len;
+        sio_http_rx_context_t *rx; // response bodies go in here
+        TickType_t deadline;
+
+        char request[SIO_HTTP_REQUEST_SIZE];
+        size_t request_head;  // built part of the head, 0 while not open
+        size_t request_token; // offset of the cache buster in request, 0 for none
+        bool post;            // the head ends with the Content-Length value, added per request
+        size_t request_len;
+        const char *body;
+        size_t body_len;
+        size_t sent; // of request_len + body_len
+
+        char head[SIO_HTTP_HEAD_SIZE];
+        size_t head_len;
+
+        int status;
+        int64_t content_length; // -1 if the body ends with the connection or the last chunk
+        int64_t body_left;
+        bool chunked;
+        bool keep_alive;
+        sio_http_chunk_state_t chunk_state;
+        size_t chunk_left;
+        size_t line_len; // bytes of the current chunk size or trailer line
+        bool size_done;  // rest of the chunk size line is ignored
+    } sio_http_conn_t;
+
+    // host[:port] of server_address, blocks for the lookup
+    esp_err_t http_conn_resolve(const char *server_address, struct sockaddr_storage *addr, socklen_t *addr_len);
+
+    // an unopened connection without a socket, responses go to rx
+    void http_conn_init(sio_http_conn_t *conn, sio_http_rx_context_t *rx);
+    // Builds the request head for url (http://<host><path>), the socket connects with the first
+    // request. A GET moves the SIO_TOKEN_SIZE cache buster at token_offset of url (0 for none)
+    // on per request, a post sends its body as text/plain.
+    esp_err_t http_conn_open(sio_http_conn_t *conn, const char *url, size_t token_offset, bool post,
+                             const struct sockaddr_storage *addr, socklen_t addr_len);
+    // closes the socket, a request in flight is dropped and the head forgotten
+    void http_conn_close(sio_http_conn_t *conn);
+    bool http_conn_is_open(const sio_http_conn_t *conn);
+
+    // Starts a request, the body (NULL for a GET) is read until the request completes. A socket
+    // kept alive from the last request is reused.
+    esp_err_t http_conn_start(sio_http_conn_t *conn, const char *body, size_t body_len, TickType_t now, TickType_t timeout);
+    // what select has to wait for on behalf of a request in flight, and for how long at most
+    void http_conn_prepare(const sio_http_conn_t *conn, TickType_t now, fd_set *readable, fd_set *writable, int *max_fd, TickType_t *wait);
+    // Moves a request in flight on with what select reported. *done once the response is complete,
+    // its packets are in rx then and conn->status holds the status. ESP_ERR_TIMEOUT past the timeout,
+    // any error ends the request and closes the socket. A kept alive socket the server dropped
+    // meanwhile is replaced once, transparently.
+    esp_err_t http_conn_step(sio_http_conn_t *conn, TickType_t now, const fd_set *readable, const fd_set *writable, bool *done);
+    // start and step until the response is complete, blocks the calling task
+    esp_err_t http_conn_perform(sio_http_conn_t *conn, const char *body, size_t body_len, uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
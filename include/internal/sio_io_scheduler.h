@@ -0,0 +1,35 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <esp_err.h>
+
+#ifdef CONFIG_SIO_SHARED_IO_TASK
+#define SIO_SHARED_IO_TASK 1
+#define SIO_IO_TASK_STACK_SIZE CONFIG_SIO_IO_TASK_STACK_SIZE
+#define SIO_IO_TASK_PRIORITY CONFIG_SIO_IO_TASK_PRIORITY
+#define SIO_IO_TASK_CORE CONFIG_SIO_IO_TASK_CORE
+#define SIO_IO_TASK_MAX_SESSIONS CONFIG_SIO_IO_TASK_MAX_SESSIONS
+#else
+#define SIO_SHARED_IO_TASK 0
+#endif
+
+    struct sio_client_t;
+
+    // Hands the polling side of a freshly opened session to the shared I/O task, which polls,
+    // probes the websocket upgrade and posts the send queue and the journal over non-blocking
+    // sockets until polling_session_end.
+    // Starts the task on first use. ESP_ERR_NO_MEM once SIO_IO_TASK_MAX_SESSIONS are driven,
+    // ESP_ERR_NOT_SUPPORTED without CONFIG_SIO_SHARED_IO_TASK.
+    esp_err_t io_scheduler_add(struct sio_client_t *client);
+
+    // New packets in a send queue or a client closing, the task looks at all clients again.
+    // Safe from any task, does nothing before the task runs.
+    void io_scheduler_wake(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <sio_journal.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define SIO_JOURNAL_MAGIC 0x314a4f53 /* "SOJ1" */
+
+    // persisted at offset 0 of the storage, check guards against torn or foreign data
+    typedef struct
+    {
+        uint32_t magic;
+        uint32_t data_size;
+        uint32_t head;
+        uint32_t tail;
+        uint32_t check;
+    } sio_journal_header_t;
+
+    // Ring of outbound packets behind a storage backend. Records are a 16 bit length and the
+    // packet text, they never wrap: the rest of a lap is skipped (marked with 0xFFFF if there
+    // is room for it). head and tail are positions that only grow, modulo data_size on storage.
+    typedef struct
+    {
+        sio_journal_storage_t storage;
+        sio_journal_eviction_t eviction;
+        SemaphoreHandle_t lock; // held across storage I/O, replays included
+        uint32_t data_size;
+        uint32_t head;
+        uint32_t tail;
+        uint32_t evicted; // records dropped to make room
+        uint32_t epoch;   // moves on whenever records go without being replayed
+    } sio_journal_t;
+
+    // sends count records in order, len bytes separated by ASCII_RS. Anything but ESP_OK
+    // keeps them in the journal for the next replay.
+    typedef esp_err_t (*sio_journal_send_fn)(const char *records, size_t len, size_t count, void *arg);
+
+    // a buffer of at least size bytes, NULL if there is none
+    typedef char *(*sio_journal_reserve_fn)(size_t size, void *arg);
+
+    // records journal_peek copied out, journal_commit drops them once they were sent
+    typedef struct
+    {
+        char *records; // from reserve, separated by ASCII_RS and terminated
+        size_t len;
+        size_t count;
+        uint32_t from;
+        uint32_t to;
+        uint32_t epoch;
+    } sio_journal_batch_t;
+
+    // picks up whatever the storage holds from before a restart
+    esp_err_t journal_open(sio_journal_t *journal, const sio_journal_storage_t *storage, sio_journal_eviction_t eviction);
+    void journal_close(sio_journal_t *journal);
+
+    esp_err_t journal_append(sio_journal_t *journal, const char *data, size_t len);
+    bool journal_is_empty(sio_journal_t *journal);
+
+    // Hands the records to send from the oldest on, batches of up to batch_bytes
+    // (0 sends them one by one). Stops at the first failed send. ESP_ERR_TIMEOUT if the
+    // journal stayed busy for longer than wait.
+    esp_err_t journal_replay(sio_journal_t *journal, size_t batch_bytes, TickType_t wait, sio_journal_send_fn send, void *arg);
+
+    // The oldest batch like journal_replay would send it, copied into a buffer from reserve. The
+    // journal is not held while the batch is out, a sender that must not block sends it on its own
+    // time. ESP_ERR_NOT_FOUND when empty, ESP_ERR_TIMEOUT if busy for longer than wait.
+    esp_err_t journal_peek(sio_journal_t *journal, size_t batch_bytes, TickType_t wait, sio_journal_reserve_fn reserve, void *arg,
+                           sio_journal_batch_t *batch);
+    // Drops a peeked batch after it was sent. If the ring evicted records meanwhile the batch
+    // stays, the next replay sends part of it again.
+    esp_err_t journal_commit(sio_journal_t *journal, const sio_journal_batch_t *batch);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <sio_types.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+
+#include "freertos/FreeRTOS.h"
+
+#define SIO_METRICS_HISTOGRAM_BUCKETS 16
+
+    // Durations in log2 buckets of milliseconds: bucket 0 counts everything below 1 ms,
+    // bucket i everything below 2^i ms, the last one everything longer.
+    typedef struct
+    {
+        uint32_t buckets[SIO_METRICS_HISTOGRAM_BUCKETS];
+        uint32_t count;
+        uint64_t sum_ms;
+        uint32_t max_ms;
+    } sio_histogram_t;
+
+    typedef struct
+    {
+        sio_client_id_t client_id;
+
+        uint64_t bytes_in;    /* http bodies and websocket frames received */
+        uint64_t bytes_out;   /* post bodies and websocket frames sent */
+        uint32_t packets_in;  /* engine.io packets received, events without a handler included */
+        uint32_t packets_out; /* engine.io packets sent, a batched post counts all of its records */
+
+        uint32_t polls;       /* polling GETs that came back */
+        uint32_t poll_errors; /* failed GETs and ones that ended the session */
+        uint32_t posts;       /* polling POSTs */
+        uint32_t post_errors;
+        uint32_t pings;      /* server pings */
+        uint32_t reconnects; /* reconnect attempts */
+        uint32_t dropped_in;  /* received message batches the delivery queue lost */
+        uint32_t dropped_out; /* outbound packets lost to a full queue or a failed post */
+
+        sio_histogram_t poll_rtt;     /* GET sent to response parsed, a long poll waits for the server to have something */
+        sio_histogram_t post_latency; /* POST sent to the server's ok */
+
+        uint32_t heap_bytes;      /* held by the client: the client itself, post and emit buffers, queued packets */
+        uint32_t heap_peak_bytes; /* most heap_bytes ever held */
+
+        uint16_t send_queue_depth;     /* packets waiting to be posted */
+        uint16_t dispatch_queue_depth; /* events waiting for the esp_event loop */
+        uint16_t dispatch_high_water;
+        uint16_t acks_pending;
+        uint32_t journal_bytes; /* emits from while offline waiting for a replay */
+    } sio_metrics_t;
+
+    // runs in the esp_timer task, it must not block
+    typedef void (*sio_metrics_report_cb_t)(void *arg);
+
+    // The counters of one client. Every update is a few additions under a spinlock,
+    // the queue depths are only read when a snapshot is taken.
+    typedef struct
+    {
+        portMUX_TYPE lock;
+        sio_metrics_t values; // queue depths are left for the snapshot to fill in
+        int64_t poll_started_us; // one GET at a time per client
+
+        esp_timer_handle_t timer; // periodic report, NULL without one
+        sio_metrics_report_cb_t report_cb;
+        void *arg;
+    } sio_metrics_recorder_t;
+
+    // interval_ms 0 reports nothing on its own
+    esp_err_t metrics_init(sio_metrics_recorder_t *metrics, sio_client_id_t client_id, uint32_t interval_ms,
+                           sio_metrics_report_cb_t report_cb, void *arg);
+    void metrics_deinit(sio_metrics_recorder_t *metrics);
+
+    // all of them take NULL and do nothing
+    void metrics_count_in(sio_metrics_recorder_t *metrics, size_t bytes, uint32_t packets);
+    void metrics_count_out(sio_metrics_recorder_t *metrics, size_t bytes, uint32_t packets);
+    void metrics_drop_out(sio_metrics_recorder_t *metrics, uint32_t packets);
+    void metrics_poll_begin(sio_metrics_recorder_t *metrics);
+    // the GET from the last metrics_poll_begin is over
+    void metrics_poll_end(sio_metrics_recorder_t *metrics, bool ok);
+    void metrics_post(sio_metrics_recorder_t *metrics, int64_t started_us, bool ok);
+    void metrics_ping(sio_metrics_recorder_t *metrics);
+    void metrics_reconnect(sio_metrics_recorder_t *metrics);
+    // bytes the client took from (positive) or gave back to (negative) the heap
+    void metrics_heap(sio_metrics_recorder_t *metrics, int32_t delta);
+
+    // the counters so far, queue depths are zero
+    void metrics_snapshot(sio_metrics_recorder_t *metrics, sio_metrics_t *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "sdkconfig.h"
+#include <sio_types.h>
+#include <internal/sio_packet.h>
+#include <internal/sio_event_handlers.h>
+#include <internal/sio_dispatch.h>
+
+#include "freertos/FreeRTOS.h"
+
+#define SIO_MAX_NAMESPACES CONFIG_SIO_MAX_NAMESPACES
+#define SIO_MAX_NAMESPACE_LEN 32 /* including the leading slash and the terminator */
+#define SIO_RECOVERY_ID_LEN 48   /* pid and offset of connection state recovery, including the terminator */
+
+    typedef enum
+    {
+        SIO_NAMESPACE_FREE = 0,     /* Slot unused */
+        SIO_NAMESPACE_DISCONNECTED, /* Known, but not connected on the current session */
+        SIO_NAMESPACE_CONNECTING,   /* Connect sent, waiting for the server */
+        SIO_NAMESPACE_CONNECTED
+    } sio_namespace_state_t;
+
+    typedef struct
+    {
+        sio_namespace_state_t state;
+        char name[SIO_MAX_NAMESPACE_LEN];
+
+        // connection state recovery, both empty if the server does not offer it
+        char pid[SIO_RECOVERY_ID_LEN];    // private id the server handed out with the last connect
+        char offset[SIO_RECOVERY_ID_LEN]; // offset of the last event, the server appends it as last argument
+        bool recovered;                   // last connect resumed the previous session
+    } sio_namespace_t;
+
+    // Namespaces multiplexed over the session of one client, id 0 is the one from the config.
+    // Has its own lock, the receiving side looks up namespaces without the client lock.
+    typedef struct
+    {
+        portMUX_TYPE lock;
+        sio_namespace_t entries[SIO_MAX_NAMESPACES];
+    } sio_namespace_table_t;
+
+    void namespace_table_init(sio_namespace_table_t *table, const char *default_nsp);
+
+    // id of nsp, adds it if it is new, -1 if the table is full
+    sio_namespace_id_t namespace_table_add(sio_namespace_table_t *table, const char *nsp);
+    // name is not terminated, NULL is the root namespace
+    sio_namespace_id_t namespace_table_find(sio_namespace_table_t *table, const char *name, size_t len);
+    void namespace_table_remove(sio_namespace_table_t *table, sio_namespace_id_t id);
+
+    // copies the name of id into name, false if the slot is free
+    bool namespace_table_get_name(sio_namespace_table_t *table, sio_namespace_id_t id, char name[SIO_MAX_NAMESPACE_LEN]);
+
+    sio_namespace_state_t namespace_table_get_state(sio_namespace_table_t *table, sio_namespace_id_t id);
+    void namespace_table_set_state(sio_namespace_table_t *table, sio_namespace_id_t id, sio_namespace_state_t state);
+    // every known namespace goes back to disconnected, the session is gone.
+    // pid and offset stay so the next connect can ask the server to replay what was missed.
+    void namespace_table_session_lost(sio_namespace_table_t *table);
+
+    // Connect packet for id, auth is the json object sent along or NULL. Carries pid and offset
+    // as well once the server offered connection state recovery. NULL if id is not known.
+    Packet_t *namespace_table_alloc_connect(sio_namespace_table_t *table, sio_namespace_id_t id, const char *auth);
+    bool namespace_table_recovered(sio_namespace_table_t *table, sio_namespace_id_t id);
+
+    // Routes received packets to the namespaces they belong to and queues them for the event loop,
+    // one SIO_EVENT_RECEIVED_MESSAGE per namespace. Connects, disconnects and connect errors of a
+    // namespace become SIO_EVENT_NAMESPACE_* events. Once handlers are registered, events go to
+    // their handler instead and events without one are dropped.
+    // Takes ownership of the array, never locks the client.
+    void namespace_dispatch_packets(sio_dispatch_queue_t *dispatch, sio_namespace_table_t *table,
+                                    sio_event_handler_table_t *handlers, PacketPointerArray_t packets);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,8 +15,19 @@ extern "C"
 
 #include <sio_types.h>
 #include <esp_types.h>
+#include <esp_err.h>
 
+    // Receive buffer shared by all packets parsed out of it, freed with the last reference
     typedef struct
+    {
+        int refcount;
+        bool pooled;     // slot of the receive buffer pool
+        size_t len;      // bytes used
+        size_t capacity; // bytes available in data, not counting the terminator
+        char data[];
+    } sio_rx_buffer_t;
+
+    typedef struct Packet_t
     {
         eio_packet_t eio_type;
         sio_packet_t sio_type;
@@ -25,19 +36,100 @@ extern "C"
 
         char *data; // raw data
         size_t len;
+
+        sio_rx_buffer_t *rx_buffer; // set if data is a view into a receive buffer instead of owned
+        char control_data[2];       // storage for single character packets, see alloc_control_packet
+
+        uint8_t attachments_expected;      // binary event/ack: number of attachments announced in the header
+        struct Packet_t **attachments;     // binary event/ack: the received attachments in order, freed with the packet
+
+        int32_t ack_id; // event asking for an ack or the ack itself, -1 if none
+        const char *nsp; // namespace inside data without the separating comma, NULL for the root namespace
+        size_t nsp_len;
     } Packet_t;
 
     typedef Packet_t **PacketPointerArray_t;
 
     void parse_packet(Packet_t *packet_p);
 
+    sio_rx_buffer_t *alloc_rx_buffer(size_t capacity);
+    void rx_buffer_retain(sio_rx_buffer_t *buffer);
+    void rx_buffer_release(sio_rx_buffer_t **buffer_p_p);
+
+    // false drops the raw record before a packet is taken for it
+    typedef bool (*sio_record_filter_t)(const char *record, size_t len, void *arg);
+
+    // Incremental splitter for engine.io payloads. Bytes can be fed in pieces of any size,
+    // every record is cut out in place and parsed as soon as its separator arrives.
+    typedef struct
+    {
+        sio_rx_buffer_t *buffer; // buffer currently received into
+        size_t record_start;     // offset of the unfinished record in buffer
+        size_t size_hint;        // expected body size if known, sizes the first buffer
+
+        PacketPointerArray_t packets; // finished packets, views holding a buffer reference each
+
+        sio_record_filter_t filter; // optional, set after rx_parser_init
+        void *filter_arg;
+        size_t dropped; // records the filter dropped
+    } sio_rx_parser_t;
+
+    void rx_parser_init(sio_rx_parser_t *parser, size_t size_hint);
+    esp_err_t rx_parser_feed(sio_rx_parser_t *parser, const char *data, size_t len);
+    // ends the last record and returns all packets in one array, resets the parser
+    PacketPointerArray_t rx_parser_finish(sio_rx_parser_t *parser);
+    void rx_parser_reset(sio_rx_parser_t *parser);
+    bool rx_parser_started(const sio_rx_parser_t *parser);
+
+    // Splits a complete buffer the same way, takes over the callers reference.
+    // The packets are views into the buffer, free everything with free_packet_arr.
+    PacketPointerArray_t parse_packet_buffer(sio_rx_buffer_t *buffer);
+    // same for a buffer holding one binary frame
+    PacketPointerArray_t parse_binary_buffer(sio_rx_buffer_t *buffer);
+
+    // Moves binary attachments into the binary event or ack announcing them and drops them
+    // from the array. A header still waiting for attachments is kept in *pending_p across
+    // calls, it comes out in a later array once complete. *arr_p becomes NULL if nothing is left.
+    void packet_arr_collect_attachments(PacketPointerArray_t *arr_p, Packet_t **pending_p);
+
+    // Frees and drops every packet consume returns true for, keeps the order of the rest.
+    // *arr_p becomes NULL if nothing is left.
+    void packet_arr_filter(PacketPointerArray_t *arr_p, bool (*consume)(Packet_t *packet, void *arg), void *arg);
+
+    // Arrays know their size, get_array_size is O(1). Packets and arrays come from
+    // the pools in sio_pool.h, the heap only steps in when those run dry.
+    PacketPointerArray_t alloc_packet_arr(int count);
+    // appends and grows the array if needed, allocates it if *arr_p is NULL
+    esp_err_t packet_arr_append(PacketPointerArray_t *arr_p, Packet_t *packet);
+
     // locks internally
     Packet_t *alloc_message(const char *json_str, const char *event_str);
+    // 42[/nsp,][<ack_id>]["event",json], nsp NULL or "/" is the root namespace, ack_id -1 for none.
+    // The server answers an ack id with 43<ack_id>[...]
+    Packet_t *alloc_event_message(const char *nsp, const char *json_str, const char *event_str, int32_t ack_id);
+    // 43[/nsp,]<ack_id>[json], answers an event the server sent with an ack id
+    Packet_t *alloc_ack_message(const char *nsp, const char *json_str, uint32_t ack_id);
+    // connect (40/nsp,{auth}) or disconnect (41/nsp,) of a namespace
+    Packet_t *alloc_namespace_message(const char *nsp, sio_packet_t type, const char *json_str);
+
+    // 45<n>-[/nsp,]["event",json,{"_placeholder":true,"num":0},...], attachments are sent right after it
+    Packet_t *alloc_binary_message(const char *nsp, const char *json_str, const char *event_str, size_t attachment_count);
+
+    // 'b' + base64 record for polling, websockets send the raw bytes instead
+    Packet_t *alloc_base64_attachment(const sio_binary_t *attachment);
+
+    Packet_t *alloc_packet_copy(const Packet_t *packet);
+
+    // engine.io packet without payload (ping, pong, close, upgrade, ...)
+    Packet_t *alloc_control_packet(eio_packet_t type);
 
     int get_array_size(PacketPointerArray_t arr);
 
+    // packets inside an array go with free_packet_arr
     void free_packet(Packet_t **packet_p_p);
     void free_packet_arr(PacketPointerArray_t *arr_p_p);
+    // frees only the array, for packets that moved on somewhere else
+    void release_packet_arr(PacketPointerArray_t *arr_p_p);
 
     void print_packet(const Packet_t *packet_p);
     void print_packet_arr(PacketPointerArray_t arr);
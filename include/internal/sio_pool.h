@@ -0,0 +1,56 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "sdkconfig.h"
+#include <internal/sio_packet.h>
+#include <esp_types.h>
+
+#define SIO_PACKET_POOL_SIZE CONFIG_SIO_PACKET_POOL_SIZE
+#define SIO_BATCH_POOL_SIZE CONFIG_SIO_BATCH_POOL_SIZE
+#define SIO_BATCH_POOL_CAPACITY CONFIG_SIO_BATCH_POOL_CAPACITY
+#define SIO_RX_BUFFER_POOL_SIZE CONFIG_SIO_RX_BUFFER_POOL_SIZE
+#define SIO_RX_BUFFER_POOL_CAPACITY 512 /* fits pings, post answers and most events */
+
+    // Packet array with its size, PacketPointerArray_t points at packets
+    typedef struct
+    {
+        uint16_t count;
+        uint16_t capacity; // pointer slots, not counting the NULL terminator
+        bool pooled;
+        Packet_t *packets[]; // NULL terminated
+    } sio_packet_batch_t;
+
+    typedef struct
+    {
+        uint32_t packets_in_use;
+        uint32_t packets_peak;
+        uint32_t packet_heap_fallbacks; /* acquires served from the heap because the pool was empty */
+        uint32_t batches_in_use;
+        uint32_t batches_peak;
+        uint32_t batch_heap_fallbacks; /* includes batches too big for a pool slot */
+        uint32_t rx_buffers_in_use;
+        uint32_t rx_buffers_peak;
+        uint32_t rx_buffer_heap_fallbacks; /* includes buffers too big for a pool slot */
+    } sio_pool_stats_t;
+
+    // zeroed packet, from the pool if one is free
+    Packet_t *pool_acquire_packet(void);
+    void pool_release_packet(Packet_t *packet);
+
+    // empty batch for at least capacity packets
+    sio_packet_batch_t *pool_acquire_batch(size_t capacity);
+    void pool_release_batch(sio_packet_batch_t *batch);
+
+    // receive buffer for at least capacity bytes, refcount 1
+    sio_rx_buffer_t *pool_acquire_rx_buffer(size_t capacity);
+    void pool_release_rx_buffer(sio_rx_buffer_t *buffer);
+
+    void sio_pool_get_stats(sio_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
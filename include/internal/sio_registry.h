@@ -0,0 +1,34 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "sdkconfig.h"
+#include <sio_types.h>
+#include <esp_err.h>
+
+#define SIO_REGISTRY_MAX_CLIENTS CONFIG_SIO_MAX_PARALLEL_SOCKETS
+#define SIO_REGISTRY_CHUNK_SIZE 8 /* slots allocated at once, chunks are never freed */
+#define SIO_REGISTRY_INDEX_BITS 8 /* low bits of a handle, the generation of the slot sits above */
+
+    struct sio_client_t;
+
+    // Clients by handle. A handle is the slot index plus the generation of the slot, every client
+    // gets a new generation of its slot, so a stale handle never finds the next client.
+    // Lookups take no lock: chunks only ever get added and a slot is read like a seqlock.
+    // Removing does not wait for lookups in flight, calls on a handle must not race its destroy.
+
+    // Takes a slot and hands out its handle, lookups only find the client once it is published.
+    // ESP_ERR_NO_MEM once SIO_REGISTRY_MAX_CLIENTS are registered.
+    esp_err_t registry_reserve(sio_client_id_t *id);
+    void registry_publish(sio_client_id_t id, struct sio_client_t *client);
+    // NULL for unknown, stale and unpublished handles
+    struct sio_client_t *registry_get(sio_client_id_t id);
+    // false if the handle was stale already, exactly one remove of a handle succeeds
+    bool registry_remove(sio_client_id_t id);
+
+#ifdef __cplusplus
+}
+#endif
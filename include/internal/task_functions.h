@@ -1,3 +1,38 @@
 #pragma once
 
-void sio_polling_task(void *pvParameters);
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <sio_client.h>
+
+#define SIO_POLL_RETRY_DELAY_MS 250 /* times the retry count */
+
+    typedef enum
+    {
+        SIO_POLL_NEXT = 0,    /* start the next GET */
+        SIO_POLL_RETRY,       /* GET failed, retry after SIO_POLL_RETRY_DELAY_MS * failed_polls */
+        SIO_POLL_SESSION_LOST /* server closed the session or it failed for good */
+    } sio_poll_result_t;
+
+    typedef enum
+    {
+        SIO_POLLING_UPGRADED = 0, /* the session moved to the websocket */
+        SIO_POLLING_STOPPED,      /* sio_client_close */
+        SIO_POLLING_LOST          /* reconnects if the client wants to */
+    } sio_polling_end_t;
+
+    void sio_polling_task(void *pvParameters);
+    void sio_posting_task(void *pvParameters);
+    void sio_reconnect_task(void *pvParameters);
+
+    // Takes the response of one polling GET out of client->polling_rx and hands it out,
+    // err and status are what the request came back with. Without the client lock.
+    sio_poll_result_t polling_handle_response(sio_client_t *client, esp_err_t err, int status, uint8_t *failed_polls);
+    // Tears the polling side of the session down, locks internally
+    void polling_session_end(sio_client_t *client, sio_polling_end_t how);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "esp_event.h"
+#include "esp_websocket_client.h"
+
+    typedef enum
+    {
+        SIO_WEBSOCKET_STATE_CLOSED = 0, /* No connection or connection lost */
+        SIO_WEBSOCKET_STATE_HANDSHAKE,  /* Connecting, waiting for the engine.io open packet */
+        SIO_WEBSOCKET_STATE_PROBE,      /* Upgrading from polling, 2probe sent once connected */
+        SIO_WEBSOCKET_STATE_UPGRADE,    /* 3probe received, waiting for the upgrade packet to be sent */
+        SIO_WEBSOCKET_STATE_OPEN        /* Session established on the websocket */
+    } sio_websocket_state_t;
+
+    struct sio_client_t;
+
+    // handler_args has to be the sio_client_t * the websocket belongs to
+    void websocket_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
+
+    // Ends the running session as if the connection was lost, the socket itself is left to close
+    void websocket_session_dead(struct sio_client_t *client);
+
+    // Sends the journal one frame per record once namespace 0 is connected, without the client
+    // lock. ESP_ERR_TIMEOUT if the journal stayed busy for longer than wait.
+    esp_err_t websocket_replay_journal(struct sio_client_t *client, esp_websocket_client_handle_t ws, TickType_t wait);
+
+#ifdef __cplusplus
+}
+#endif
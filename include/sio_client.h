@@ -7,13 +7,21 @@ extern "C"
 
 #include <sio_types.h>
 #include <internal/http_handlers.h>
+#include <internal/sio_http_conn.h>
+#include <internal/websocket_handlers.h>
 #include <internal/sio_packet.h>
+#include <internal/sio_ack.h>
+#include <internal/sio_namespace.h>
+#include <internal/sio_heartbeat.h>
+#include <internal/sio_journal_ring.h>
+#include <internal/sio_metrics.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "esp_event.h"
+#include "esp_websocket_client.h"
 
 #define SIO_DEFAULT_EIO_VERSION 4
 #define SIO_DEFAULT_SIO_URL_PATH "/socket.io"
@@ -24,7 +32,7 @@ extern "C"
 #define SIO_TRANSPORT_POLLING_STRING "polling"
 #define SIO_TRANSPORT_POLLING_PROTO_STRING "http"
 
-#define SIO_TRANSPORT_WEBSOCKETS_STRING "websockets"
+#define SIO_TRANSPORT_WEBSOCKETS_STRING "websocket"
 #define SIO_TRANSPORT_WEBSOCKETS_PROTO_STRING "ws"
 
 #define SIO_SID_SIZE 20
@@ -32,8 +40,37 @@ extern "C"
 
 #define MAX_HTTP_RECV_BUFFER 512
 
+#define SIO_DEFAULT_MESSAGE_QUEUE_SIZE CONFIG_SIO_DEFAULT_MESSAGE_QUEUE_SIZE
+#define SIO_SEND_LINGER_MS CONFIG_SIO_SEND_LINGER_MS
+#define SIO_DEFAULT_MAX_PAYLOAD 1000000 /* engine.io default when the server does not say */
+
+#define SIO_RECONNECT_DELAY_MS CONFIG_SIO_RECONNECT_DELAY_MS
+#define SIO_RECONNECT_DELAY_MAX_MS CONFIG_SIO_RECONNECT_DELAY_MAX_MS
+#define SIO_RECONNECT_JITTER_PERCENT 50 /* delays spread +-50% so a fleet does not come back in lockstep */
+#define SIO_POLL_RETRIES CONFIG_SIO_POLL_RETRIES
+
+#define SIO_JOURNAL_REPLAY_BATCH 4096 /* bytes per replay post, less if the server's maxPayload is smaller */
+
+#define SIO_WEBSOCKET_HANDSHAKE_TIMEOUT_MS 10000
+#define SIO_WEBSOCKET_SEND_TIMEOUT_MS 5000
+#define SIO_POST_TIMEOUT_MS 5000
+
     typedef struct sio_client_t sio_client_t;
 
+    // Connection state, kept in one word so senders and status queries read it without any lock.
+    // Changed under the client lock, the websocket handler and heartbeat only clear SIO_STATE_WEBSOCKET.
+    // SIO_STATE_RECONNECTING is claimed lock free by sio_client_schedule_reconnect and cleared by the task.
+    typedef enum
+    {
+        SIO_STATE_SESSION = 1 << 0,             /* server_session_id is set */
+        SIO_STATE_POLLING = 1 << 1,             /* polling task or shared I/O task polls the session */
+        SIO_STATE_POSTING = 1 << 2,             /* the send queue gets posted */
+        SIO_STATE_WEBSOCKET = 1 << 3,           /* websocket side of the session is up */
+        SIO_STATE_TRANSPORT_WEBSOCKET = 1 << 4, /* the session runs (or starts) on websockets, else polling */
+        SIO_STATE_IO_SCHEDULED = 1 << 5,        /* the shared I/O task polls and posts instead of the two tasks */
+        SIO_STATE_RECONNECTING = 1 << 6,        /* a reconnect task runs, or is about to */
+    } sio_client_state_t;
+
     typedef const char *(*sio_auth_body_fptr_t)(const struct sio_client_t *client);
     typedef struct
     {
@@ -42,45 +79,119 @@ extern "C"
         const char *base_mac;
         const char *server_address; /* SocketIO server address with port (Excluding namespace)*/
         const char *sio_url_path;   /* SocketIO URL path, usually "/socket.io" */
-        const char *nspc;           /* SocketIO namespace */
+        const char *nspc;           /* SocketIO namespace connected with the session, namespace id 0 */
+        bool upgrade_transport;     /* Connect with polling, then upgrade to websockets if the server offers it */
+        sio_overflow_policy_t dispatch_overflow; /* What happens to received messages while the delivery queue is full */
+
+        bool reconnect;                  /* Handshake again with backoff once the session is lost */
+        uint16_t reconnect_max_attempts; /* 0 keeps trying */
+        uint32_t reconnect_delay_ms;     /* First delay, doubles per attempt. 0 uses CONFIG_SIO_RECONNECT_DELAY_MS */
+        uint32_t reconnect_delay_max_ms; /* 0 uses CONFIG_SIO_RECONNECT_DELAY_MAX_MS */
+
+        const sio_journal_storage_t *journal_storage; /* Keeps emits made while offline and replays them, NULL to lose them */
+        sio_journal_eviction_t journal_eviction;      /* What a full journal does with another emit */
 
         sio_auth_body_fptr_t alloc_auth_body_cb; /* Callback to generate auth body, will be free'd after use */
 
+        uint32_t metrics_interval_ms; /* Posts a sio_metrics_t as SIO_METRICS_EVENT this often, 0 for never */
+
     } sio_client_config_t;
 
     struct sio_client_t
     {
         sio_client_id_t client_id;
-        SemaphoreHandle_t client_lock;
+        SemaphoreHandle_t client_lock; /* session setup and teardown, never held across a send */
+        uint32_t state;                /* sio_client_state_t flags, see sio_client_state */
+        SemaphoreHandle_t send_lock;   /* outgoing network I/O: posting connection, post buffer, websocket frames */
+        SemaphoreHandle_t queue_lock;  /* admission to send_queue, held for a few queue operations only */
 
         uint8_t eio_version;
         char *base_mac;
         char *server_address;
         char *sio_url_path;
         char *nspc;
-        sio_transport_t transport;
+        sio_transport_t preferred_transport; /* transport from the config, a reconnect starts over with it */
+        bool upgrade_transport;
+
+        bool reconnect;
+        uint16_t reconnect_max_attempts;
+        uint32_t reconnect_delay_ms;
+        uint32_t reconnect_delay_max_ms;
 
         sio_auth_body_fptr_t alloc_auth_body_cb;
 
         // after init
 
         // info gotten from the server
-        uint16_t server_ping_interval_ms; /* Server-configured ping interval */
-        uint16_t server_ping_timeout_ms;  /* Server-configured ping wait-timeout */
+        uint32_t server_ping_interval_ms; /* Server-configured ping interval */
+        uint32_t server_ping_timeout_ms;  /* Server-configured ping wait-timeout */
+        bool server_upgrade_websocket;    /* Server offers the websocket upgrade */
+        uint32_t server_max_payload;      /* Max bytes per polling request body */
+
+        struct sockaddr_storage server_addr; /* server_address looked up once per handshake */
+        socklen_t server_addr_len;
 
         char *server_session_id; /* SocketIO session ID */
+        char *session_url;        /* polling url of the session, built once per handshake */
+        size_t session_url_token; /* offset of the SIO_TOKEN_SIZE cache buster in session_url */
 
         // used internally
         esp_http_client_handle_t handshake_client; /* Used to establish first connection*/
+        sio_http_rx_context_t handshake_rx;
+
+        sio_http_conn_t polling_conn; /* GETs of the polling task, kept alive between GETs */
+        sio_http_rx_context_t polling_rx;
+        TaskHandle_t polling_task;
 
-        esp_http_client_handle_t polling_client; /* Used for continuous polling */
-        bool polling_client_running;
+        sio_http_conn_t posting_conn; /* Used for posting messages, kept alive between posts */
+        sio_http_rx_context_t posting_rx;
 
-        esp_http_client_handle_t posting_client; /* Used for posting messages */
+        QueueHandle_t send_queue; /* Packet_t * waiting to be posted, drained by the posting task */
+        Packet_t *outbound_carry; /* taken from send_queue but did not fit the last post, send lock */
+        bool pong_owed;           /* the shared I/O task answered a ping, the next post carries the pong */
+        char *post_buffer;        /* body of batched posts, grows to the biggest one */
+        size_t post_buffer_capacity;
+        TaskHandle_t posting_task;
+
+        esp_websocket_client_handle_t websocket_client; /* Used for the websocket transport, receives in its own task */
+        sio_websocket_state_t websocket_state;
+        SemaphoreHandle_t websocket_handshake_done; /* Given by the websocket handler once the handshake is over */
+        sio_rx_buffer_t *websocket_recv_buffer;     /* Reassembly buffer for fragmented frames */
+        Packet_t *websocket_binary_pending;         /* Binary event waiting for its attachment frames */
+
+        sio_ack_table_t acks; /* emits waiting for their ack */
+
+        sio_heartbeat_t heartbeat; /* declares the session dead without a ping within pingInterval + pingTimeout */
+
+        SemaphoreHandle_t reconnect_wake; /* given by sio_client_close to cut the backoff short */
+        SemaphoreHandle_t reconnect_done; /* given by the reconnect task after clearing SIO_STATE_RECONNECTING */
+        bool reconnect_cancelled;         /* set by sio_client_close, cleared by sio_client_begin, atomic */
+
+        bool journal_enabled;  /* journal_storage was given */
+        sio_journal_t journal; /* plain emits while the session is down, oldest first */
+
+        sio_namespace_table_t namespaces; /* namespaces sharing this session, 0 is nspc */
+
+        sio_event_handler_table_t handlers; /* sio_on handlers, events bypass the event loop once there are any */
+
+        sio_dispatch_queue_t dispatch; /* events waiting for the esp_event loop */
+
+        SemaphoreHandle_t emit_lock; /* held by the sio_emit_t building in emit_buffer */
+        char *emit_buffer;           /* reused by every emit, grows to the biggest one */
+        size_t emit_buffer_capacity;
+
+        sio_metrics_recorder_t metrics; /* traffic counters, see sio_client_get_metrics */
     };
 
     ESP_EVENT_DECLARE_BASE(SIO_EVENT);
 
+    // a base of its own, handlers of SIO_EVENT expect sio_event_data_t
+    ESP_EVENT_DECLARE_BASE(SIO_METRICS_EVENT);
+    typedef enum
+    {
+        SIO_METRICS_EVENT_SNAPSHOT = 0, /* event data is a sio_metrics_t, every metrics_interval_ms */
+    } sio_metrics_event_t;
+
     esp_err_t sio_client_begin(const sio_client_id_t clientId);
 
     void unlockClient(sio_client_t *client);
@@ -91,19 +202,120 @@ extern "C"
     void sio_client_destroy(sio_client_id_t clientId);
 
     bool sio_client_is_inited(const sio_client_id_t clientId);
+    // lock free, never waits for a send or poll in progress
     bool sio_client_is_connected(sio_client_id_t clientId);
+    // delivery queue counters, tells whether the event handlers keep up
+    esp_err_t sio_client_get_dispatch_stats(const sio_client_id_t clientId, sio_dispatch_stats_t *stats);
+    // traffic, latency and heap of the client since init, lock free like the dispatch stats
+    esp_err_t sio_client_get_metrics(const sio_client_id_t clientId, sio_metrics_t *metrics);
     esp_err_t sio_client_close(const sio_client_id_t clientId);
 
+    // On polling the packet is copied into the send queue and posted by the posting task,
+    // packets sent in quick succession share one request. With a journal, events without
+    // an ack that come while the session is down are journaled and ESP_OK is returned.
     esp_err_t sio_send_packet(const sio_client_id_t clientId, const Packet_t *packet);
     esp_err_t sio_send_string(const sio_client_id_t clientId, const char *event, const char *data);
+    // same as sio_send_string on another namespace of the session
+    esp_err_t sio_send_string_to(const sio_client_id_t clientId, sio_namespace_id_t nsp, const char *event, const char *data);
+    // Emits event with data, cb is called once with the servers ack, on timeout or when the client closes
+    esp_err_t sio_send_string_ack(const sio_client_id_t clientId, const char *event, const char *data,
+                                  sio_ack_cb_t cb, void *user_arg, uint32_t timeout_ms);
+    // Answers an event the server sent with an ack id (packet->ack_id), data is the ack argument or NULL
+    esp_err_t sio_send_ack(const sio_client_id_t clientId, const Packet_t *event, const char *data);
+
+    // Emits event with data followed by the attachments as binary, placeholders are added to the
+    // arguments. Websockets send the attachments straight from the callers memory, polling as base64.
+    esp_err_t sio_send_binary(const sio_client_id_t clientId, const char *event, const char *data,
+                              const sio_binary_t *attachments, size_t attachment_count);
+
+    // Connects another namespace over the running session, auth is the json sent along or NULL.
+    // Returns the namespace id used in sio_event_data_t and sio_send_string_to, -1 on failure.
+    // SIO_EVENT_NAMESPACE_CONNECTED or SIO_EVENT_NAMESPACE_CONNECT_ERROR tells how it went.
+    sio_namespace_id_t sio_namespace_connect(const sio_client_id_t clientId, const char *nsp, const char *auth);
+    esp_err_t sio_namespace_disconnect(const sio_client_id_t clientId, sio_namespace_id_t nsp);
+    // -1 if the namespace is not known
+    sio_namespace_id_t sio_namespace_find(const sio_client_id_t clientId, const char *nsp);
+    // The last connect of nsp resumed the previous session (connection state recovery),
+    // the server replayed the events missed in between
+    bool sio_namespace_recovered(const sio_client_id_t clientId, sio_namespace_id_t nsp);
+
+    // Calls handler for every event named event on the default namespace, replaces an earlier one.
+    // Once a client has handlers, events go to them instead of SIO_EVENT_RECEIVED_MESSAGE and
+    // events without a handler are dropped while parsing. Handlers run in the receiving task.
+    esp_err_t sio_on(const sio_client_id_t clientId, const char *event, sio_on_handler_t handler, void *ctx);
+    esp_err_t sio_off(const sio_client_id_t clientId, const char *event);
+    esp_err_t sio_on_namespace(const sio_client_id_t clientId, sio_namespace_id_t nsp, const char *event,
+                               sio_on_handler_t handler, void *ctx);
+    esp_err_t sio_off_namespace(const sio_client_id_t clientId, sio_namespace_id_t nsp, const char *event);
 
     // locks the semaphore, get it first before doing
     // any writing else it will most certainly produce race conditions
     sio_client_t *sio_client_get_and_lock(const sio_client_id_t clientId);
+    // the client without its lock, for paths that only use the state word and the send side
+    sio_client_t *sio_client_get(const sio_client_id_t clientId);
+
+    // sio_client_state_t flags as last published
+    uint32_t sio_client_state(const sio_client_t *client);
+    // set and clear return the flags from before the change
+    uint32_t sio_client_state_set(sio_client_t *client, uint32_t flags);
+    uint32_t sio_client_state_clear(sio_client_t *client, uint32_t flags);
+    // sets and clears in one step, readers see either the old or the new state
+    uint32_t sio_client_state_change(sio_client_t *client, uint32_t set, uint32_t clear);
+    sio_transport_t sio_client_transport(const sio_client_t *client);
+    void sio_client_set_transport(sio_client_t *client, sio_transport_t transport);
 
     bool sio_client_is_locked(const sio_client_id_t clientId);
 
     char *alloc_polling_get_url(const sio_client_t *client);
+    // session_url with a fresh cache buster, changes in place. Only the polling side calls it
+    // while the session runs, NULL without a session.
+    const char *sio_client_session_url(sio_client_t *client);
+
+    // reads sid and ping settings from an engine.io open packet into the client
+    esp_err_t sio_client_apply_open_packet(sio_client_t *client, const Packet_t *packet);
+
+    // Probes a websocket for the polling session and switches the client over to it.
+    // Must be called without holding the client lock, holds the send lock for the switch.
+    esp_err_t sio_client_upgrade_transport(sio_client_t *client);
+    // The steps of sio_client_upgrade_transport for callers that cannot block on the probe.
+    // start opens the websocket, websocket_handshake_done is given once the probe is answered.
+    esp_err_t sio_client_upgrade_start(sio_client_t *client);
+    // Sends the upgrade packet and moves the session over. Queue and send lock held, everything
+    // queued already posted. ESP_ERR_INVALID_STATE once polling stopped meanwhile.
+    esp_err_t sio_client_upgrade_switch(sio_client_t *client);
+    // gives up on a started probe, report posts SIO_EVENT_UPGRADE_TRANSPORT_ERROR
+    void sio_client_upgrade_abandon(sio_client_t *client, bool report);
+
+    // Posts everything in the send queue, takes the send lock
+    esp_err_t sio_client_flush_outbound(sio_client_t *client);
+    // Fills the post buffer with the owed pong and what is queued, as much as one post may carry.
+    // Send lock held. ESP_ERR_NOT_FOUND with nothing to post.
+    esp_err_t sio_client_take_outbound(sio_client_t *client, size_t *len, size_t *records);
+    // Outcome of a post on posting_conn that started at started_us: frees the response,
+    // counts it, ESP_ERR_INVALID_RESPONSE for a status other than 200. Send lock held.
+    esp_err_t sio_client_post_done(sio_client_t *client, esp_err_t err, int64_t started_us, const char *body, size_t len);
+
+    // Answers a server ping without the client lock. On polling the pong jumps the send queue
+    // and goes out with the next post, the receiving side never waits for it.
+    esp_err_t sio_client_send_pong(sio_client_t *client);
+    // heartbeat expiry of the client in arg, runs in the esp_timer task
+    void sio_client_heartbeat_expired(void *arg);
+    // periodic metrics of the client in arg, runs in the esp_timer task
+    void sio_client_metrics_report(void *arg);
+
+    // Starts the reconnect task if the client wants one, the session must be torn down already.
+    // Never takes the client lock.
+    void sio_client_schedule_reconnect(sio_client_t *client);
+    // One handshake on behalf of the reconnect task, the other namespaces follow with their
+    // recovery ids. ESP_ERR_INVALID_STATE once the client was closed.
+    esp_err_t sio_client_reconnect(sio_client_t *client);
+
+    // Sends the journal once namespace 0 is connected again, takes the send lock.
+    // Polling posts the records in batches, websockets send one frame each.
+    esp_err_t sio_client_replay_journal(sio_client_t *client);
+    // Next journal batch for a polling post into the post buffer, never waits for the journal.
+    // Send lock held, journal_commit drops the batch once posted.
+    esp_err_t sio_client_take_journal(sio_client_t *client, sio_journal_batch_t *batch);
 
     // Events:
 
@@ -111,7 +323,8 @@ extern "C"
     typedef struct
     {
         sio_client_id_t client_id;
-        PacketPointerArray_t packets_pointer;
+        sio_namespace_id_t namespace_id; // namespace all packets belong to
+        PacketPointerArray_t packets_pointer; // binary events carry their attachments as views in packet->attachments
         int len;
     } sio_event_data_t;
 
@@ -0,0 +1,49 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <sio_client.h>
+#include <cJSON.h>
+
+    // Builds 42[/nsp,]["event",arg,...] straight into the reusable output buffer of the client,
+    // arguments are rendered and escaped in place without intermediate strings.
+    //
+    //   sio_emit_t emit;
+    //   sio_emit_begin(&emit, client_id, 0, "telemetry");
+    //   sio_emit_double(&emit, temperature);
+    //   sio_emit_string(&emit, sensor_name);
+    //   esp_err_t err = sio_emit_send(&emit);
+    //
+    // The buffer is held from begin until send or abort, other emits of the same client wait.
+    // Errors stick, only the result of sio_emit_send needs checking.
+    typedef struct
+    {
+        sio_client_t *client;
+        size_t len;
+        esp_err_t err;
+    } sio_emit_t;
+
+    esp_err_t sio_emit_begin(sio_emit_t *emit, const sio_client_id_t clientId, sio_namespace_id_t nsp, const char *event);
+
+    esp_err_t sio_emit_int(sio_emit_t *emit, int64_t value);
+    // NaN and infinity are not valid json and go out as null
+    esp_err_t sio_emit_double(sio_emit_t *emit, double value);
+    esp_err_t sio_emit_bool(sio_emit_t *emit, bool value);
+    esp_err_t sio_emit_null(sio_emit_t *emit);
+    esp_err_t sio_emit_string(sio_emit_t *emit, const char *value);
+    // already rendered json, copied as it is
+    esp_err_t sio_emit_json(sio_emit_t *emit, const char *json);
+    // printed straight into the buffer
+    esp_err_t sio_emit_cjson(sio_emit_t *emit, cJSON *json);
+
+    // sends and releases the buffer
+    esp_err_t sio_emit_send(sio_emit_t *emit);
+    // releases the buffer without sending
+    void sio_emit_abort(sio_emit_t *emit);
+
+#ifdef __cplusplus
+}
+#endif
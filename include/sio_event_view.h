@@ -0,0 +1,65 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <internal/sio_packet.h>
+#include <cJSON.h>
+
+#define SIO_EVENT_VIEW_MAX_ARGS 8 /* arguments past this are not tokenized */
+
+    typedef enum
+    {
+        SIO_ARG_INVALID = 0,
+        SIO_ARG_STRING,
+        SIO_ARG_NUMBER,
+        SIO_ARG_OBJECT,
+        SIO_ARG_ARRAY,
+        SIO_ARG_BOOL,
+        SIO_ARG_NULL
+    } sio_arg_type_t;
+
+    // Span of one argument inside the packet data, strings without their quotes and still escaped
+    typedef struct
+    {
+        sio_arg_type_t type;
+        const char *start;
+        size_t len;
+    } sio_arg_t;
+
+    // Tokenized view of an event or ack, only valid as long as the packet is.
+    //
+    //   sio_event_view_t view;
+    //   if (sio_event_view_parse(&view, packet) == ESP_OK && sio_event_view_is(&view, "set_led"))
+    //   {
+    //       int64_t brightness;
+    //       sio_arg_get_int(&view.args[0], &brightness);
+    //   }
+    typedef struct
+    {
+        const char *event; // raw event name, NULL for acks
+        size_t event_len;
+        int32_t ack_id; // -1 if the sender wants no ack
+        uint8_t arg_count;
+        sio_arg_t args[SIO_EVENT_VIEW_MAX_ARGS]; // arguments after the event name
+    } sio_event_view_t;
+
+    // Splits the json array of an event or ack packet into spans, nothing is allocated or copied
+    esp_err_t sio_event_view_parse(sio_event_view_t *view, const Packet_t *packet);
+    bool sio_event_view_is(const sio_event_view_t *view, const char *event);
+
+    // typed accessors, parse the span on demand
+    esp_err_t sio_arg_get_int(const sio_arg_t *arg, int64_t *value);
+    esp_err_t sio_arg_get_double(const sio_arg_t *arg, double *value);
+    esp_err_t sio_arg_get_bool(const sio_arg_t *arg, bool *value);
+    // unescapes into dst and terminates it, ESP_ERR_INVALID_SIZE if dst is too small
+    esp_err_t sio_arg_copy_string(const sio_arg_t *arg, char *dst, size_t dst_size);
+    bool sio_arg_string_equals(const sio_arg_t *arg, const char *str);
+    // full cJSON tree of one argument for the cases that need it, free with cJSON_Delete
+    cJSON *sio_arg_parse_json(const sio_arg_t *arg);
+
+#ifdef __cplusplus
+}
+#endif
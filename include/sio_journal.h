@@ -0,0 +1,38 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <esp_err.h>
+#include <esp_types.h>
+
+    // what a full journal does with another emit
+    typedef enum
+    {
+        SIO_JOURNAL_DROP_OLDEST = 0, /* oldest emits make room */
+        SIO_JOURNAL_REJECT_NEW       /* the new emit fails with ESP_ERR_NO_MEM */
+    } sio_journal_eviction_t;
+
+    // Byte addressed storage the offline journal lives in. Reads past anything ever written
+    // return zeros. The client takes the storage over and closes it on destroy.
+    typedef struct
+    {
+        esp_err_t (*read)(void *ctx, size_t offset, void *dst, size_t len);
+        esp_err_t (*write)(void *ctx, size_t offset, const void *src, size_t len);
+        void (*close)(void *ctx); // optional
+        size_t size;              // bytes the journal may use, header included
+        void *ctx;
+    } sio_journal_storage_t;
+
+    // Journal in NVS, split into blobs of SIO_JOURNAL_NVS_PAGE_SIZE in its own namespace.
+    // nvs_flash_init has to be done already.
+    esp_err_t sio_journal_storage_nvs(sio_journal_storage_t *storage, const char *nvs_namespace, size_t size);
+
+    // Journal in a file, anything with stdio works: SPIFFS, FAT or a file on the host
+    esp_err_t sio_journal_storage_file(sio_journal_storage_t *storage, const char *path, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
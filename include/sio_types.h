@@ -7,7 +7,8 @@ extern "C"
 
 #include <esp_types.h>
 
-    typedef int8_t sio_client_id_t;
+    typedef int32_t sio_client_id_t; /* slot and generation, -1 if invalid. Stale ids are rejected */
+    typedef int8_t sio_namespace_id_t; /* 0 is the namespace from the client config */
 
     // low level message
     typedef enum
@@ -20,7 +21,8 @@ extern "C"
         EIO_PACKET_PONG,
         EIO_PACKET_MESSAGE,
         EIO_PACKET_UPGRADE,
-        EIO_PACKET_NOOP
+        EIO_PACKET_NOOP,
+        EIO_PACKET_BINARY /* binary data, 'b' + base64 on polling, a binary frame on websockets */
     } eio_packet_t;
 
     // packets that talk about events
@@ -44,21 +46,49 @@ extern "C"
         SIO_EVENT_RECEIVED_MESSAGE,        /* SocketIO Client received message */
         SIO_EVENT_CONNECT_ERROR,           /* SocketIO Client failed to connect */
         SIO_EVENT_UPGRADE_TRANSPORT_ERROR, /* SocketIO Client failed upgrade transport */
-        SIO_EVENT_DISCONNECTED             /* SocketIO Client disconnected */
+        SIO_EVENT_DISCONNECTED,            /* SocketIO Client disconnected */
+        SIO_EVENT_NAMESPACE_CONNECTED,     /* Server accepted the connect to a namespace */
+        SIO_EVENT_NAMESPACE_DISCONNECTED,  /* Server disconnected a namespace */
+        SIO_EVENT_NAMESPACE_CONNECT_ERROR, /* Server refused the connect to a namespace */
+        SIO_EVENT_RECONNECTING,            /* Session lost, about to try another handshake */
+        SIO_EVENT_RECONNECT_FAILED         /* Gave up after reconnect_max_attempts */
     } sio_event_t;
 
+    // how an emit with ack ended
+    typedef enum
+    {
+        SIO_ACK_RECEIVED = 0, /* server acknowledged, the ack packet carries its arguments */
+        SIO_ACK_TIMEOUT,      /* no ack within the timeout */
+        SIO_ACK_CANCELLED     /* client closed before the ack arrived */
+    } sio_ack_status_t;
+
     typedef enum
     {
         SIO_CLIENT_DISCONNECTED = 0,
         SIO_CLIENT_CONNECTED,
     } sio_client_status_t;
 
+    // what a full delivery queue does with another message batch
+    typedef enum
+    {
+        SIO_OVERFLOW_BLOCK = 0,   /* receiving task waits for room */
+        SIO_OVERFLOW_DROP_OLDEST, /* oldest queued batch is dropped */
+        SIO_OVERFLOW_DROP_NEWEST  /* the new batch is dropped */
+    } sio_overflow_policy_t;
+
     typedef enum
     {
         SIO_TRANSPORT_POLLING = 0, /* polling */
         SIO_TRANSPORT_WEBSOCKETS   /* websockets */
     } sio_transport_t;
 
+    // raw bytes sent as a binary attachment, only borrowed for the duration of the send
+    typedef struct
+    {
+        const uint8_t *data;
+        size_t len;
+    } sio_binary_t;
+
     // http structs
 
 #ifdef __cplusplus
@@ -12,8 +12,21 @@ extern "C"
 #include "esp_err.h"
 
     char *alloc_random_string(const size_t length);
+    // next token after the len characters in place, no two requests of a session share one
+    void util_token_next(char *token, size_t len);
     void freeIfNotNull(void **ptr);
 
+    // base64 as used by engine.io for binary data on polling
+    size_t util_base64_encoded_len(size_t len);
+    // writes util_base64_encoded_len(len) characters, no terminator
+    void util_base64_encode(const uint8_t *src, size_t len, char *dst);
+    // decodes over the input, returns the decoded length or -1 on invalid input
+    int util_base64_decode_in_place(char *data, size_t len);
+
+    // JSON string escaping without the quotes, dst NULL only measures.
+    // Returns the escaped length, dst gets no terminator.
+    size_t util_json_escape(char *dst, const char *src, size_t len);
+
     // undef
 
     char *util_str_cat(char *destination, char *source);
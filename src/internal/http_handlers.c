@@ -8,12 +8,65 @@
 
 static const char *TAG = "[sio:http_handlers]";
 
+void http_rx_context_reset(sio_http_rx_context_t *context)
+{
+    rx_parser_reset(&context->parser);
+    if (context->packets != NULL)
+    {
+        free_packet_arr(&context->packets);
+    }
+    if (context->binary_pending != NULL)
+    {
+        free_packet(&context->binary_pending);
+    }
+}
+
+esp_err_t http_rx_context_feed(sio_http_rx_context_t *context, const char *data, size_t len, int64_t content_length)
+{
+    sio_rx_parser_t *parser = &context->parser;
+    if (!rx_parser_started(parser))
+    {
+        rx_parser_init(parser, content_length < 0 ? 0 : content_length);
+        parser->filter = context->record_filter;
+        parser->filter_arg = context->record_filter_arg;
+    }
+
+    metrics_count_in(context->metrics, len, 0);
+
+    // records are split and parsed as they complete, whatever the chunk boundaries
+    if (rx_parser_feed(parser, data, len) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to parse received data");
+        rx_parser_reset(parser);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void http_rx_context_finish(sio_http_rx_context_t *context)
+{
+    sio_rx_parser_t *parser = &context->parser;
+    if (!rx_parser_started(parser))
+    {
+        return; // no body
+    }
+
+    if (context->packets != NULL)
+    {
+        ESP_LOGE(TAG, "Previous response was not taken, this should not happen");
+        rx_parser_reset(parser);
+        return;
+    }
+
+    // only the last record is left to end, the array takes over all buffers
+    context->records_dropped = parser->dropped;
+    context->packets = rx_parser_finish(parser);
+}
+
 esp_err_t http_client_polling_get_handler(esp_http_client_event_t *evt)
 {
-    // TODO: This makes a race condition if the handler is used twice at the same time.
-    // I don't think this happenes due to the esp implementation under the hood
-    static char *recv_buffer = NULL;
-    static size_t recv_length = 0;
+    sio_http_rx_context_t *context = (sio_http_rx_context_t *)evt->user_data;
+    sio_rx_parser_t *parser = &context->parser;
 
     switch (evt->event_id)
     {
@@ -21,7 +74,7 @@ esp_err_t http_client_polling_get_handler(esp_http_client_event_t *evt)
         ESP_LOGD(TAG, "HTTP_EVENT_ERROR");
         break;
     case HTTP_EVENT_ON_CONNECTED:
-        ESP_LOGD(TAG, "HTTP_EVENT_ON_CONNECTED with pointer %p", recv_buffer);
+        ESP_LOGD(TAG, "HTTP_EVENT_ON_CONNECTED with pointer %p", parser->buffer);
         break;
     case HTTP_EVENT_HEADER_SENT:
         ESP_LOGD(TAG, "HTTP_EVENT_HEADER_SENT");
@@ -32,124 +85,14 @@ esp_err_t http_client_polling_get_handler(esp_http_client_event_t *evt)
     case HTTP_EVENT_ON_DATA:
         ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
 
-        if (!esp_http_client_is_chunked_response(evt->client))
-        {
-
-            if (recv_buffer == NULL)
-            {
-                int all_size = esp_http_client_get_content_length(evt->client) + 2;
-
-                recv_buffer = (char *)calloc(1, all_size);
-                recv_length = 0;
-
-                // ESP_LOGI(TAG, "allocated %d at %p", all_size, recv_buffer);
-
-                if (recv_buffer == NULL)
-                {
-                    ESP_LOGE(TAG, "Failed to allocate memory for output buffer");
-                    return ESP_FAIL;
-                }
-            }
-            memcpy((void *)recv_buffer + recv_length, evt->data, evt->data_len);
-            recv_length += evt->data_len;
-        }
-        else
         {
-            ESP_LOGD(TAG, "Chunked response %d %s", evt->data_len, (char *)evt->data);
+            // chunked responses have no length up front, the parser grows as needed
+            int64_t content_length = esp_http_client_is_chunked_response(evt->client) ? -1 : esp_http_client_get_content_length(evt->client);
+            return http_rx_context_feed(context, (const char *)evt->data, evt->data_len, content_length);
         }
-
-        break;
     case HTTP_EVENT_ON_FINISH:
         ESP_LOGD(TAG, "HTTP_EVENT_ON_FINISH");
-
-        // parse the data into packets, multi packet support
-        if (recv_buffer != NULL && recv_length > 0)
-        {
-            ESP_LOGD(TAG, "Received %i bytes at %p of data %s",
-                     recv_length, recv_buffer, (char *)recv_buffer);
-
-            recv_buffer[recv_length] = ASCII_RS;
-            recv_buffer[recv_length + 1] = '\0';
-
-            PacketPointerArray_t response_arr = *((PacketPointerArray_t *)evt->user_data);
-
-            if (response_arr != NULL)
-            {
-                ESP_LOGE(TAG, "User data is not null, this should not happen");
-                goto freeBuffers;
-            }
-
-            ESP_LOGD(TAG, "Received %i bytes of data  destination for arr pointer %p, %s,",
-                     recv_length, evt->user_data, (char *)recv_buffer);
-
-            // count how many packets ( by scanning for ASCII_RS)
-            // the '<=' is important so we take the end delimiter with us and know if there is a single packet
-            int rs_count = 0;
-            for (int i = 0; i <= recv_length; i++)
-            {
-                if (recv_buffer[i] == ASCII_RS)
-                {
-                    rs_count++;
-                }
-            }
-
-            ESP_LOGD(TAG, "Found %i packets", rs_count);
-
-            if (rs_count == 0)
-            {
-                // ???
-                ESP_LOGW(TAG, "No packets found, creating empty packet");
-
-                goto freeBuffers;
-            }
-
-            // allocate the response array of pointers
-            response_arr = (PacketPointerArray_t)calloc(rs_count + 1, sizeof(Packet_t *));
-
-            ESP_LOGD(TAG, "Allocated l:%d packets array %p", rs_count, response_arr);
-
-            if (response_arr == NULL)
-            {
-                ESP_LOGE(TAG, "Failed alloc response array");
-                goto freeBuffers;
-            }
-
-            // initially all of them are null, fill all of them up except the last which will stay null, indicating end
-
-            char *packet_start = strtok(recv_buffer, ASCII_RS_STRING);
-            for (int i = 0; i < rs_count; i++)
-            {
-
-                if (packet_start == NULL)
-                {
-                    ESP_LOGE(TAG, "Failed to parse packet");
-                    goto freeBuffers;
-                }
-
-                Packet_t *new_packet_p = (Packet_t *)calloc(1, sizeof(Packet_t));
-
-                ESP_LOGD(TAG, "Allocated packet %p", new_packet_p);
-
-                new_packet_p->data = strdup(packet_start);
-                new_packet_p->len = strlen(packet_start);
-                parse_packet(new_packet_p);
-
-                response_arr[i] = new_packet_p;
-
-                packet_start = strtok(NULL, ASCII_RS_STRING);
-            }
-            *((PacketPointerArray_t *)evt->user_data) = response_arr;
-            // print_packet_arr(response_arr);
-        }
-    freeBuffers:
-        if (recv_buffer != NULL)
-        {
-            // ESP_LOGI(TAG, "Freed %p", recv_buffer);
-            free(recv_buffer);
-        }
-        recv_buffer = NULL;
-        recv_length = 0;
-
+        http_rx_context_finish(context);
         break;
     case HTTP_EVENT_DISCONNECTED:
         ESP_LOGD(TAG, "HTTP_EVENT_DISCONNECTED");
@@ -159,12 +102,7 @@ esp_err_t http_client_polling_get_handler(esp_http_client_event_t *evt)
         {
             ESP_LOGD(TAG, "Last esp error code: 0x%x", err);
             ESP_LOGD(TAG, "Last mbedtls failure: 0x%x", mbedtls_err);
-            if (recv_buffer != NULL)
-            {
-                free(recv_buffer);
-                recv_buffer = NULL;
-                recv_length = 0;
-            }
+            rx_parser_reset(parser);
         }
 
         break;
@@ -178,8 +116,3 @@ esp_err_t http_client_polling_get_handler(esp_http_client_event_t *evt)
     }
     return ESP_OK;
 }
-
-esp_err_t http_client_polling_post_handler(esp_http_client_event_t *evt) // Any will do fine, posting is not done with the handler, handler only handles receiving
-{
-    return http_client_polling_get_handler(evt);
-}
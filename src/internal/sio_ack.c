@@ -0,0 +1,326 @@
+#include <internal/sio_ack.h>
+#include <esp_log.h>
+#include <string.h>
+
+static const char *TAG = "[sio:ack]";
+
+#define ACK_ID_MASK 0x7FFFFFFF // ids go out as json numbers, keep them positive
+
+static void ack_timer_tick(void *arg);
+
+// call with the table lock held
+static void ack_unlink(sio_ack_table_t *table, int16_t index)
+{
+    sio_ack_slot_t *slot = &table->slots[index];
+    if (slot->prev >= 0)
+    {
+        table->slots[slot->prev].next = slot->next;
+    }
+    else
+    {
+        for (int i = 0; i < SIO_ACK_WHEEL_SLOTS; i++)
+        {
+            if (table->buckets[i] == index)
+            {
+                table->buckets[i] = slot->next;
+                break;
+            }
+        }
+    }
+    if (slot->next >= 0)
+    {
+        table->slots[slot->next].prev = slot->prev;
+    }
+    slot->prev = -1;
+    slot->next = -1;
+}
+
+// call with the table lock held
+static void ack_free_slot(sio_ack_table_t *table, int16_t index)
+{
+    table->slots[index].cb = NULL;
+    table->slots[index].user_arg = NULL;
+    table->slots[index].expired = false;
+    table->pending--;
+}
+
+esp_err_t ack_table_init(sio_ack_table_t *table, sio_client_id_t client_id)
+{
+    memset(table, 0, sizeof(sio_ack_table_t));
+    table->client_id = client_id;
+
+    for (int i = 0; i < SIO_ACK_WHEEL_SLOTS; i++)
+    {
+        table->buckets[i] = -1;
+    }
+    for (int i = 0; i < SIO_MAX_PENDING_ACKS; i++)
+    {
+        table->slots[i].prev = -1;
+        table->slots[i].next = -1;
+    }
+
+    table->lock = xSemaphoreCreateMutex();
+    table->tick_done = xSemaphoreCreateBinary();
+    if (table->lock == NULL || table->tick_done == NULL)
+    {
+        if (table->lock != NULL)
+        {
+            vSemaphoreDelete(table->lock);
+            table->lock = NULL;
+        }
+        if (table->tick_done != NULL)
+        {
+            vSemaphoreDelete(table->tick_done);
+            table->tick_done = NULL;
+        }
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = ack_timer_tick,
+        .arg = table,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sio_ack",
+        .skip_unhandled_events = true};
+
+    esp_err_t err = esp_timer_create(&timer_args, &table->timer);
+    if (err != ESP_OK)
+    {
+        vSemaphoreDelete(table->lock);
+        vSemaphoreDelete(table->tick_done);
+        table->lock = NULL;
+        table->tick_done = NULL;
+    }
+    return err;
+}
+
+void ack_table_deinit(sio_ack_table_t *table)
+{
+    if (table->lock == NULL)
+    {
+        return;
+    }
+
+    ack_table_cancel_all(table);
+
+    // esp_timer_stop does not wait for a tick that already runs, that one still needs the lock
+    xSemaphoreTake(table->lock, portMAX_DELAY);
+    table->closing = true;
+    bool ticking = table->ticking;
+    xSemaphoreGive(table->lock);
+
+    esp_timer_stop(table->timer);
+    if (ticking)
+    {
+        xSemaphoreTake(table->tick_done, portMAX_DELAY);
+    }
+
+    esp_timer_delete(table->timer);
+    vSemaphoreDelete(table->lock);
+    vSemaphoreDelete(table->tick_done);
+    table->timer = NULL;
+    table->lock = NULL;
+    table->tick_done = NULL;
+}
+
+esp_err_t ack_table_register(sio_ack_table_t *table, sio_ack_cb_t cb, void *user_arg, uint32_t timeout_ms, uint32_t *id_p)
+{
+    if (cb == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(table->lock, portMAX_DELAY);
+
+    // ids keep counting up, skip the ones whose slot is still taken
+    int16_t index = -1;
+    uint32_t id = 0;
+    for (int tries = 0; tries < SIO_MAX_PENDING_ACKS; tries++)
+    {
+        id = table->next_id;
+        table->next_id = (table->next_id + 1) & ACK_ID_MASK;
+        if (table->slots[id % SIO_MAX_PENDING_ACKS].cb == NULL)
+        {
+            index = id % SIO_MAX_PENDING_ACKS;
+            break;
+        }
+    }
+
+    if (index < 0)
+    {
+        xSemaphoreGive(table->lock);
+        ESP_LOGW(TAG, "All %d ack slots are pending", SIO_MAX_PENDING_ACKS);
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t ticks = (timeout_ms + SIO_ACK_TICK_MS - 1) / SIO_ACK_TICK_MS;
+    if (ticks == 0)
+    {
+        ticks = 1;
+    }
+    uint16_t bucket = (table->cursor + ticks) % SIO_ACK_WHEEL_SLOTS;
+
+    sio_ack_slot_t *slot = &table->slots[index];
+    slot->cb = cb;
+    slot->user_arg = user_arg;
+    slot->id = id;
+    slot->rounds = (ticks - 1) / SIO_ACK_WHEEL_SLOTS;
+    slot->expired = false;
+    slot->prev = -1;
+    slot->next = table->buckets[bucket];
+    if (slot->next >= 0)
+    {
+        table->slots[slot->next].prev = index;
+    }
+    table->buckets[bucket] = index;
+    table->pending++;
+
+    if (!table->timer_running)
+    {
+        esp_timer_start_periodic(table->timer, SIO_ACK_TICK_MS * 1000);
+        table->timer_running = true;
+    }
+
+    xSemaphoreGive(table->lock);
+
+    *id_p = id;
+    return ESP_OK;
+}
+
+void ack_table_forget(sio_ack_table_t *table, uint32_t id)
+{
+    int16_t index = id % SIO_MAX_PENDING_ACKS;
+
+    xSemaphoreTake(table->lock, portMAX_DELAY);
+    sio_ack_slot_t *slot = &table->slots[index];
+    if (slot->cb != NULL && slot->id == id && !slot->expired)
+    {
+        ack_unlink(table, index);
+        ack_free_slot(table, index);
+    }
+    xSemaphoreGive(table->lock);
+}
+
+void ack_table_cancel_all(sio_ack_table_t *table)
+{
+    for (int16_t index = 0; index < SIO_MAX_PENDING_ACKS; index++)
+    {
+        xSemaphoreTake(table->lock, portMAX_DELAY);
+        sio_ack_slot_t *slot = &table->slots[index];
+        if (slot->cb == NULL || slot->expired)
+        {
+            // free, or the timer is about to report it
+            xSemaphoreGive(table->lock);
+            continue;
+        }
+        sio_ack_cb_t cb = slot->cb;
+        void *user_arg = slot->user_arg;
+        ack_unlink(table, index);
+        ack_free_slot(table, index);
+        xSemaphoreGive(table->lock);
+
+        cb(table->client_id, SIO_ACK_CANCELLED, NULL, user_arg);
+    }
+}
+
+static bool ack_resolve(Packet_t *packet, void *arg)
+{
+    sio_ack_table_t *table = (sio_ack_table_t *)arg;
+
+    if ((packet->sio_type != SIO_PACKET_ACK && packet->sio_type != SIO_PACKET_BINARY_ACK) || packet->ack_id < 0)
+    {
+        return false;
+    }
+
+    int16_t index = packet->ack_id % SIO_MAX_PENDING_ACKS;
+
+    xSemaphoreTake(table->lock, portMAX_DELAY);
+    sio_ack_slot_t *slot = &table->slots[index];
+    if (slot->cb == NULL || slot->id != (uint32_t)packet->ack_id || slot->expired)
+    {
+        xSemaphoreGive(table->lock);
+        ESP_LOGW(TAG, "Ack %ld is not pending, timed out already?", (long)packet->ack_id);
+        return true;
+    }
+    sio_ack_cb_t cb = slot->cb;
+    void *user_arg = slot->user_arg;
+    ack_unlink(table, index);
+    ack_free_slot(table, index);
+    xSemaphoreGive(table->lock);
+
+    cb(table->client_id, SIO_ACK_RECEIVED, packet, user_arg);
+    return true;
+}
+
+void ack_table_take_acks(sio_ack_table_t *table, PacketPointerArray_t *arr_p)
+{
+    packet_arr_filter(arr_p, ack_resolve, table);
+}
+
+static void ack_timer_tick(void *arg)
+{
+    sio_ack_table_t *table = (sio_ack_table_t *)arg;
+
+    xSemaphoreTake(table->lock, portMAX_DELAY);
+    if (table->closing)
+    {
+        xSemaphoreGive(table->lock);
+        return;
+    }
+    table->ticking = true;
+
+    table->cursor = (table->cursor + 1) % SIO_ACK_WHEEL_SLOTS;
+
+    // take the due entries off the wheel first, they stay reserved until their callback ran
+    int16_t expired_head = -1;
+    int16_t index = table->buckets[table->cursor];
+    while (index >= 0)
+    {
+        sio_ack_slot_t *slot = &table->slots[index];
+        int16_t next = slot->next;
+        if (slot->rounds > 0)
+        {
+            slot->rounds--;
+        }
+        else
+        {
+            ack_unlink(table, index);
+            slot->expired = true;
+            slot->next = expired_head;
+            expired_head = index;
+        }
+        index = next;
+    }
+    xSemaphoreGive(table->lock);
+
+    while (expired_head >= 0)
+    {
+        xSemaphoreTake(table->lock, portMAX_DELAY);
+        index = expired_head;
+        sio_ack_slot_t *slot = &table->slots[index];
+        expired_head = slot->next;
+        slot->next = -1;
+        sio_ack_cb_t cb = slot->cb;
+        void *user_arg = slot->user_arg;
+        ack_free_slot(table, index);
+        xSemaphoreGive(table->lock);
+
+        cb(table->client_id, SIO_ACK_TIMEOUT, NULL, user_arg);
+    }
+
+    xSemaphoreTake(table->lock, portMAX_DELAY);
+    if (table->pending == 0 && table->timer_running)
+    {
+        esp_timer_stop(table->timer);
+        table->timer_running = false;
+    }
+    table->ticking = false;
+    bool closing = table->closing;
+    xSemaphoreGive(table->lock);
+
+    if (closing)
+    {
+        // the table may be gone right after this
+        xSemaphoreGive(table->tick_done);
+    }
+}
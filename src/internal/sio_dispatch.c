@@ -0,0 +1,256 @@
+#include <internal/sio_dispatch.h>
+#include <sio_client.h>
+#include <esp_log.h>
+#include <string.h>
+
+static const char *TAG = "[sio:dispatch]";
+
+#define DISPATCH_TASK_STACK 3072
+#define DISPATCH_TASK_PRIORITY 5 /* below the network tasks */
+#define DISPATCH_BLOCK_RETRY_MS 100
+
+static bool droppable(const sio_dispatch_item_t *item)
+{
+    return item->event == SIO_EVENT_RECEIVED_MESSAGE;
+}
+
+static void drop_item(sio_dispatch_item_t *item)
+{
+    if (item->packets != NULL)
+    {
+        free_packet_arr(&item->packets);
+    }
+}
+
+// call with the lock held
+static sio_dispatch_item_t *item_at(sio_dispatch_queue_t *dispatch, uint16_t i)
+{
+    return &dispatch->items[(dispatch->head + i) % SIO_DISPATCH_QUEUE_LEN];
+}
+
+// call with the lock held, false if nothing in the ring may be dropped
+static bool remove_oldest_droppable(sio_dispatch_queue_t *dispatch, sio_dispatch_item_t *removed)
+{
+    for (uint16_t i = 0; i < dispatch->count; i++)
+    {
+        if (!droppable(item_at(dispatch, i)))
+        {
+            continue;
+        }
+        *removed = *item_at(dispatch, i);
+        // close the gap, everything behind it moves up one
+        for (uint16_t j = i + 1; j < dispatch->count; j++)
+        {
+            *item_at(dispatch, j - 1) = *item_at(dispatch, j);
+        }
+        dispatch->count--;
+        return true;
+    }
+    return false;
+}
+
+// call with the lock held
+static void push(sio_dispatch_queue_t *dispatch, const sio_dispatch_item_t *item)
+{
+    *item_at(dispatch, dispatch->count) = *item;
+    dispatch->count++;
+    if (dispatch->count > dispatch->stats.high_water)
+    {
+        dispatch->stats.high_water = dispatch->count;
+    }
+}
+
+static bool pop(sio_dispatch_queue_t *dispatch, sio_dispatch_item_t *item)
+{
+    bool taken = false;
+    portENTER_CRITICAL(&dispatch->lock);
+    if (!dispatch->stopping && dispatch->count > 0)
+    {
+        *item = dispatch->items[dispatch->head];
+        dispatch->head = (dispatch->head + 1) % SIO_DISPATCH_QUEUE_LEN;
+        dispatch->count--;
+        taken = true;
+    }
+    portEXIT_CRITICAL(&dispatch->lock);
+
+    if (taken)
+    {
+        xSemaphoreGive(dispatch->space);
+    }
+    return taken;
+}
+
+static void dispatch_task(void *pvParameters)
+{
+    sio_dispatch_queue_t *dispatch = (sio_dispatch_queue_t *)pvParameters;
+
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        sio_dispatch_item_t item;
+        while (pop(dispatch, &item))
+        {
+            // the array and the packets belong to the event receiver
+            sio_event_data_t event_data = {
+                .client_id = dispatch->client_id,
+                .namespace_id = item.nsp,
+                .packets_pointer = item.packets,
+                .len = get_array_size(item.packets)};
+
+            // a slow event loop only holds up this task, never the network side
+            esp_err_t err = esp_event_post(SIO_EVENT, item.event, &event_data, sizeof(sio_event_data_t), portMAX_DELAY);
+
+            portENTER_CRITICAL(&dispatch->lock);
+            if (err == ESP_OK)
+            {
+                dispatch->stats.posted++;
+            }
+            else
+            {
+                dispatch->stats.dropped++;
+            }
+            portEXIT_CRITICAL(&dispatch->lock);
+
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Failed to post event %d: %s", item.event, esp_err_to_name(err));
+                drop_item(&item);
+            }
+        }
+
+        portENTER_CRITICAL(&dispatch->lock);
+        bool stopping = dispatch->stopping;
+        portEXIT_CRITICAL(&dispatch->lock);
+        if (stopping)
+        {
+            break;
+        }
+    }
+
+    xSemaphoreGive(dispatch->stopped);
+    vTaskDelete(NULL);
+}
+
+esp_err_t dispatch_queue_init(sio_dispatch_queue_t *dispatch, sio_client_id_t client_id, sio_overflow_policy_t policy)
+{
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    memset(dispatch, 0, sizeof(sio_dispatch_queue_t));
+    dispatch->lock = unlocked;
+    dispatch->client_id = client_id;
+    dispatch->policy = policy;
+
+    dispatch->space = xSemaphoreCreateBinary();
+    dispatch->stopped = xSemaphoreCreateBinary();
+    if (dispatch->space == NULL || dispatch->stopped == NULL)
+    {
+        goto fail;
+    }
+
+    if (xTaskCreate(&dispatch_task, "sio_dispatch", DISPATCH_TASK_STACK, dispatch, DISPATCH_TASK_PRIORITY, &dispatch->task) != pdPASS)
+    {
+        goto fail;
+    }
+    return ESP_OK;
+
+fail:
+    ESP_LOGE(TAG, "Failed to set up dispatch queue");
+    if (dispatch->space != NULL)
+    {
+        vSemaphoreDelete(dispatch->space);
+    }
+    if (dispatch->stopped != NULL)
+    {
+        vSemaphoreDelete(dispatch->stopped);
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void dispatch_queue_deinit(sio_dispatch_queue_t *dispatch)
+{
+    portENTER_CRITICAL(&dispatch->lock);
+    dispatch->stopping = true;
+    portEXIT_CRITICAL(&dispatch->lock);
+
+    xTaskNotifyGive(dispatch->task);
+    xSemaphoreTake(dispatch->stopped, portMAX_DELAY);
+
+    // the task is gone, nobody else touches the ring anymore
+    while (dispatch->count > 0)
+    {
+        drop_item(item_at(dispatch, 0));
+        dispatch->head = (dispatch->head + 1) % SIO_DISPATCH_QUEUE_LEN;
+        dispatch->count--;
+    }
+
+    vSemaphoreDelete(dispatch->space);
+    vSemaphoreDelete(dispatch->stopped);
+}
+
+void dispatch_queue_post(sio_dispatch_queue_t *dispatch, sio_event_t event, sio_namespace_id_t nsp, PacketPointerArray_t packets)
+{
+    sio_dispatch_item_t item = {.event = event, .nsp = nsp, .packets = packets};
+    sio_overflow_policy_t policy = droppable(&item) ? dispatch->policy : SIO_OVERFLOW_BLOCK;
+
+    while (true)
+    {
+        sio_dispatch_item_t dropped = {0};
+        bool queued = false;
+        bool drop_new = false;
+
+        portENTER_CRITICAL(&dispatch->lock);
+        if (dispatch->stopping)
+        {
+            // client is going away, nobody would deliver it
+            dispatch->stats.dropped++;
+            drop_new = true;
+        }
+        else if (dispatch->count == SIO_DISPATCH_QUEUE_LEN)
+        {
+            if (policy == SIO_OVERFLOW_DROP_OLDEST && remove_oldest_droppable(dispatch, &dropped))
+            {
+                dispatch->stats.dropped++;
+            }
+            else if (policy == SIO_OVERFLOW_DROP_NEWEST)
+            {
+                dispatch->stats.dropped++;
+                drop_new = true;
+            }
+        }
+        if (!drop_new && dispatch->count < SIO_DISPATCH_QUEUE_LEN)
+        {
+            push(dispatch, &item);
+            queued = true;
+        }
+        portEXIT_CRITICAL(&dispatch->lock);
+
+        // packets are freed outside of the spinlock
+        if (dropped.packets != NULL)
+        {
+            ESP_LOGW(TAG, "Delivery queue of client %d full, dropped oldest batch", (int)dispatch->client_id);
+            drop_item(&dropped);
+        }
+        if (drop_new)
+        {
+            ESP_LOGW(TAG, "Delivery queue of client %d full, dropped event %d", (int)dispatch->client_id, event);
+            drop_item(&item);
+            return;
+        }
+        if (queued)
+        {
+            xTaskNotifyGive(dispatch->task);
+            return;
+        }
+
+        // full of events that may not be dropped, wait for the task to take one
+        xSemaphoreTake(dispatch->space, pdMS_TO_TICKS(DISPATCH_BLOCK_RETRY_MS));
+    }
+}
+
+void dispatch_queue_get_stats(sio_dispatch_queue_t *dispatch, sio_dispatch_stats_t *stats)
+{
+    portENTER_CRITICAL(&dispatch->lock);
+    *stats = dispatch->stats;
+    stats->queued = dispatch->count;
+    portEXIT_CRITICAL(&dispatch->lock);
+}
@@ -0,0 +1,247 @@
+#include <internal/sio_event_handlers.h>
+#include <internal/sio_namespace.h>
+#include <sio_client.h>
+#include <utility.h>
+#include <esp_log.h>
+#include <string.h>
+
+static const char *TAG = "[sio:event_handlers]";
+
+// FNV-1a over the namespace id and the escaped name, the same bytes the filter sees on the wire
+static uint32_t handler_hash(sio_namespace_id_t nsp, const char *name, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ (uint8_t)nsp) * 16777619u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool slot_matches(const sio_handler_slot_t *slot, uint32_t hash, sio_namespace_id_t nsp, const char *name, size_t len)
+{
+    return slot->state == SIO_HANDLER_SLOT_USED && slot->hash == hash && slot->nsp == nsp &&
+           slot->name_len == len && memcmp(slot->name, name, len) == 0;
+}
+
+// call with the table lock held, -1 if the event has no handler
+static int find_slot_locked(sio_event_handler_table_t *table, uint32_t hash, sio_namespace_id_t nsp, const char *name, size_t len)
+{
+    for (int i = 0; i < SIO_EVENT_HANDLER_SLOTS; i++)
+    {
+        int index = (hash + i) % SIO_EVENT_HANDLER_SLOTS;
+        sio_handler_slot_t *slot = &table->slots[index];
+        if (slot->state == SIO_HANDLER_SLOT_EMPTY)
+        {
+            return -1;
+        }
+        if (slot_matches(slot, hash, nsp, name, len))
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+static bool lookup(sio_event_handler_table_t *table, sio_namespace_id_t nsp, const char *name, size_t len,
+                   sio_on_handler_t *handler, void **ctx)
+{
+    uint32_t hash = handler_hash(nsp, name, len);
+
+    portENTER_CRITICAL(&table->lock);
+    int index = table->count > 0 ? find_slot_locked(table, hash, nsp, name, len) : -1;
+    if (index >= 0 && handler != NULL)
+    {
+        *handler = table->slots[index].handler;
+        *ctx = table->slots[index].ctx;
+    }
+    portEXIT_CRITICAL(&table->lock);
+    return index >= 0;
+}
+
+void event_handler_table_init(sio_event_handler_table_t *table)
+{
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    memset(table, 0, sizeof(sio_event_handler_table_t));
+    table->lock = unlocked;
+}
+
+esp_err_t event_handler_table_add(sio_event_handler_table_t *table, sio_namespace_id_t nsp, const char *event,
+                                  sio_on_handler_t handler, void *ctx)
+{
+    size_t event_len = strlen(event);
+    size_t len = util_json_escape(NULL, event, event_len);
+    if (handler == NULL || len == 0 || len > SIO_MAX_EVENT_NAME_LEN)
+    {
+        ESP_LOGE(TAG, "Invalid handler for %s", event);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char name[SIO_MAX_EVENT_NAME_LEN];
+    util_json_escape(name, event, event_len);
+    uint32_t hash = handler_hash(nsp, name, len);
+
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&table->lock);
+    int index = find_slot_locked(table, hash, nsp, name, len);
+    if (index < 0 && table->count < SIO_MAX_EVENT_HANDLERS)
+    {
+        // first free or deleted slot on the probe chain
+        for (int i = 0; i < SIO_EVENT_HANDLER_SLOTS; i++)
+        {
+            int candidate = (hash + i) % SIO_EVENT_HANDLER_SLOTS;
+            if (table->slots[candidate].state != SIO_HANDLER_SLOT_USED)
+            {
+                index = candidate;
+                break;
+            }
+        }
+        sio_handler_slot_t *slot = &table->slots[index];
+        slot->state = SIO_HANDLER_SLOT_USED;
+        slot->hash = hash;
+        slot->nsp = nsp;
+        slot->name_len = len;
+        memcpy(slot->name, name, len);
+        table->count++;
+    }
+    if (index >= 0)
+    {
+        table->slots[index].handler = handler;
+        table->slots[index].ctx = ctx;
+    }
+    else
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+    portEXIT_CRITICAL(&table->lock);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "No handler slot left for %s, increase SIO_MAX_EVENT_HANDLERS", event);
+    }
+    return err;
+}
+
+esp_err_t event_handler_table_remove(sio_event_handler_table_t *table, sio_namespace_id_t nsp, const char *event)
+{
+    size_t event_len = strlen(event);
+    size_t len = util_json_escape(NULL, event, event_len);
+    if (len == 0 || len > SIO_MAX_EVENT_NAME_LEN)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char name[SIO_MAX_EVENT_NAME_LEN];
+    util_json_escape(name, event, event_len);
+    uint32_t hash = handler_hash(nsp, name, len);
+
+    portENTER_CRITICAL(&table->lock);
+    int index = find_slot_locked(table, hash, nsp, name, len);
+    if (index >= 0)
+    {
+        table->slots[index].state = SIO_HANDLER_SLOT_DELETED;
+        table->slots[index].handler = NULL;
+        table->count--;
+        if (table->count == 0)
+        {
+            // nothing left to probe past, start over without tombstones
+            memset(table->slots, 0, sizeof(table->slots));
+        }
+    }
+    portEXIT_CRITICAL(&table->lock);
+
+    return index >= 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+bool event_handler_table_is_empty(sio_event_handler_table_t *table)
+{
+    portENTER_CRITICAL(&table->lock);
+    bool empty = table->count == 0;
+    portEXIT_CRITICAL(&table->lock);
+    return empty;
+}
+
+bool event_handler_accept_record(const char *record, size_t len, void *arg)
+{
+    sio_client_t *client = (sio_client_t *)arg;
+    sio_event_handler_table_t *table = &client->handlers;
+
+    // only plain events are judged, binary events still wait for their attachments
+    if (len < 2 || record[0] != '0' + EIO_PACKET_MESSAGE || record[1] != '0' + SIO_PACKET_EVENT)
+    {
+        return true;
+    }
+
+    if (event_handler_table_is_empty(table))
+    {
+        return true;
+    }
+
+    const char *p = record + 2;
+    const char *end = record + len;
+
+    const char *nsp = NULL;
+    size_t nsp_len = 0;
+    if (p < end && *p == '/')
+    {
+        const char *comma = memchr(p, ',', end - p);
+        if (comma == NULL)
+        {
+            return true; // let the parser complain
+        }
+        nsp = p;
+        nsp_len = comma - p;
+        p = comma + 1;
+    }
+    sio_namespace_id_t id = namespace_table_find(&client->namespaces, nsp, nsp_len);
+    if (id < 0)
+    {
+        return true; // dispatch reports unknown namespaces
+    }
+
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        p++; // ack id
+    }
+    if (end - p < 2 || p[0] != '[' || p[1] != '"')
+    {
+        return true;
+    }
+
+    // name up to the closing quote, escapes stay as they are
+    const char *name = p + 2;
+    const char *q = name;
+    while (q < end && *q != '"')
+    {
+        q += *q == '\\' ? 2 : 1;
+    }
+    if (q >= end)
+    {
+        return true;
+    }
+
+    return lookup(table, id, name, q - name, NULL, NULL);
+}
+
+bool event_handler_table_dispatch(sio_event_handler_table_t *table, sio_client_id_t client_id,
+                                  sio_namespace_id_t nsp, const Packet_t *packet)
+{
+    sio_event_view_t view;
+    if (sio_event_view_parse(&view, packet) != ESP_OK || view.event == NULL)
+    {
+        return false;
+    }
+
+    sio_on_handler_t handler = NULL;
+    void *ctx = NULL;
+    if (!lookup(table, nsp, view.event, view.event_len, &handler, &ctx))
+    {
+        ESP_LOGD(TAG, "No handler for %.*s", (int)view.event_len, view.event);
+        return false;
+    }
+
+    // called outside of the lock, the handler may register or remove handlers
+    handler(client_id, packet, &view, ctx);
+    return true;
+}
@@ -0,0 +1,90 @@
+#include <internal/sio_heartbeat.h>
+#include <esp_log.h>
+#include <string.h>
+
+static const char *TAG = "[sio:heartbeat]";
+
+static void heartbeat_timer_cb(void *arg)
+{
+    sio_heartbeat_t *heartbeat = (sio_heartbeat_t *)arg;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&heartbeat->lock);
+    uint32_t window_ms = heartbeat->window_ms;
+    int64_t deadline = heartbeat->last_ping_us + (int64_t)window_ms * 1000;
+    bool expired = window_ms > 0 && now >= deadline;
+    if (expired)
+    {
+        heartbeat->window_ms = 0; // fires once per session
+    }
+    portEXIT_CRITICAL(&heartbeat->lock);
+
+    if (window_ms == 0)
+    {
+        return; // stopped in the meantime
+    }
+    if (!expired)
+    {
+        // pings came in since the timer was armed
+        esp_timer_start_once(heartbeat->timer, deadline - now);
+        return;
+    }
+
+    ESP_LOGW(TAG, "No ping for %u ms", (unsigned)window_ms);
+    heartbeat->expired_cb(heartbeat->arg);
+}
+
+esp_err_t heartbeat_init(sio_heartbeat_t *heartbeat, sio_heartbeat_expired_cb_t expired_cb, void *arg)
+{
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    memset(heartbeat, 0, sizeof(sio_heartbeat_t));
+    heartbeat->lock = unlocked;
+    heartbeat->expired_cb = expired_cb;
+    heartbeat->arg = arg;
+
+    esp_timer_create_args_t timer_args = {
+        .callback = heartbeat_timer_cb,
+        .arg = heartbeat,
+        .name = "sio_heartbeat"};
+    return esp_timer_create(&timer_args, &heartbeat->timer);
+}
+
+void heartbeat_deinit(sio_heartbeat_t *heartbeat)
+{
+    heartbeat_stop(heartbeat);
+    esp_timer_delete(heartbeat->timer);
+    heartbeat->timer = NULL;
+}
+
+void heartbeat_start(sio_heartbeat_t *heartbeat, uint32_t ping_interval_ms, uint32_t ping_timeout_ms)
+{
+    uint32_t window_ms = ping_interval_ms + ping_timeout_ms;
+    if (window_ms == 0)
+    {
+        return; // server sent no ping settings
+    }
+
+    portENTER_CRITICAL(&heartbeat->lock);
+    heartbeat->window_ms = window_ms;
+    heartbeat->last_ping_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&heartbeat->lock);
+
+    esp_timer_stop(heartbeat->timer); // not running is fine
+    esp_timer_start_once(heartbeat->timer, (uint64_t)window_ms * 1000);
+}
+
+void heartbeat_ping(sio_heartbeat_t *heartbeat)
+{
+    portENTER_CRITICAL(&heartbeat->lock);
+    heartbeat->last_ping_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&heartbeat->lock);
+}
+
+void heartbeat_stop(sio_heartbeat_t *heartbeat)
+{
+    portENTER_CRITICAL(&heartbeat->lock);
+    heartbeat->window_ms = 0;
+    portEXIT_CRITICAL(&heartbeat->lock);
+
+    esp_timer_stop(heartbeat->timer);
+}
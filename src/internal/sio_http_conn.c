@@ -0,0 +1,560 @@
+#include <internal/sio_http_conn.h>
+#include <sio_client.h>
+#include <utility.h>
+#include <esp_log.h>
+#include <string.h>
+#include <strings.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+static const char *TAG = "[sio:http_conn]";
+
+#define HTTP_RECV_CHUNK 512
+
+static bool tick_reached(TickType_t now, TickType_t when)
+{
+    return (int32_t)(now - when) >= 0;
+}
+
+static void close_socket(sio_http_conn_t *conn)
+{
+    if (conn->fd >= 0)
+    {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+}
+
+esp_err_t http_conn_resolve(const char *server_address, struct sockaddr_storage *addr, socklen_t *addr_len)
+{
+    char host[128];
+    const char *colon = strrchr(server_address, ':');
+    size_t host_len = colon != NULL ? (size_t)(colon - server_address) : strlen(server_address);
+    if (host_len == 0 || host_len >= sizeof(host))
+    {
+        ESP_LOGE(TAG, "Can not use server address %s", server_address);
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(host, server_address, host_len);
+    host[host_len] = '\0';
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *result = NULL;
+    int err = getaddrinfo(host, colon != NULL ? colon + 1 : "80", &hints, &result);
+    if (err != 0 || result == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to resolve %s: %d", host, err);
+        return ESP_FAIL;
+    }
+    memcpy(addr, result->ai_addr, result->ai_addrlen);
+    *addr_len = result->ai_addrlen;
+    freeaddrinfo(result);
+    return ESP_OK;
+}
+
+void http_conn_init(sio_http_conn_t *conn, sio_http_rx_context_t *rx)
+{
+    memset(conn, 0, sizeof(sio_http_conn_t));
+    conn->fd = -1;
+    conn->rx = rx;
+}
+
+esp_err_t http_conn_open(sio_http_conn_t *conn, const char *url, size_t token_offset, bool post,
+                         const struct sockaddr_storage *addr, socklen_t addr_len)
+{
+    http_conn_close(conn);
+
+    // the url is http://<host><path>
+    const char *host = strstr(url, "://");
+    const char *path = host == NULL ? NULL : strchr(host + 3, '/');
+    int len = -1;
+    if (path != NULL)
+    {
+        host += 3;
+        const char *method = post ? "POST" : "GET";
+        conn->request_token = token_offset > 0 ? strlen(method) + 1 + (url + token_offset - path) : 0;
+        // a post ends with the Content-Length header, its value and the empty line follow per request
+        len = snprintf(conn->request, sizeof(conn->request),
+                       "%s %s HTTP/1.1\r\nHost: %.*s\r\n%sConnection: keep-alive\r\n%s",
+                       method, path, (int)(path - host), host,
+                       post ? "Content-Type: text/plain;charset=UTF-8\r\nAccept: */*\r\n" : "Accept: text/plain\r\n",
+                       post ? "Content-Length: " : "\r\n");
+    }
+
+    // room for the longest Content-Length and the empty line
+    if (len < 0 || (size_t)len + 16 >= sizeof(conn->request))
+    {
+        ESP_LOGE(TAG, "Request does not fit into %d bytes", SIO_HTTP_REQUEST_SIZE);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    conn->request_head = len;
+    conn->post = post;
+    memcpy(&conn->addr, addr, addr_len);
+    conn->addr_len = addr_len;
+    return ESP_OK;
+}
+
+void http_conn_close(sio_http_conn_t *conn)
+{
+    close_socket(conn);
+    conn->state = SIO_HTTP_IDLE;
+    conn->request_head = 0;
+}
+
+bool http_conn_is_open(const sio_http_conn_t *conn)
+{
+    return conn->request_head > 0;
+}
+
+// ends a request in flight, half a response is no response
+static void conn_fail(sio_http_conn_t *conn)
+{
+    rx_parser_reset(&conn->rx->parser);
+    close_socket(conn);
+    conn->state = SIO_HTTP_IDLE;
+}
+
+static esp_err_t conn_connect(sio_http_conn_t *conn)
+{
+    conn->sent = 0;
+    conn->head_len = 0;
+    conn->reused = conn->fd >= 0;
+    if (conn->reused)
+    {
+        // kept alive from the last request
+        conn->state = SIO_HTTP_SENDING;
+        return ESP_OK;
+    }
+
+    conn->fd = socket(conn->addr.ss_family, SOCK_STREAM, 0);
+    if (conn->fd < 0)
+    {
+        ESP_LOGE(TAG, "Failed to create socket: %d", errno);
+        return ESP_FAIL;
+    }
+    fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL, 0) | O_NONBLOCK);
+    // head and body go out in separate sends, the body must not wait for the ack of the head
+    int nodelay = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    if (connect(conn->fd, (struct sockaddr *)&conn->addr, conn->addr_len) == 0)
+    {
+        conn->state = SIO_HTTP_SENDING;
+    }
+    else if (errno == EINPROGRESS)
+    {
+        conn->state = SIO_HTTP_CONNECTING;
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Failed to connect: %d", errno);
+        close_socket(conn);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t http_conn_start(sio_http_conn_t *conn, const char *body, size_t body_len, TickType_t now, TickType_t timeout)
+{
+    if (!http_conn_is_open(conn) || conn->state != SIO_HTTP_IDLE)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    conn->request_len = conn->request_head;
+    if (conn->post)
+    {
+        conn->request_len += snprintf(conn->request + conn->request_len, sizeof(conn->request) - conn->request_len,
+                                      "%u\r\n\r\n", (unsigned)body_len);
+    }
+    else if (conn->request_token > 0)
+    {
+        util_token_next(conn->request + conn->request_token, SIO_TOKEN_SIZE);
+    }
+    conn->body = body;
+    conn->body_len = conn->post ? body_len : 0;
+    conn->deadline = now + timeout;
+    conn->retried = false;
+
+    esp_err_t err = conn_connect(conn);
+    if (err != ESP_OK)
+    {
+        conn->state = SIO_HTTP_IDLE;
+    }
+    return err;
+}
+
+void http_conn_prepare(const sio_http_conn_t *conn, TickType_t now, fd_set *readable, fd_set *writable, int *max_fd, TickType_t *wait)
+{
+    if (conn->state == SIO_HTTP_IDLE)
+    {
+        return;
+    }
+    FD_SET(conn->fd, conn->state >= SIO_HTTP_HEAD ? readable : writable);
+    if (conn->fd > *max_fd)
+    {
+        *max_fd = conn->fd;
+    }
+    TickType_t until = tick_reached(now, conn->deadline) ? 0 : conn->deadline - now;
+    *wait = until < *wait ? until : *wait;
+}
+
+// value of header name in the response head, NULL if it is not there
+static const char *head_find(const sio_http_conn_t *conn, const char *name)
+{
+    size_t name_len = strlen(name);
+    const char *line = strstr(conn->head, "\r\n");
+    while (line != NULL && line[2] != '\r')
+    {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':')
+        {
+            const char *value = line + name_len + 1;
+            while (*value == ' ')
+            {
+                value++;
+            }
+            return value;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return NULL;
+}
+
+static bool value_contains(const char *value, const char *token)
+{
+    size_t token_len = strlen(token);
+    for (const char *p = value; p != NULL && *p != '\r' && *p != '\0'; p++)
+    {
+        if (strncasecmp(p, token, token_len) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static esp_err_t parse_head(sio_http_conn_t *conn)
+{
+    int minor = 0;
+    if (sscanf(conn->head, "HTTP/1.%d %d", &minor, &conn->status) != 2)
+    {
+        ESP_LOGE(TAG, "Malformed status line");
+        return ESP_FAIL;
+    }
+
+    const char *connection = head_find(conn, "Connection");
+    conn->keep_alive = connection != NULL ? !value_contains(connection, "close") : minor >= 1;
+
+    const char *encoding = head_find(conn, "Transfer-Encoding");
+    conn->chunked = encoding != NULL && value_contains(encoding, "chunked");
+    conn->chunk_state = SIO_HTTP_CHUNK_SIZE;
+    conn->chunk_left = 0;
+    conn->line_len = 0;
+    conn->size_done = false;
+
+    const char *length = head_find(conn, "Content-Length");
+    conn->content_length = !conn->chunked && length != NULL ? strtoll(length, NULL, 10) : -1;
+    conn->body_left = conn->content_length;
+    if (!conn->chunked && conn->content_length < 0)
+    {
+        conn->keep_alive = false; // the body ends with the connection
+    }
+    return ESP_OK;
+}
+
+// Feeds what came in of the body to the receive context, *done once the response is complete.
+static esp_err_t consume_body(sio_http_conn_t *conn, const char *data, size_t len, bool *done)
+{
+    if (!conn->chunked)
+    {
+        if (conn->content_length >= 0 && (int64_t)len > conn->body_left)
+        {
+            len = conn->body_left; // nothing comes after the body before we ask again
+        }
+        if (len > 0 && http_rx_context_feed(conn->rx, data, len, conn->content_length) != ESP_OK)
+        {
+            return ESP_FAIL;
+        }
+        if (conn->content_length >= 0)
+        {
+            conn->body_left -= len;
+            *done = conn->body_left == 0;
+        }
+        return ESP_OK;
+    }
+
+    const char *end = data + len;
+    while (data < end && !*done)
+    {
+        switch (conn->chunk_state)
+        {
+        case SIO_HTTP_CHUNK_SIZE:
+        case SIO_HTTP_CHUNK_TRAILER:
+        {
+            char c = *data++;
+            if (c == '\r')
+            {
+                break;
+            }
+            if (c != '\n')
+            {
+                int digit = c >= '0' && c <= '9' ? c - '0' : (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : -1;
+                if (conn->chunk_state == SIO_HTTP_CHUNK_SIZE && !conn->size_done)
+                {
+                    if (digit < 0 && conn->line_len == 0)
+                    {
+                        ESP_LOGE(TAG, "Malformed chunk size");
+                        return ESP_FAIL;
+                    }
+                    if (digit < 0 || conn->line_len >= 8)
+                    {
+                        conn->size_done = true; // extensions follow, or a chunk we would never take anyway
+                    }
+                    else
+                    {
+                        conn->chunk_left = conn->chunk_left * 16 + digit;
+                    }
+                }
+                conn->line_len++;
+                break;
+            }
+
+            // end of the line
+            if (conn->chunk_state == SIO_HTTP_CHUNK_TRAILER)
+            {
+                *done = conn->line_len == 0;
+            }
+            else
+            {
+                conn->chunk_state = conn->chunk_left == 0 ? SIO_HTTP_CHUNK_TRAILER : SIO_HTTP_CHUNK_DATA;
+            }
+            conn->line_len = 0;
+            conn->size_done = false;
+            break;
+        }
+
+        case SIO_HTTP_CHUNK_DATA:
+        {
+            size_t take = (size_t)(end - data) < conn->chunk_left ? (size_t)(end - data) : conn->chunk_left;
+            if (http_rx_context_feed(conn->rx, data, take, -1) != ESP_OK)
+            {
+                return ESP_FAIL;
+            }
+            data += take;
+            conn->chunk_left -= take;
+            if (conn->chunk_left == 0)
+            {
+                conn->chunk_state = SIO_HTTP_CHUNK_DATA_END;
+            }
+            break;
+        }
+
+        case SIO_HTTP_CHUNK_DATA_END:
+            if (*data++ == '\n')
+            {
+                conn->chunk_state = SIO_HTTP_CHUNK_SIZE;
+            }
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t conn_send(sio_http_conn_t *conn)
+{
+    // head first, then the body
+    const char *data = conn->request + conn->sent;
+    size_t left = conn->request_len - conn->sent;
+    if (conn->sent >= conn->request_len)
+    {
+        data = conn->body + (conn->sent - conn->request_len);
+        left = conn->request_len + conn->body_len - conn->sent;
+    }
+
+    int sent = send(conn->fd, data, left, 0);
+    if (sent < 0)
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? ESP_OK : ESP_FAIL;
+    }
+    conn->sent += sent;
+    if (conn->sent == conn->request_len + conn->body_len)
+    {
+        conn->state = SIO_HTTP_HEAD;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t conn_receive(sio_http_conn_t *conn, bool *done)
+{
+    char buffer[HTTP_RECV_CHUNK];
+    char *data = buffer;
+    size_t capacity = sizeof(buffer);
+    if (conn->state == SIO_HTTP_HEAD)
+    {
+        data = conn->head + conn->head_len;
+        capacity = sizeof(conn->head) - 1 - conn->head_len;
+        if (capacity == 0)
+        {
+            ESP_LOGE(TAG, "Response headers bigger than %d bytes", SIO_HTTP_HEAD_SIZE);
+            return ESP_FAIL;
+        }
+    }
+
+    int received = recv(conn->fd, data, capacity, 0);
+    if (received < 0)
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? ESP_OK : ESP_FAIL;
+    }
+    if (received == 0)
+    {
+        // fine for a body that ends with the connection, a broken response otherwise
+        bool body_until_close = conn->state == SIO_HTTP_BODY && !conn->chunked && conn->content_length < 0;
+        *done = body_until_close;
+        return body_until_close ? ESP_OK : ESP_FAIL;
+    }
+
+    if (conn->state == SIO_HTTP_BODY)
+    {
+        return consume_body(conn, data, received, done);
+    }
+
+    conn->head_len += received;
+    conn->head[conn->head_len] = '\0';
+    char *head_end = strstr(conn->head, "\r\n\r\n");
+    if (head_end == NULL)
+    {
+        return ESP_OK;
+    }
+    if (parse_head(conn) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+
+    conn->state = SIO_HTTP_BODY;
+    char *body = head_end + 4;
+    size_t body_len = conn->head + conn->head_len - body;
+    if (!conn->chunked && conn->content_length == 0)
+    {
+        *done = true;
+        return ESP_OK;
+    }
+    return consume_body(conn, body, body_len, done);
+}
+
+esp_err_t http_conn_step(sio_http_conn_t *conn, TickType_t now, const fd_set *readable, const fd_set *writable, bool *done)
+{
+    *done = false;
+    esp_err_t err = ESP_OK;
+    switch (conn->state)
+    {
+    case SIO_HTTP_CONNECTING:
+        if (FD_ISSET(conn->fd, writable))
+        {
+            int so_error = 0;
+            socklen_t len = sizeof(so_error);
+            getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &so_error, &len);
+            if (so_error != 0)
+            {
+                ESP_LOGE(TAG, "Failed to connect: %d", so_error);
+                err = ESP_FAIL;
+                break;
+            }
+            conn->state = SIO_HTTP_SENDING;
+        }
+        break;
+
+    case SIO_HTTP_SENDING:
+        if (FD_ISSET(conn->fd, writable))
+        {
+            err = conn_send(conn);
+        }
+        break;
+
+    case SIO_HTTP_HEAD:
+    case SIO_HTTP_BODY:
+        if (FD_ISSET(conn->fd, readable))
+        {
+            err = conn_receive(conn, done);
+        }
+        break;
+
+    default:
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (err == ESP_OK && !*done && tick_reached(now, conn->deadline))
+    {
+        err = ESP_ERR_TIMEOUT;
+    }
+
+    if (err != ESP_OK && err != ESP_ERR_TIMEOUT && conn->reused && conn->head_len == 0 && !conn->retried)
+    {
+        // The server dropped the idle keep-alive socket before the request made it through,
+        // start over on a fresh connection right away.
+        ESP_LOGD(TAG, "Kept alive connection went stale, reconnecting");
+        close_socket(conn);
+        conn->retried = true;
+        err = conn_connect(conn);
+        if (err == ESP_OK)
+        {
+            return ESP_OK;
+        }
+    }
+
+    if (err != ESP_OK)
+    {
+        conn_fail(conn);
+        return err;
+    }
+    if (*done)
+    {
+        http_rx_context_finish(conn->rx);
+        if (!conn->keep_alive)
+        {
+            close_socket(conn);
+        }
+        conn->state = SIO_HTTP_IDLE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t http_conn_perform(sio_http_conn_t *conn, const char *body, size_t body_len, uint32_t timeout_ms)
+{
+    TickType_t now = xTaskGetTickCount();
+    esp_err_t err = http_conn_start(conn, body, body_len, now, pdMS_TO_TICKS(timeout_ms));
+    bool done = false;
+    while (err == ESP_OK && !done)
+    {
+        fd_set readable;
+        fd_set writable;
+        FD_ZERO(&readable);
+        FD_ZERO(&writable);
+        int max_fd = -1;
+        TickType_t wait = pdMS_TO_TICKS(timeout_ms);
+        http_conn_prepare(conn, now, &readable, &writable, &max_fd, &wait);
+
+        uint32_t wait_ms = wait * portTICK_PERIOD_MS;
+        struct timeval timeout = {.tv_sec = wait_ms / 1000, .tv_usec = (wait_ms % 1000) * 1000};
+        if (select(max_fd + 1, &readable, &writable, NULL, &timeout) < 0)
+        {
+            if (errno != EINTR)
+            {
+                ESP_LOGE(TAG, "select failed: %d", errno);
+                conn_fail(conn);
+                return ESP_FAIL;
+            }
+            // interrupted, the step below only looks at the deadline
+            FD_ZERO(&readable);
+            FD_ZERO(&writable);
+        }
+        now = xTaskGetTickCount();
+        err = http_conn_step(conn, now, &readable, &writable, &done);
+    }
+    return err;
+}
@@ -0,0 +1,691 @@
+#include <internal/sio_io_scheduler.h>
+#include <internal/task_functions.h>
+#include <sio_client.h>
+#include <esp_log.h>
+#include <string.h>
+
+#if SIO_SHARED_IO_TASK
+
+#include <esp_timer.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+static const char *TAG = "[sio:io]";
+
+#define IO_IDLE_WAIT_MS 1000 /* longest select, nothing waits on a timer beyond it */
+#define IO_LOCK_RETRY_MS 10  /* a lock someone else holds is tried again after this */
+
+// One polling session: a GET at a time over its own keep-alive connection, posts over the
+// posting connection of the client. Only the I/O task touches a slot once it is handed over,
+// and it never blocks on the network for one.
+typedef enum
+{
+    IO_SLOT_FREE = 0,
+    IO_SLOT_START,     /* handed over, upgrade decision pending */
+    IO_SLOT_PROBING,   /* websocket probe in flight, no GETs */
+    IO_SLOT_SWITCHING, /* probe answered, posting what is queued ahead of the upgrade packet */
+    IO_SLOT_POLLING,   /* a GET in flight, or the next one starts at deadline */
+    IO_SLOT_ENDING     /* session over, a post in flight finishes before the slot is free */
+} io_slot_state_t;
+
+typedef enum
+{
+    IO_TASK_STOPPED = 0,
+    IO_TASK_STARTING, /* the first client sets the task up, the others wait */
+    IO_TASK_RUNNING
+} io_task_state_t;
+
+typedef struct
+{
+    struct sio_client_t *client;
+    io_slot_state_t state;
+    TickType_t deadline; // probe timeout, or while polling the start of the next GET
+    sio_http_conn_t get;
+    uint8_t failed_polls;
+    sio_polling_end_t how; // once ENDING
+
+    // locks of the client the slot holds across loops
+    bool send_locked;
+    bool queue_locked;
+
+    // the post in flight on client->posting_conn, send lock held
+    bool posting;
+    bool post_journal; // journal_batch rather than the send queue
+    sio_journal_batch_t journal_batch;
+    size_t post_len;
+    size_t post_records;
+    int64_t post_started_us;
+    TickType_t post_not_before; // after a busy lock or a failed post
+
+    bool outbound_pending;
+    TickType_t outbound_since;
+    bool carry_left;  // the last post left a packet behind that did not fit
+    bool journal_due; // namespace 0 may be back or records are left, look at the journal
+} io_slot_t;
+
+static portMUX_TYPE io_lock = portMUX_INITIALIZER_UNLOCKED;
+static io_slot_t io_slots[SIO_IO_TASK_MAX_SESSIONS];
+static io_task_state_t io_task_state = IO_TASK_STOPPED;
+static int wake_fd = -1;
+static struct sockaddr_in wake_addr;
+
+static bool tick_reached(TickType_t now, TickType_t when)
+{
+    return (int32_t)(now - when) >= 0;
+}
+
+static TickType_t ticks_until(TickType_t now, TickType_t when)
+{
+    return tick_reached(now, when) ? 0 : when - now;
+}
+
+// self addressed UDP socket, select returns as soon as someone sends to it
+static esp_err_t wake_socket_open(void)
+{
+    wake_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (wake_fd < 0)
+    {
+        return ESP_FAIL;
+    }
+
+    memset(&wake_addr, 0, sizeof(wake_addr));
+    wake_addr.sin_family = AF_INET;
+    wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(wake_addr);
+    if (bind(wake_fd, (struct sockaddr *)&wake_addr, sizeof(wake_addr)) != 0 ||
+        getsockname(wake_fd, (struct sockaddr *)&wake_addr, &len) != 0)
+    {
+        close(wake_fd);
+        wake_fd = -1;
+        return ESP_FAIL;
+    }
+    fcntl(wake_fd, F_SETFL, fcntl(wake_fd, F_GETFL, 0) | O_NONBLOCK);
+    return ESP_OK;
+}
+
+static void wake_socket_drain(void)
+{
+    char drain[8];
+    while (recv(wake_fd, drain, sizeof(drain), 0) > 0)
+    {
+    }
+}
+
+void io_scheduler_wake(void)
+{
+    // the wake socket is set up before the task is published as running
+    if (__atomic_load_n(&io_task_state, __ATOMIC_SEQ_CST) == IO_TASK_RUNNING)
+    {
+        char byte = 0;
+        sendto(wake_fd, &byte, 1, 0, (struct sockaddr *)&wake_addr, sizeof(wake_addr));
+    }
+}
+
+static void slot_give_send_lock(io_slot_t *slot)
+{
+    if (slot->send_locked)
+    {
+        slot->send_locked = false;
+        xSemaphoreGive(slot->client->send_lock);
+    }
+}
+
+// The polling side is over. GETs stop at once, a post in flight still finishes and the slot
+// lets go of the client after it.
+static void slot_end(io_slot_t *slot, sio_polling_end_t how)
+{
+    struct sio_client_t *client = slot->client;
+
+    http_conn_close(&slot->get);
+    if ((slot->state == IO_SLOT_PROBING || slot->state == IO_SLOT_SWITCHING) && how != SIO_POLLING_UPGRADED)
+    {
+        sio_client_upgrade_abandon(client, false);
+    }
+    if (slot->queue_locked)
+    {
+        slot->queue_locked = false;
+        xSemaphoreGive(client->queue_lock);
+    }
+    slot->how = how;
+    slot->state = IO_SLOT_ENDING;
+}
+
+static void slot_release(io_slot_t *slot)
+{
+    struct sio_client_t *client = slot->client;
+    slot_give_send_lock(slot);
+
+    portENTER_CRITICAL(&io_lock);
+    slot->state = IO_SLOT_FREE;
+    slot->client = NULL;
+    portEXIT_CRITICAL(&io_lock);
+
+    polling_session_end(client, slot->how);
+}
+
+static void slot_post_done(io_slot_t *slot, esp_err_t err, TickType_t now)
+{
+    struct sio_client_t *client = slot->client;
+    const char *body = slot->post_journal ? slot->journal_batch.records : client->post_buffer;
+
+    err = sio_client_post_done(client, err, slot->post_started_us, body, slot->post_len);
+    if (slot->post_journal)
+    {
+        // the records stay in the journal for the next attempt if the post failed
+        if (err == ESP_OK)
+        {
+            journal_commit(&client->journal, &slot->journal_batch);
+        }
+        slot->journal_due = true;
+    }
+    else if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Lost %d queued packets of client %d: %s", (int)slot->post_records, (int)client->client_id, esp_err_to_name(err));
+        metrics_drop_out(&client->metrics, slot->post_records);
+    }
+    if (err != ESP_OK)
+    {
+        slot->post_not_before = now + pdMS_TO_TICKS(SIO_POLL_RETRY_DELAY_MS);
+    }
+
+    slot->carry_left = client->outbound_carry != NULL;
+    slot->posting = false;
+    // the switch keeps the send lock until the upgrade packet is out
+    if (slot->state != IO_SLOT_SWITCHING)
+    {
+        slot_give_send_lock(slot);
+    }
+}
+
+// Starts a post of the owed pong and the send queue, else of the next journal batch if
+// journal. Send lock held, false if nothing went out.
+static bool slot_post_start(io_slot_t *slot, TickType_t now, bool journal)
+{
+    struct sio_client_t *client = slot->client;
+
+    slot->carry_left = false;
+    slot->post_journal = false;
+    esp_err_t err = sio_client_take_outbound(client, &slot->post_len, &slot->post_records);
+    slot->outbound_pending = false;
+    if (err != ESP_OK && journal && slot->journal_due)
+    {
+        err = sio_client_take_journal(client, &slot->journal_batch);
+        if (err == ESP_OK)
+        {
+            slot->post_journal = true;
+            slot->post_len = slot->journal_batch.len;
+            slot->post_records = slot->journal_batch.count;
+        }
+        else if (err == ESP_ERR_TIMEOUT)
+        {
+            slot->post_not_before = now + pdMS_TO_TICKS(IO_LOCK_RETRY_MS);
+        }
+        else
+        {
+            slot->journal_due = false;
+        }
+    }
+    if (err != ESP_OK)
+    {
+        return false;
+    }
+
+    const char *body = slot->post_journal ? slot->journal_batch.records : client->post_buffer;
+    http_rx_context_reset(&client->posting_rx);
+    slot->post_started_us = esp_timer_get_time();
+    err = http_conn_start(&client->posting_conn, body, slot->post_len, now, pdMS_TO_TICKS(SIO_POST_TIMEOUT_MS));
+    if (err != ESP_OK)
+    {
+        slot_post_done(slot, err, now);
+        return false;
+    }
+    slot->posting = true;
+    return true;
+}
+
+static void slot_step_post(io_slot_t *slot, TickType_t now, const fd_set *readable, const fd_set *writable)
+{
+    bool done = false;
+    esp_err_t err = http_conn_step(&slot->client->posting_conn, now, readable, writable, &done);
+    if (err != ESP_OK || done)
+    {
+        slot_post_done(slot, err, now);
+    }
+}
+
+// posts the send queue once it lingered for SIO_SEND_LINGER_MS like the posting task does,
+// a pong right away and the journal whenever it may have something
+static void slot_run_outbound(io_slot_t *slot, TickType_t now)
+{
+    struct sio_client_t *client = slot->client;
+    if (slot->posting || (slot->state != IO_SLOT_POLLING && slot->state != IO_SLOT_PROBING) ||
+        sio_client_transport(client) != SIO_TRANSPORT_POLLING || !tick_reached(now, slot->post_not_before))
+    {
+        return;
+    }
+
+    if (uxQueueMessagesWaiting(client->send_queue) == 0)
+    {
+        slot->outbound_pending = false;
+    }
+    else if (!slot->outbound_pending)
+    {
+        slot->outbound_pending = true;
+        slot->outbound_since = now;
+    }
+    bool outbound = slot->carry_left || __atomic_load_n(&client->pong_owed, __ATOMIC_SEQ_CST) ||
+                    (slot->outbound_pending && tick_reached(now, slot->outbound_since + pdMS_TO_TICKS(SIO_SEND_LINGER_MS)));
+    if (!outbound && !slot->journal_due)
+    {
+        return;
+    }
+
+    // an emitter posting a full queue itself holds it for a request at most
+    if (xSemaphoreTake(client->send_lock, 0) != pdTRUE)
+    {
+        slot->post_not_before = now + pdMS_TO_TICKS(IO_LOCK_RETRY_MS);
+        return;
+    }
+    slot->send_locked = true;
+    if (!slot_post_start(slot, now, true))
+    {
+        slot_give_send_lock(slot);
+    }
+}
+
+static void slot_start(io_slot_t *slot, TickType_t now)
+{
+    struct sio_client_t *client = slot->client;
+
+    // the session url belongs to the polling side, the connection moves its cache buster on per GET
+    const char *url = sio_client_session_url(client);
+    http_conn_init(&slot->get, &client->polling_rx);
+    if (url == NULL || http_conn_open(&slot->get, url, client->session_url_token, false, &client->server_addr, client->server_addr_len) != ESP_OK)
+    {
+        slot_end(slot, SIO_POLLING_LOST);
+        return;
+    }
+
+    // both were settled by the handshake before the session was handed over
+    bool try_upgrade = client->upgrade_transport && client->server_upgrade_websocket;
+    if (try_upgrade && sio_client_upgrade_start(client) == ESP_OK)
+    {
+        slot->state = IO_SLOT_PROBING;
+        slot->deadline = now + pdMS_TO_TICKS(SIO_WEBSOCKET_HANDSHAKE_TIMEOUT_MS);
+        return;
+    }
+    slot->state = IO_SLOT_POLLING;
+    slot->deadline = now;
+}
+
+// the websocket handler gives websocket_handshake_done and wakes the task
+static void slot_probe(io_slot_t *slot, TickType_t now)
+{
+    struct sio_client_t *client = slot->client;
+
+    if (xSemaphoreTake(client->websocket_handshake_done, 0) == pdTRUE)
+    {
+        if (client->websocket_state == SIO_WEBSOCKET_STATE_UPGRADE)
+        {
+            slot->state = IO_SLOT_SWITCHING;
+            return;
+        }
+        ESP_LOGE(TAG, "Websocket probe of client %d failed", (int)client->client_id);
+    }
+    else if (tick_reached(now, slot->deadline))
+    {
+        ESP_LOGE(TAG, "Websocket probe of client %d timed out", (int)client->client_id);
+    }
+    else
+    {
+        return;
+    }
+
+    sio_client_upgrade_abandon(client, true);
+    slot->state = IO_SLOT_POLLING;
+    slot->deadline = now;
+}
+
+// Like sio_client_upgrade_transport: with both locks held everything queued goes out over
+// polling, then the upgrade packet over the websocket. The locks are only ever tried.
+static void slot_switch(io_slot_t *slot, TickType_t now)
+{
+    struct sio_client_t *client = slot->client;
+
+    if (slot->posting)
+    {
+        return;
+    }
+    if (!slot->queue_locked)
+    {
+        if (xSemaphoreTake(client->queue_lock, 0) != pdTRUE)
+        {
+            return;
+        }
+        slot->queue_locked = true;
+    }
+    if (!slot->send_locked)
+    {
+        if (xSemaphoreTake(client->send_lock, 0) != pdTRUE)
+        {
+            return;
+        }
+        slot->send_locked = true;
+    }
+
+    if (slot_post_start(slot, now, false))
+    {
+        return;
+    }
+
+    esp_err_t err = sio_client_upgrade_switch(client);
+    if (err == ESP_OK)
+    {
+        slot_end(slot, SIO_POLLING_UPGRADED);
+        return;
+    }
+
+    // polling goes on, ESP_ERR_INVALID_STATE means it stopped meanwhile and the slot ends next
+    sio_client_upgrade_abandon(client, err != ESP_ERR_INVALID_STATE);
+    slot_give_send_lock(slot);
+    slot->queue_locked = false;
+    xSemaphoreGive(client->queue_lock);
+    slot->state = IO_SLOT_POLLING;
+    slot->deadline = now;
+}
+
+static void slot_poll(io_slot_t *slot, TickType_t now, const fd_set *readable, const fd_set *writable)
+{
+    struct sio_client_t *client = slot->client;
+
+    esp_err_t err = ESP_OK;
+    bool done = false;
+    if (slot->get.state == SIO_HTTP_IDLE)
+    {
+        if (!tick_reached(now, slot->deadline))
+        {
+            return;
+        }
+        // the server pings within the interval, a GET outliving interval + timeout means a dead link
+        metrics_poll_begin(&client->metrics);
+        TickType_t window = pdMS_TO_TICKS(client->server_ping_interval_ms + client->server_ping_timeout_ms);
+        err = http_conn_start(&slot->get, NULL, 0, now, window);
+    }
+    else
+    {
+        err = http_conn_step(&slot->get, now, readable, writable, &done);
+    }
+
+    if (err == ESP_ERR_TIMEOUT)
+    {
+        ESP_LOGW(TAG, "Polling GET of client %d timed out", (int)client->client_id);
+    }
+    if (err == ESP_OK && !done)
+    {
+        return;
+    }
+
+    sio_poll_result_t result = polling_handle_response(client, err, err == ESP_OK ? slot->get.status : 0, &slot->failed_polls);
+    if (result == SIO_POLL_SESSION_LOST)
+    {
+        slot_end(slot, SIO_POLLING_LOST);
+        return;
+    }
+    slot->deadline = result == SIO_POLL_RETRY ? now + pdMS_TO_TICKS(SIO_POLL_RETRY_DELAY_MS * slot->failed_polls) : now;
+
+    // namespace 0 may just have come back
+    slot->journal_due = true;
+}
+
+static void slot_run(io_slot_t *slot, TickType_t now, const fd_set *readable, const fd_set *writable)
+{
+    struct sio_client_t *client = slot->client;
+
+    if (slot->posting)
+    {
+        slot_step_post(slot, now, readable, writable);
+    }
+
+    // a plain read, sio_client_close waits for us to let go
+    if (slot->state != IO_SLOT_ENDING && !(sio_client_state(client) & SIO_STATE_POLLING))
+    {
+        ESP_LOGI(TAG, "Client %d stopped polling", (int)client->client_id);
+        slot_end(slot, SIO_POLLING_STOPPED);
+    }
+
+    switch (slot->state)
+    {
+    case IO_SLOT_START:
+        slot_start(slot, now);
+        break;
+    case IO_SLOT_PROBING:
+        slot_probe(slot, now);
+        break;
+    case IO_SLOT_SWITCHING:
+        slot_switch(slot, now);
+        break;
+    case IO_SLOT_POLLING:
+        slot_poll(slot, now, readable, writable);
+        break;
+    default:
+        break;
+    }
+
+    if (slot->state == IO_SLOT_ENDING)
+    {
+        if (!slot->posting)
+        {
+            slot_release(slot);
+        }
+        return;
+    }
+    slot_run_outbound(slot, now);
+}
+
+// what select waits for on behalf of the slot, and for how long at most
+static void slot_prepare(io_slot_t *slot, TickType_t now, fd_set *readable, fd_set *writable, int *max_fd, TickType_t *wait)
+{
+    struct sio_client_t *client = slot->client;
+    TickType_t until = pdMS_TO_TICKS(IO_IDLE_WAIT_MS);
+
+    switch (slot->state)
+    {
+    case IO_SLOT_START:
+        until = 0;
+        break;
+    case IO_SLOT_PROBING:
+        until = ticks_until(now, slot->deadline);
+        break;
+    case IO_SLOT_SWITCHING:
+        until = slot->posting ? until : pdMS_TO_TICKS(IO_LOCK_RETRY_MS);
+        break;
+    case IO_SLOT_POLLING:
+        if (slot->get.state == SIO_HTTP_IDLE)
+        {
+            until = ticks_until(now, slot->deadline);
+        }
+        http_conn_prepare(&slot->get, now, readable, writable, max_fd, &until);
+        break;
+    default:
+        break;
+    }
+
+    if (slot->posting)
+    {
+        http_conn_prepare(&client->posting_conn, now, readable, writable, max_fd, &until);
+    }
+    else if (slot->state == IO_SLOT_POLLING || slot->state == IO_SLOT_PROBING)
+    {
+        TickType_t post = pdMS_TO_TICKS(IO_IDLE_WAIT_MS);
+        if (slot->carry_left || slot->journal_due || __atomic_load_n(&client->pong_owed, __ATOMIC_SEQ_CST))
+        {
+            post = 0;
+        }
+        else if (slot->outbound_pending)
+        {
+            post = ticks_until(now, slot->outbound_since + pdMS_TO_TICKS(SIO_SEND_LINGER_MS));
+        }
+        TickType_t ready = ticks_until(now, slot->post_not_before);
+        post = post > ready ? post : ready;
+        until = post < until ? post : until;
+    }
+    *wait = until < *wait ? until : *wait;
+}
+
+static void io_task(void *pvParameters)
+{
+    ESP_LOGI(TAG, "Started shared I/O task");
+    while (true)
+    {
+        fd_set readable;
+        fd_set writable;
+        FD_ZERO(&readable);
+        FD_ZERO(&writable);
+        FD_SET(wake_fd, &readable);
+        int max_fd = wake_fd;
+        TickType_t wait = pdMS_TO_TICKS(IO_IDLE_WAIT_MS);
+
+        TickType_t now = xTaskGetTickCount();
+        for (int i = 0; i < SIO_IO_TASK_MAX_SESSIONS; i++)
+        {
+            // slots only go from FREE to START outside of this task
+            if (io_slots[i].state != IO_SLOT_FREE)
+            {
+                slot_prepare(&io_slots[i], now, &readable, &writable, &max_fd, &wait);
+            }
+        }
+
+        uint32_t wait_ms = wait * portTICK_PERIOD_MS;
+        struct timeval timeout = {.tv_sec = wait_ms / 1000, .tv_usec = (wait_ms % 1000) * 1000};
+        int ready = select(max_fd + 1, &readable, &writable, NULL, &timeout);
+        if (ready < 0)
+        {
+            if (errno != EINTR)
+            {
+                ESP_LOGE(TAG, "select failed: %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+            FD_ZERO(&readable);
+            FD_ZERO(&writable);
+        }
+        else if (FD_ISSET(wake_fd, &readable))
+        {
+            wake_socket_drain();
+        }
+
+        now = xTaskGetTickCount();
+        for (int i = 0; i < SIO_IO_TASK_MAX_SESSIONS; i++)
+        {
+            io_slot_t *slot = &io_slots[i];
+            portENTER_CRITICAL(&io_lock);
+            bool used = slot->state != IO_SLOT_FREE;
+            portEXIT_CRITICAL(&io_lock);
+
+            if (used)
+            {
+                slot_run(slot, now, &readable, &writable);
+            }
+        }
+    }
+}
+
+// Starts the task on first use. Whoever gets there first sets everything up before the task
+// is published as running, the others wait for it.
+static esp_err_t io_task_start(void)
+{
+    while (true)
+    {
+        portENTER_CRITICAL(&io_lock);
+        io_task_state_t state = io_task_state;
+        if (state == IO_TASK_STOPPED)
+        {
+            io_task_state = IO_TASK_STARTING;
+        }
+        portEXIT_CRITICAL(&io_lock);
+
+        if (state == IO_TASK_RUNNING)
+        {
+            return ESP_OK;
+        }
+        if (state == IO_TASK_STOPPED)
+        {
+            break;
+        }
+        vTaskDelay(1 / portTICK_PERIOD_MS); // do a yield
+    }
+
+    for (int i = 0; i < SIO_IO_TASK_MAX_SESSIONS; i++)
+    {
+        http_conn_init(&io_slots[i].get, NULL);
+    }
+
+    esp_err_t err = wake_socket_open();
+    BaseType_t core = SIO_IO_TASK_CORE < 0 ? tskNO_AFFINITY : SIO_IO_TASK_CORE;
+    if (err == ESP_OK &&
+        xTaskCreatePinnedToCore(&io_task, "sio_io", SIO_IO_TASK_STACK_SIZE, NULL, SIO_IO_TASK_PRIORITY, NULL, core) != pdPASS)
+    {
+        close(wake_fd);
+        wake_fd = -1;
+        err = ESP_FAIL;
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start the shared I/O task");
+    }
+
+    portENTER_CRITICAL(&io_lock);
+    io_task_state = err == ESP_OK ? IO_TASK_RUNNING : IO_TASK_STOPPED;
+    portEXIT_CRITICAL(&io_lock);
+    return err;
+}
+
+esp_err_t io_scheduler_add(struct sio_client_t *client)
+{
+    if (io_task_start() != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+
+    // the task sets the slot up itself once it sees START
+    esp_err_t err = ESP_ERR_NO_MEM;
+    TickType_t now = xTaskGetTickCount();
+    portENTER_CRITICAL(&io_lock);
+    for (int i = 0; i < SIO_IO_TASK_MAX_SESSIONS; i++)
+    {
+        if (io_slots[i].state == IO_SLOT_FREE && io_slots[i].client == NULL)
+        {
+            io_slots[i].client = client;
+            io_slots[i].failed_polls = 0;
+            io_slots[i].posting = false;
+            io_slots[i].post_not_before = now;
+            io_slots[i].outbound_pending = false;
+            io_slots[i].carry_left = false;
+            io_slots[i].journal_due = false;
+            io_slots[i].state = IO_SLOT_START;
+            err = ESP_OK;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&io_lock);
+
+    io_scheduler_wake();
+    return err;
+}
+
+#else
+
+esp_err_t io_scheduler_add(struct sio_client_t *client)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void io_scheduler_wake(void)
+{
+}
+
+#endif
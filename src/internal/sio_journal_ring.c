@@ -0,0 +1,377 @@
+#include <internal/sio_journal_ring.h>
+#include <internal/http_handlers.h>
+#include <esp_log.h>
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "[sio:journal]";
+
+#define RECORD_LEN_SIZE 2
+#define RECORD_WRAP 0xFFFF
+#define RECORD_MAX_LEN 0xFFFE
+
+static uint32_t header_check(const sio_journal_header_t *header)
+{
+    return header->magic ^ header->data_size ^ header->head ^ header->tail ^ 0xA5A5A5A5;
+}
+
+// call with the lock held
+static esp_err_t write_header(sio_journal_t *journal)
+{
+    sio_journal_header_t header = {
+        .magic = SIO_JOURNAL_MAGIC,
+        .data_size = journal->data_size,
+        .head = journal->head,
+        .tail = journal->tail};
+    header.check = header_check(&header);
+    return journal->storage.write(journal->storage.ctx, 0, &header, sizeof(header));
+}
+
+static size_t physical(const sio_journal_t *journal, uint32_t position)
+{
+    return sizeof(sio_journal_header_t) + position % journal->data_size;
+}
+
+static uint32_t lap_left(const sio_journal_t *journal, uint32_t position)
+{
+    return journal->data_size - position % journal->data_size;
+}
+
+// Length of the record at position, skips the end of a lap. Call with the lock held.
+static esp_err_t read_record_len(sio_journal_t *journal, uint32_t *position, uint16_t *len)
+{
+    while (true)
+    {
+        uint32_t left = lap_left(journal, *position);
+        if (left < RECORD_LEN_SIZE)
+        {
+            *position += left;
+            continue;
+        }
+
+        uint8_t raw[RECORD_LEN_SIZE];
+        esp_err_t err = journal->storage.read(journal->storage.ctx, physical(journal, *position), raw, RECORD_LEN_SIZE);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        *len = raw[0] | (raw[1] << 8);
+        if (*len == RECORD_WRAP)
+        {
+            *position += left;
+            continue;
+        }
+        if (*len > left - RECORD_LEN_SIZE)
+        {
+            ESP_LOGE(TAG, "Corrupt record of %d bytes at %u", *len, (unsigned)*position);
+            return ESP_ERR_INVALID_STATE;
+        }
+        return ESP_OK;
+    }
+}
+
+// call with the lock held
+static void reset(sio_journal_t *journal)
+{
+    journal->head = 0;
+    journal->tail = 0;
+    journal->epoch++;
+}
+
+// call with the lock held
+static esp_err_t evict_oldest(sio_journal_t *journal)
+{
+    uint32_t position = journal->head;
+    uint16_t len = 0;
+    esp_err_t err = read_record_len(journal, &position, &len);
+    if (err != ESP_OK)
+    {
+        // nothing trustworthy left in there
+        reset(journal);
+        return err;
+    }
+    journal->head = position + RECORD_LEN_SIZE + len;
+    journal->evicted++;
+    journal->epoch++;
+    return ESP_OK;
+}
+
+esp_err_t journal_open(sio_journal_t *journal, const sio_journal_storage_t *storage, sio_journal_eviction_t eviction)
+{
+    memset(journal, 0, sizeof(sio_journal_t));
+    if (storage->read == NULL || storage->write == NULL || storage->size <= sizeof(sio_journal_header_t) + RECORD_LEN_SIZE)
+    {
+        ESP_LOGE(TAG, "Unusable journal storage");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    journal->storage = *storage;
+    journal->eviction = eviction;
+    journal->data_size = storage->size - sizeof(sio_journal_header_t);
+    journal->lock = xSemaphoreCreateMutex();
+    if (journal->lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    sio_journal_header_t header;
+    esp_err_t err = storage->read(storage->ctx, 0, &header, sizeof(header));
+    if (err == ESP_OK && header.magic == SIO_JOURNAL_MAGIC && header.check == header_check(&header) &&
+        header.data_size == journal->data_size && header.tail - header.head <= journal->data_size)
+    {
+        journal->head = header.head;
+        journal->tail = header.tail;
+        if (journal->head != journal->tail)
+        {
+            ESP_LOGI(TAG, "Journal holds %u bytes from before", (unsigned)(journal->tail - journal->head));
+        }
+        return ESP_OK;
+    }
+
+    // new storage, another size or garbage: start empty
+    return write_header(journal);
+}
+
+void journal_close(sio_journal_t *journal)
+{
+    if (journal->lock == NULL)
+    {
+        return;
+    }
+    vSemaphoreDelete(journal->lock);
+    journal->lock = NULL;
+    if (journal->storage.close != NULL)
+    {
+        journal->storage.close(journal->storage.ctx);
+    }
+}
+
+esp_err_t journal_append(sio_journal_t *journal, const char *data, size_t len)
+{
+    uint32_t need = RECORD_LEN_SIZE + len;
+    if (len > RECORD_MAX_LEN || need > journal->data_size)
+    {
+        ESP_LOGE(TAG, "Packet of %d bytes does not fit into the journal", (int)len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(journal->lock, portMAX_DELAY);
+
+    // a record that does not fit into the rest of the lap starts the next one
+    uint32_t left = lap_left(journal, journal->tail);
+    uint32_t skip = left < need ? left : 0;
+
+    esp_err_t err = ESP_OK;
+    while (journal->data_size - (journal->tail - journal->head) < skip + need)
+    {
+        if (journal->eviction == SIO_JOURNAL_REJECT_NEW)
+        {
+            err = ESP_ERR_NO_MEM;
+            goto cleanup;
+        }
+        evict_oldest(journal);
+    }
+    if (journal->head == journal->tail)
+    {
+        reset(journal);
+        skip = 0;
+    }
+
+    if (skip >= RECORD_LEN_SIZE)
+    {
+        uint8_t wrap[RECORD_LEN_SIZE] = {RECORD_WRAP & 0xFF, RECORD_WRAP >> 8};
+        err = journal->storage.write(journal->storage.ctx, physical(journal, journal->tail), wrap, RECORD_LEN_SIZE);
+        if (err != ESP_OK)
+        {
+            goto cleanup;
+        }
+    }
+
+    uint32_t position = journal->tail + skip;
+    uint8_t raw[RECORD_LEN_SIZE] = {len & 0xFF, len >> 8};
+    err = journal->storage.write(journal->storage.ctx, physical(journal, position), raw, RECORD_LEN_SIZE);
+    if (err == ESP_OK)
+    {
+        err = journal->storage.write(journal->storage.ctx, physical(journal, position) + RECORD_LEN_SIZE, data, len);
+    }
+    if (err != ESP_OK)
+    {
+        goto cleanup;
+    }
+
+    // the record only counts once the header says so
+    journal->tail = position + need;
+    err = write_header(journal);
+
+cleanup:
+    xSemaphoreGive(journal->lock);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to journal packet: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+bool journal_is_empty(sio_journal_t *journal)
+{
+    xSemaphoreTake(journal->lock, portMAX_DELAY);
+    bool empty = journal->head == journal->tail;
+    xSemaphoreGive(journal->lock);
+    return empty;
+}
+
+// Copies the records from *cursor on into a buffer from reserve, separated by ASCII_RS and
+// terminated, as many as fit into batch_bytes and always at least one. Call with the lock held.
+static esp_err_t read_batch(sio_journal_t *journal, size_t batch_bytes, sio_journal_reserve_fn reserve, void *arg,
+                            char **buffer, size_t *used, size_t *count, uint32_t *cursor)
+{
+    *buffer = NULL;
+    *used = 0;
+    *count = 0;
+    while (*cursor != journal->tail)
+    {
+        uint32_t position = *cursor;
+        uint16_t len = 0;
+        esp_err_t err = read_record_len(journal, &position, &len);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        if (*count > 0 && *used + 1 + len > batch_bytes)
+        {
+            break;
+        }
+        if (*buffer == NULL)
+        {
+            *buffer = reserve((batch_bytes > len ? batch_bytes : len) + 1, arg);
+            if (*buffer == NULL)
+            {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        if (*count > 0)
+        {
+            (*buffer)[(*used)++] = ASCII_RS;
+        }
+        err = journal->storage.read(journal->storage.ctx, physical(journal, position) + RECORD_LEN_SIZE, *buffer + *used, len);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        *used += len;
+        (*count)++;
+        *cursor = position + RECORD_LEN_SIZE + len;
+    }
+    if (*buffer != NULL)
+    {
+        (*buffer)[*used] = '\0';
+    }
+    return ESP_OK;
+}
+
+// the records up to cursor were sent, call with the lock held
+static esp_err_t drop_until(sio_journal_t *journal, uint32_t cursor)
+{
+    journal->head = cursor;
+    if (journal->head == journal->tail)
+    {
+        reset(journal);
+    }
+    return write_header(journal);
+}
+
+static char *reserve_heap(size_t size, void *arg)
+{
+    char **buffer = (char **)arg;
+    *buffer = malloc(size);
+    return *buffer;
+}
+
+esp_err_t journal_replay(sio_journal_t *journal, size_t batch_bytes, TickType_t wait, sio_journal_send_fn send, void *arg)
+{
+    esp_err_t err = ESP_OK;
+    if (xSemaphoreTake(journal->lock, wait) != pdTRUE)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    while (journal->head != journal->tail)
+    {
+        uint32_t cursor = journal->head;
+        char *owned = NULL;
+        char *buffer = NULL;
+        size_t used = 0;
+        size_t count = 0;
+        err = read_batch(journal, batch_bytes, reserve_heap, &owned, &buffer, &used, &count, &cursor);
+
+        bool corrupt = err == ESP_ERR_INVALID_STATE;
+        if (err == ESP_OK && count > 0)
+        {
+            err = send(buffer, used, count, arg);
+        }
+        free(owned);
+
+        if (corrupt)
+        {
+            // unreadable records, drop the journal rather than replaying garbage forever
+            reset(journal);
+            write_header(journal);
+            break;
+        }
+        if (err != ESP_OK)
+        {
+            break;
+        }
+
+        ESP_LOGI(TAG, "Replayed %d journaled packets", (int)count);
+        err = drop_until(journal, cursor);
+        if (err != ESP_OK)
+        {
+            break;
+        }
+    }
+
+    xSemaphoreGive(journal->lock);
+    return err;
+}
+
+esp_err_t journal_peek(sio_journal_t *journal, size_t batch_bytes, TickType_t wait, sio_journal_reserve_fn reserve, void *arg,
+                       sio_journal_batch_t *batch)
+{
+    if (xSemaphoreTake(journal->lock, wait) != pdTRUE)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    if (journal->head != journal->tail)
+    {
+        batch->from = journal->head;
+        batch->to = journal->head;
+        batch->epoch = journal->epoch;
+        err = read_batch(journal, batch_bytes, reserve, arg, &batch->records, &batch->len, &batch->count, &batch->to);
+        if (err == ESP_ERR_INVALID_STATE)
+        {
+            // unreadable records, drop the journal rather than replaying garbage forever
+            reset(journal);
+            write_header(journal);
+        }
+    }
+
+    xSemaphoreGive(journal->lock);
+    return err;
+}
+
+esp_err_t journal_commit(sio_journal_t *journal, const sio_journal_batch_t *batch)
+{
+    xSemaphoreTake(journal->lock, portMAX_DELAY);
+    esp_err_t err = ESP_OK;
+    // records the ring dropped meanwhile shifted the head, the rest goes out again with the next replay
+    if (journal->epoch == batch->epoch && journal->head == batch->from)
+    {
+        ESP_LOGI(TAG, "Replayed %d journaled packets", (int)batch->count);
+        err = drop_until(journal, batch->to);
+    }
+    xSemaphoreGive(journal->lock);
+    return err;
+}
@@ -0,0 +1,205 @@
+#include <internal/sio_metrics.h>
+#include <esp_log.h>
+#include <string.h>
+
+static const char *TAG = "[sio:metrics]";
+
+static void histogram_add(sio_histogram_t *histogram, int64_t elapsed_us)
+{
+    uint32_t ms = elapsed_us < 0 ? 0 : (uint32_t)(elapsed_us / 1000);
+    size_t bucket = 0;
+    while (bucket < SIO_METRICS_HISTOGRAM_BUCKETS - 1 && ms >= (1u << bucket))
+    {
+        bucket++;
+    }
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum_ms += ms;
+    if (ms > histogram->max_ms)
+    {
+        histogram->max_ms = ms;
+    }
+}
+
+static void metrics_timer_cb(void *arg)
+{
+    sio_metrics_recorder_t *metrics = (sio_metrics_recorder_t *)arg;
+    metrics->report_cb(metrics->arg);
+}
+
+esp_err_t metrics_init(sio_metrics_recorder_t *metrics, sio_client_id_t client_id, uint32_t interval_ms,
+                       sio_metrics_report_cb_t report_cb, void *arg)
+{
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    memset(metrics, 0, sizeof(sio_metrics_recorder_t));
+    metrics->lock = unlocked;
+    metrics->values.client_id = client_id;
+    metrics->report_cb = report_cb;
+    metrics->arg = arg;
+
+    if (interval_ms == 0 || report_cb == NULL)
+    {
+        return ESP_OK;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = metrics_timer_cb,
+        .arg = metrics,
+        .name = "sio_metrics"};
+    esp_err_t err = esp_timer_create(&timer_args, &metrics->timer);
+    if (err == ESP_OK)
+    {
+        err = esp_timer_start_periodic(metrics->timer, (uint64_t)interval_ms * 1000);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start the metrics report: %s", esp_err_to_name(err));
+        metrics_deinit(metrics);
+    }
+    return err;
+}
+
+void metrics_deinit(sio_metrics_recorder_t *metrics)
+{
+    if (metrics->timer != NULL)
+    {
+        esp_timer_stop(metrics->timer); // not running is fine
+        esp_timer_delete(metrics->timer);
+        metrics->timer = NULL;
+    }
+}
+
+void metrics_count_in(sio_metrics_recorder_t *metrics, size_t bytes, uint32_t packets)
+{
+    if (metrics == NULL)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&metrics->lock);
+    metrics->values.bytes_in += bytes;
+    metrics->values.packets_in += packets;
+    portEXIT_CRITICAL(&metrics->lock);
+}
+
+void metrics_count_out(sio_metrics_recorder_t *metrics, size_t bytes, uint32_t packets)
+{
+    if (metrics == NULL)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&metrics->lock);
+    metrics->values.bytes_out += bytes;
+    metrics->values.packets_out += packets;
+    portEXIT_CRITICAL(&metrics->lock);
+}
+
+void metrics_drop_out(sio_metrics_recorder_t *metrics, uint32_t packets)
+{
+    if (metrics == NULL)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&metrics->lock);
+    metrics->values.dropped_out += packets;
+    portEXIT_CRITICAL(&metrics->lock);
+}
+
+void metrics_poll_begin(sio_metrics_recorder_t *metrics)
+{
+    if (metrics == NULL)
+    {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&metrics->lock);
+    metrics->poll_started_us = now;
+    portEXIT_CRITICAL(&metrics->lock);
+}
+
+void metrics_poll_end(sio_metrics_recorder_t *metrics, bool ok)
+{
+    if (metrics == NULL)
+    {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&metrics->lock);
+    metrics->values.polls++;
+    if (!ok)
+    {
+        metrics->values.poll_errors++;
+    }
+    else if (metrics->poll_started_us != 0)
+    {
+        histogram_add(&metrics->values.poll_rtt, now - metrics->poll_started_us);
+    }
+    metrics->poll_started_us = 0;
+    portEXIT_CRITICAL(&metrics->lock);
+}
+
+void metrics_post(sio_metrics_recorder_t *metrics, int64_t started_us, bool ok)
+{
+    if (metrics == NULL)
+    {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&metrics->lock);
+    metrics->values.posts++;
+    if (ok)
+    {
+        histogram_add(&metrics->values.post_latency, now - started_us);
+    }
+    else
+    {
+        metrics->values.post_errors++;
+    }
+    portEXIT_CRITICAL(&metrics->lock);
+}
+
+void metrics_ping(sio_metrics_recorder_t *metrics)
+{
+    if (metrics == NULL)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&metrics->lock);
+    metrics->values.pings++;
+    portEXIT_CRITICAL(&metrics->lock);
+}
+
+void metrics_reconnect(sio_metrics_recorder_t *metrics)
+{
+    if (metrics == NULL)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&metrics->lock);
+    metrics->values.reconnects++;
+    portEXIT_CRITICAL(&metrics->lock);
+}
+
+void metrics_heap(sio_metrics_recorder_t *metrics, int32_t delta)
+{
+    if (metrics == NULL)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&metrics->lock);
+    // never below zero, a miscount must not wrap around
+    int64_t heap = (int64_t)metrics->values.heap_bytes + delta;
+    metrics->values.heap_bytes = heap < 0 ? 0 : (uint32_t)heap;
+    if (metrics->values.heap_bytes > metrics->values.heap_peak_bytes)
+    {
+        metrics->values.heap_peak_bytes = metrics->values.heap_bytes;
+    }
+    portEXIT_CRITICAL(&metrics->lock);
+}
+
+void metrics_snapshot(sio_metrics_recorder_t *metrics, sio_metrics_t *snapshot)
+{
+    portENTER_CRITICAL(&metrics->lock);
+    *snapshot = metrics->values;
+    portEXIT_CRITICAL(&metrics->lock);
+}
@@ -0,0 +1,391 @@
+#include <internal/sio_namespace.h>
+#include <sio_client.h>
+#include <esp_log.h>
+#include <cJSON.h>
+#include <string.h>
+#include <stdio.h>
+
+static const char *TAG = "[sio:namespace]";
+
+static bool namespace_matches(const sio_namespace_t *entry, const char *name, size_t len)
+{
+    if (name == NULL)
+    {
+        return strcmp(entry->name, "/") == 0;
+    }
+    return strncmp(entry->name, name, len) == 0 && entry->name[len] == '\0';
+}
+
+void namespace_table_init(sio_namespace_table_t *table, const char *default_nsp)
+{
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    memset(table, 0, sizeof(sio_namespace_table_t));
+    table->lock = unlocked;
+
+    snprintf(table->entries[0].name, SIO_MAX_NAMESPACE_LEN, "%s", default_nsp);
+    table->entries[0].state = SIO_NAMESPACE_DISCONNECTED;
+}
+
+sio_namespace_id_t namespace_table_add(sio_namespace_table_t *table, const char *nsp)
+{
+    size_t len = strlen(nsp);
+    if (len == 0 || nsp[0] != '/' || len >= SIO_MAX_NAMESPACE_LEN)
+    {
+        ESP_LOGE(TAG, "Invalid namespace %s", nsp);
+        return -1;
+    }
+
+    sio_namespace_id_t id = -1;
+    sio_namespace_id_t free_id = -1;
+    portENTER_CRITICAL(&table->lock);
+    for (int i = 0; i < SIO_MAX_NAMESPACES; i++)
+    {
+        if (table->entries[i].state == SIO_NAMESPACE_FREE)
+        {
+            free_id = free_id < 0 ? i : free_id;
+        }
+        else if (namespace_matches(&table->entries[i], nsp, len))
+        {
+            id = i;
+            break;
+        }
+    }
+    if (id < 0 && free_id >= 0)
+    {
+        id = free_id;
+        memset(&table->entries[id], 0, sizeof(sio_namespace_t));
+        memcpy(table->entries[id].name, nsp, len + 1);
+        table->entries[id].state = SIO_NAMESPACE_DISCONNECTED;
+    }
+    portEXIT_CRITICAL(&table->lock);
+
+    if (id < 0)
+    {
+        ESP_LOGE(TAG, "No namespace slot left for %s, increase SIO_MAX_NAMESPACES", nsp);
+    }
+    return id;
+}
+
+sio_namespace_id_t namespace_table_find(sio_namespace_table_t *table, const char *name, size_t len)
+{
+    sio_namespace_id_t id = -1;
+    portENTER_CRITICAL(&table->lock);
+    for (int i = 0; i < SIO_MAX_NAMESPACES; i++)
+    {
+        if (table->entries[i].state != SIO_NAMESPACE_FREE && namespace_matches(&table->entries[i], name, len))
+        {
+            id = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&table->lock);
+    return id;
+}
+
+void namespace_table_remove(sio_namespace_table_t *table, sio_namespace_id_t id)
+{
+    if (id <= 0 || id >= SIO_MAX_NAMESPACES)
+    {
+        return; // the default namespace stays
+    }
+    portENTER_CRITICAL(&table->lock);
+    table->entries[id].state = SIO_NAMESPACE_FREE;
+    table->entries[id].pid[0] = '\0';
+    portEXIT_CRITICAL(&table->lock);
+}
+
+bool namespace_table_get_name(sio_namespace_table_t *table, sio_namespace_id_t id, char name[SIO_MAX_NAMESPACE_LEN])
+{
+    if (id < 0 || id >= SIO_MAX_NAMESPACES)
+    {
+        return false;
+    }
+    portENTER_CRITICAL(&table->lock);
+    bool used = table->entries[id].state != SIO_NAMESPACE_FREE;
+    if (used)
+    {
+        memcpy(name, table->entries[id].name, SIO_MAX_NAMESPACE_LEN);
+    }
+    portEXIT_CRITICAL(&table->lock);
+    return used;
+}
+
+sio_namespace_state_t namespace_table_get_state(sio_namespace_table_t *table, sio_namespace_id_t id)
+{
+    if (id < 0 || id >= SIO_MAX_NAMESPACES)
+    {
+        return SIO_NAMESPACE_FREE;
+    }
+    portENTER_CRITICAL(&table->lock);
+    sio_namespace_state_t state = table->entries[id].state;
+    portEXIT_CRITICAL(&table->lock);
+    return state;
+}
+
+void namespace_table_set_state(sio_namespace_table_t *table, sio_namespace_id_t id, sio_namespace_state_t state)
+{
+    if (id < 0 || id >= SIO_MAX_NAMESPACES)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&table->lock);
+    if (table->entries[id].state != SIO_NAMESPACE_FREE)
+    {
+        table->entries[id].state = state;
+    }
+    portEXIT_CRITICAL(&table->lock);
+}
+
+void namespace_table_session_lost(sio_namespace_table_t *table)
+{
+    portENTER_CRITICAL(&table->lock);
+    for (int i = 0; i < SIO_MAX_NAMESPACES; i++)
+    {
+        if (table->entries[i].state != SIO_NAMESPACE_FREE)
+        {
+            table->entries[i].state = SIO_NAMESPACE_DISCONNECTED;
+        }
+    }
+    portEXIT_CRITICAL(&table->lock);
+}
+
+// recovery ids go into json unescaped
+static bool valid_recovery_id(const char *id, size_t len)
+{
+    if (len == 0 || len >= SIO_RECOVERY_ID_LEN)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (id[i] == '"' || id[i] == '\\' || (unsigned char)id[i] < 0x20)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+Packet_t *namespace_table_alloc_connect(sio_namespace_table_t *table, sio_namespace_id_t id, const char *auth)
+{
+    if (id < 0 || id >= SIO_MAX_NAMESPACES)
+    {
+        return NULL;
+    }
+
+    char name[SIO_MAX_NAMESPACE_LEN];
+    char pid[SIO_RECOVERY_ID_LEN];
+    char offset[SIO_RECOVERY_ID_LEN];
+    portENTER_CRITICAL(&table->lock);
+    bool used = table->entries[id].state != SIO_NAMESPACE_FREE;
+    memcpy(name, table->entries[id].name, SIO_MAX_NAMESPACE_LEN);
+    memcpy(pid, table->entries[id].pid, SIO_RECOVERY_ID_LEN);
+    memcpy(offset, table->entries[id].offset, SIO_RECOVERY_ID_LEN);
+    portEXIT_CRITICAL(&table->lock);
+
+    if (!used)
+    {
+        return NULL;
+    }
+    if (pid[0] == '\0' || offset[0] == '\0')
+    {
+        // nothing to resume
+        return alloc_namespace_message(name, SIO_PACKET_CONNECT, auth);
+    }
+
+    // {"pid":"..","offset":"..",<rest of auth>}
+    const char *rest = "}";
+    if (auth != NULL)
+    {
+        const char *p = auth;
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        {
+            p++;
+        }
+        if (*p == '{')
+        {
+            rest = p + 1;
+        }
+    }
+    while (*rest == ' ' || *rest == '\t' || *rest == '\r' || *rest == '\n')
+    {
+        rest++;
+    }
+    const char *separator = *rest == '}' ? "" : ",";
+
+    size_t len = strlen(pid) + strlen(offset) + strlen(separator) + strlen(rest) + 23;
+    char *merged = malloc(len + 1);
+    if (merged == NULL)
+    {
+        return NULL;
+    }
+    snprintf(merged, len + 1, "{\"pid\":\"%s\",\"offset\":\"%s\"%s%s", pid, offset, separator, rest);
+
+    ESP_LOGI(TAG, "Asking to recover %s from offset %s", name, offset);
+    Packet_t *packet = alloc_namespace_message(name, SIO_PACKET_CONNECT, merged);
+    free(merged);
+    return packet;
+}
+
+bool namespace_table_recovered(sio_namespace_table_t *table, sio_namespace_id_t id)
+{
+    if (id < 0 || id >= SIO_MAX_NAMESPACES)
+    {
+        return false;
+    }
+    portENTER_CRITICAL(&table->lock);
+    bool recovered = table->entries[id].state != SIO_NAMESPACE_FREE && table->entries[id].recovered;
+    portEXIT_CRITICAL(&table->lock);
+    return recovered;
+}
+
+// 40{"sid":"..","pid":".."}, a pid means the server offers recovery
+static void namespace_connected(sio_namespace_table_t *table, sio_namespace_id_t id, const Packet_t *packet)
+{
+    const char *pid = NULL;
+    cJSON *json = NULL;
+    if (packet->json_start != NULL)
+    {
+        json = cJSON_ParseWithLength(packet->json_start, packet->data + packet->len - packet->json_start);
+        cJSON *pid_item = cJSON_GetObjectItemCaseSensitive(json, "pid");
+        if (cJSON_IsString(pid_item) && valid_recovery_id(pid_item->valuestring, strlen(pid_item->valuestring)))
+        {
+            pid = pid_item->valuestring;
+        }
+    }
+
+    portENTER_CRITICAL(&table->lock);
+    sio_namespace_t *entry = &table->entries[id];
+    entry->state = SIO_NAMESPACE_CONNECTED;
+    entry->recovered = pid != NULL && strcmp(entry->pid, pid) == 0;
+    if (!entry->recovered)
+    {
+        // a fresh session, offsets of the old one mean nothing to it
+        snprintf(entry->pid, SIO_RECOVERY_ID_LEN, "%s", pid == NULL ? "" : pid);
+        entry->offset[0] = '\0';
+    }
+    portEXIT_CRITICAL(&table->lock);
+
+    cJSON_Delete(json);
+}
+
+// remembers the offset the server appended to an event as its last argument
+static void namespace_track_offset(sio_namespace_table_t *table, sio_namespace_id_t id, const Packet_t *packet)
+{
+    // ...,"<offset>"]
+    const char *start = packet->json_start;
+    const char *end = packet->data + packet->len;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\n'))
+    {
+        end--;
+    }
+    if (start == NULL || end - start < 4 || end[-1] != ']' || end[-2] != '"')
+    {
+        return;
+    }
+    const char *offset_end = end - 2;
+    const char *offset = offset_end;
+    while (offset > start && offset[-1] != '"')
+    {
+        offset--;
+    }
+    if (offset - start < 2 || offset[-2] != ',' || !valid_recovery_id(offset, offset_end - offset))
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&table->lock);
+    sio_namespace_t *entry = &table->entries[id];
+    if (entry->pid[0] != '\0')
+    {
+        memcpy(entry->offset, offset, offset_end - offset);
+        entry->offset[offset_end - offset] = '\0';
+    }
+    portEXIT_CRITICAL(&table->lock);
+}
+
+static void post_single_packet(sio_dispatch_queue_t *dispatch, sio_namespace_id_t id, sio_event_t event, Packet_t *packet)
+{
+    PacketPointerArray_t single = NULL;
+    if (packet_arr_append(&single, packet) != ESP_OK)
+    {
+        free_packet(&packet);
+        return;
+    }
+    dispatch_queue_post(dispatch, event, id, single);
+}
+
+void namespace_dispatch_packets(sio_dispatch_queue_t *dispatch, sio_namespace_table_t *table,
+                                sio_event_handler_table_t *handlers, PacketPointerArray_t packets)
+{
+    PacketPointerArray_t routed[SIO_MAX_NAMESPACES] = {NULL};
+    int count = get_array_size(packets);
+    bool use_handlers = !event_handler_table_is_empty(handlers);
+
+    for (int i = 0; i < count; i++)
+    {
+        Packet_t *packet = packets[i];
+
+        if (packet->eio_type != EIO_PACKET_MESSAGE)
+        {
+            // engine.io packets were handled by the transport already
+            free_packet(&packet);
+            continue;
+        }
+
+        sio_namespace_id_t id = namespace_table_find(table, packet->nsp, packet->nsp_len);
+        if (id < 0)
+        {
+            ESP_LOGW(TAG, "Dropping packet for unknown namespace %.*s", (int)packet->nsp_len, packet->nsp);
+            free_packet(&packet);
+            continue;
+        }
+
+        switch (packet->sio_type)
+        {
+        case SIO_PACKET_CONNECT:
+            namespace_connected(table, id, packet);
+            post_single_packet(dispatch, id, SIO_EVENT_NAMESPACE_CONNECTED, packet);
+            break;
+
+        case SIO_PACKET_DISCONNECT:
+            namespace_table_set_state(table, id, SIO_NAMESPACE_DISCONNECTED);
+            post_single_packet(dispatch, id, SIO_EVENT_NAMESPACE_DISCONNECTED, packet);
+            break;
+
+        case SIO_PACKET_CONNECT_ERROR:
+            namespace_table_set_state(table, id, SIO_NAMESPACE_DISCONNECTED);
+            post_single_packet(dispatch, id, SIO_EVENT_NAMESPACE_CONNECT_ERROR, packet);
+            break;
+
+        case SIO_PACKET_EVENT:
+        case SIO_PACKET_BINARY_EVENT:
+            namespace_track_offset(table, id, packet);
+            if (use_handlers)
+            {
+                // unhandled events were mostly dropped by the parser already
+                event_handler_table_dispatch(handlers, dispatch->client_id, id, packet);
+                free_packet(&packet);
+                break;
+            }
+            // fall through
+        default:
+            if (packet_arr_append(&routed[id], packet) != ESP_OK)
+            {
+                free_packet(&packet);
+            }
+            break;
+        }
+    }
+
+    // every packet moved on, only the array itself is left
+    release_packet_arr(&packets);
+
+    for (int id = 0; id < SIO_MAX_NAMESPACES; id++)
+    {
+        if (routed[id] != NULL)
+        {
+            dispatch_queue_post(dispatch, SIO_EVENT_RECEIVED_MESSAGE, id, routed[id]);
+        }
+    }
+}
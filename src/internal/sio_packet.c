@@ -1,13 +1,23 @@
 
 #include <internal/sio_packet.h>
+#include <internal/sio_pool.h>
+#include <internal/http_handlers.h>
 #include <utility.h>
 
+#include <stddef.h>
+
 #include <esp_log.h>
 #include <sio_client.h>
 
 const char *TAG = "[sio_packet]";
 const char *empty_str = "";
 
+// every PacketPointerArray_t is the packets member of a batch
+static sio_packet_batch_t *get_batch(PacketPointerArray_t arr)
+{
+    return (sio_packet_batch_t *)((char *)arr - offsetof(sio_packet_batch_t, packets));
+}
+
 void parse_packet(Packet_t *packet)
 {
 
@@ -31,10 +41,38 @@ void parse_packet(Packet_t *packet)
         return;
     }
 
+    if (packet->data[0] == 'b')
+    {
+        // binary record on polling, decoded over itself so the packet stays a view
+        if (packet->rx_buffer == NULL)
+        {
+            ESP_LOGE(TAG, "Binary record outside of a receive buffer");
+            return;
+        }
+        int decoded_len = util_base64_decode_in_place(packet->data + 1, packet->len - 1);
+        if (decoded_len < 0)
+        {
+            ESP_LOGE(TAG, "Invalid base64 in binary record");
+            return;
+        }
+        packet->eio_type = EIO_PACKET_BINARY;
+        packet->sio_type = SIO_PACKET_NONE;
+        packet->json_start = NULL;
+        packet->data += 1;
+        packet->len = decoded_len;
+        return;
+    }
+
     packet->eio_type = (eio_packet_t)(packet->data[0] - '0');
     packet->sio_type = SIO_PACKET_NONE;
     packet->json_start = NULL;
 
+    if (packet->eio_type == EIO_PACKET_MESSAGE && packet->len >= 2)
+    {
+        // a bare "40" or "41" of the default namespace has no more than the type
+        packet->sio_type = (sio_packet_t)(packet->data[1] - '0');
+    }
+
     if (packet->len <= 2)
     {
         ESP_LOGD(TAG, "Packet length is less than 2, single indicator");
@@ -48,18 +86,68 @@ void parse_packet(Packet_t *packet)
         break;
 
     case EIO_PACKET_MESSAGE:
-        packet->sio_type = (sio_packet_t)(packet->data[1] - '0');
-        // find the start of the json message, (the namespace might be in between but we just ignore it)
+    {
+        // 4<type>[<attachments>-][/namespace,][<ack id>]<json>
+        size_t pos = 2;
+
+        if (packet->sio_type == SIO_PACKET_BINARY_EVENT || packet->sio_type == SIO_PACKET_BINARY_ACK)
+        {
+            // the attachments follow as separate packets
+            int attachments = 0;
+            for (; pos < packet->len && packet->data[pos] >= '0' && packet->data[pos] <= '9'; pos++)
+            {
+                attachments = attachments * 10 + (packet->data[pos] - '0');
+            }
+            packet->attachments_expected = attachments > UINT8_MAX ? UINT8_MAX : attachments;
+            if (pos < packet->len && packet->data[pos] == '-')
+            {
+                pos++;
+            }
+        }
+
+        if (pos < packet->len && packet->data[pos] == '/')
+        {
+            packet->nsp = packet->data + pos;
+            while (pos < packet->len && packet->data[pos] != ',')
+            {
+                pos++;
+            }
+            packet->nsp_len = packet->data + pos - packet->nsp;
+            pos++;
+        }
+
+        if (pos < packet->len && packet->data[pos] >= '0' && packet->data[pos] <= '9')
+        {
+            int64_t ack_id = 0;
+            for (; pos < packet->len && packet->data[pos] >= '0' && packet->data[pos] <= '9'; pos++)
+            {
+                ack_id = ack_id * 10 + (packet->data[pos] - '0');
+                if (ack_id > INT32_MAX)
+                {
+                    ESP_LOGW(TAG, "Ack id out of range");
+                    ack_id = -1;
+                    break;
+                }
+            }
+            packet->ack_id = ack_id;
+        }
 
-        for (int i = 2; i < packet->len; i++)
+        // find the start of the json message
+        for (; pos < packet->len; pos++)
         {
-            if (packet->data[i] == '{' || packet->data[i] == '[')
+            if (packet->data[pos] == '{' || packet->data[pos] == '[')
             {
-                packet->json_start = packet->data + i;
+                packet->json_start = packet->data + pos;
                 break;
             }
         }
         break;
+    }
+
+    case EIO_PACKET_PING:
+    case EIO_PACKET_PONG:
+        // probe payload, no json
+        break;
 
     default:
         ESP_LOGW(TAG, "Unknown packet type %d %s", packet->eio_type, packet->data);
@@ -67,17 +155,360 @@ void parse_packet(Packet_t *packet)
     }
 }
 
+sio_rx_buffer_t *alloc_rx_buffer(size_t capacity)
+{
+    return pool_acquire_rx_buffer(capacity);
+}
+
+void rx_buffer_retain(sio_rx_buffer_t *buffer)
+{
+    __atomic_add_fetch(&buffer->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void rx_buffer_release(sio_rx_buffer_t **buffer_p_p)
+{
+    sio_rx_buffer_t *buffer = *buffer_p_p;
+    *buffer_p_p = NULL;
+
+    if (buffer != NULL && __atomic_sub_fetch(&buffer->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        pool_release_rx_buffer(buffer);
+    }
+}
+
+PacketPointerArray_t alloc_packet_arr(int count)
+{
+    sio_packet_batch_t *batch = pool_acquire_batch(count);
+    return batch == NULL ? NULL : batch->packets;
+}
+
+esp_err_t packet_arr_append(PacketPointerArray_t *arr_p, Packet_t *packet)
+{
+    sio_packet_batch_t *batch = *arr_p == NULL ? pool_acquire_batch(SIO_BATCH_POOL_CAPACITY) : get_batch(*arr_p);
+    if (batch == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (batch->count == batch->capacity)
+    {
+        sio_packet_batch_t *bigger = pool_acquire_batch(batch->capacity * 2);
+        if (bigger == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(bigger->packets, batch->packets, batch->count * sizeof(Packet_t *));
+        bigger->count = batch->count;
+        pool_release_batch(batch);
+        batch = bigger;
+    }
+
+    batch->packets[batch->count++] = packet;
+    batch->packets[batch->count] = NULL;
+    *arr_p = batch->packets;
+    return ESP_OK;
+}
+
+// streaming parser
+
+void rx_parser_init(sio_rx_parser_t *parser, size_t size_hint)
+{
+    memset(parser, 0, sizeof(sio_rx_parser_t));
+    parser->size_hint = size_hint;
+}
+
+void rx_parser_reset(sio_rx_parser_t *parser)
+{
+    if (parser->packets != NULL)
+    {
+        free_packet_arr(&parser->packets);
+    }
+    rx_buffer_release(&parser->buffer);
+    rx_parser_init(parser, 0);
+}
+
+bool rx_parser_started(const sio_rx_parser_t *parser)
+{
+    return parser->buffer != NULL || parser->packets != NULL;
+}
+
+// cuts [record_start, end) out of the current buffer as a finished packet
+static esp_err_t rx_parser_end_record(sio_rx_parser_t *parser, size_t end)
+{
+    size_t start = parser->record_start;
+    parser->record_start = end + 1;
+
+    if (end == start)
+    {
+        return ESP_OK; // empty record
+    }
+
+    if (parser->filter != NULL && !parser->filter(parser->buffer->data + start, end - start, parser->filter_arg))
+    {
+        parser->dropped++;
+        return ESP_OK;
+    }
+
+    Packet_t *packet = pool_acquire_packet();
+    if (packet == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = packet_arr_append(&parser->packets, packet);
+    if (err != ESP_OK)
+    {
+        pool_release_packet(packet);
+        return err;
+    }
+
+    sio_rx_buffer_t *buffer = parser->buffer;
+    buffer->data[end] = '\0';
+
+    packet->data = buffer->data + start;
+    packet->len = end - start;
+    packet->rx_buffer = buffer;
+    rx_buffer_retain(buffer);
+
+    parse_packet(packet);
+    return ESP_OK;
+}
+
+static esp_err_t rx_parser_scan(sio_rx_parser_t *parser, size_t from)
+{
+    sio_rx_buffer_t *buffer = parser->buffer;
+    for (size_t i = from; i < buffer->len; i++)
+    {
+        if (buffer->data[i] == ASCII_RS)
+        {
+            esp_err_t err = rx_parser_end_record(parser, i);
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t rx_parser_feed(sio_rx_parser_t *parser, const char *data, size_t len)
+{
+    sio_rx_buffer_t *buffer = parser->buffer;
+    size_t available = buffer == NULL ? 0 : buffer->capacity - buffer->len;
+
+    if (len > available)
+    {
+        // Finished packets keep the old buffer alive through their reference,
+        // only the unfinished record moves over to the new one.
+        size_t partial = buffer == NULL ? 0 : buffer->len - parser->record_start;
+        size_t capacity;
+        if (buffer == NULL && parser->size_hint > 0)
+        {
+            capacity = parser->size_hint; // content length known, one buffer fits all
+        }
+        else if (buffer == NULL)
+        {
+            capacity = MAX_HTTP_RECV_BUFFER;
+        }
+        else
+        {
+            capacity = buffer->capacity * 2;
+        }
+        if (capacity < partial + len)
+        {
+            capacity = partial + len;
+        }
+
+        sio_rx_buffer_t *next = alloc_rx_buffer(capacity);
+        if (next == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        if (partial > 0)
+        {
+            memcpy(next->data, buffer->data + parser->record_start, partial);
+            next->len = partial;
+        }
+        rx_buffer_release(&parser->buffer);
+        parser->buffer = next;
+        parser->record_start = 0;
+        buffer = next;
+    }
+
+    size_t from = buffer->len;
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+
+    return rx_parser_scan(parser, from);
+}
+
+PacketPointerArray_t rx_parser_finish(sio_rx_parser_t *parser)
+{
+    PacketPointerArray_t arr = NULL;
+
+    // the end of the body ends the last record
+    if (parser->buffer != NULL && rx_parser_end_record(parser, parser->buffer->len) != ESP_OK)
+    {
+        goto reset;
+    }
+
+    if (parser->packets == NULL)
+    {
+        if (parser->dropped == 0)
+        {
+            ESP_LOGW(TAG, "No packets found in buffer");
+        }
+        goto reset;
+    }
+
+    // the packets and their buffer references go out as they are
+    arr = parser->packets;
+    parser->packets = NULL;
+
+reset:
+    rx_parser_reset(parser);
+    return arr;
+}
+
+PacketPointerArray_t parse_packet_buffer(sio_rx_buffer_t *buffer)
+{
+    sio_rx_parser_t parser;
+    rx_parser_init(&parser, 0);
+    parser.buffer = buffer;
+
+    if (rx_parser_scan(&parser, 0) != ESP_OK)
+    {
+        rx_parser_reset(&parser);
+        return NULL;
+    }
+    return rx_parser_finish(&parser);
+}
+
+PacketPointerArray_t parse_binary_buffer(sio_rx_buffer_t *buffer)
+{
+    Packet_t *packet = pool_acquire_packet();
+    PacketPointerArray_t arr = NULL;
+    if (packet == NULL || packet_arr_append(&arr, packet) != ESP_OK)
+    {
+        pool_release_packet(packet);
+        rx_buffer_release(&buffer);
+        return NULL;
+    }
+
+    // the packet takes over the callers reference
+    packet->eio_type = EIO_PACKET_BINARY;
+    packet->sio_type = SIO_PACKET_NONE;
+    packet->data = buffer->data;
+    packet->len = buffer->len;
+    packet->rx_buffer = buffer;
+    return arr;
+}
+
+void packet_arr_collect_attachments(PacketPointerArray_t *arr_p, Packet_t **pending_p)
+{
+    sio_packet_batch_t *batch = get_batch(*arr_p);
+    size_t kept = 0;
+
+    // kept never overtakes i, so the array is compacted in place
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        Packet_t *packet = batch->packets[i];
+        Packet_t *pending = *pending_p;
+
+        if (packet->eio_type == EIO_PACKET_BINARY)
+        {
+            if (pending == NULL)
+            {
+                ESP_LOGW(TAG, "Binary data without a header, dropping %d bytes", (int)packet->len);
+                free_packet(&packet);
+                continue;
+            }
+
+            if (packet_arr_append(&pending->attachments, packet) != ESP_OK)
+            {
+                free_packet(&packet);
+                free_packet(pending_p);
+                continue;
+            }
+
+            if (get_array_size(pending->attachments) >= pending->attachments_expected)
+            {
+                batch->packets[kept++] = pending;
+                *pending_p = NULL;
+            }
+            continue;
+        }
+
+        if (pending != NULL)
+        {
+            ESP_LOGW(TAG, "Binary packet got %d of %d attachments, dropping it",
+                     get_array_size(pending->attachments), pending->attachments_expected);
+            free_packet(pending_p);
+        }
+
+        if (packet->attachments_expected > 0)
+        {
+            *pending_p = packet;
+            continue;
+        }
+        batch->packets[kept++] = packet;
+    }
+
+    batch->count = kept;
+    batch->packets[kept] = NULL;
+    if (kept == 0)
+    {
+        pool_release_batch(batch);
+        *arr_p = NULL;
+    }
+}
+
+void packet_arr_filter(PacketPointerArray_t *arr_p, bool (*consume)(Packet_t *packet, void *arg), void *arg)
+{
+    sio_packet_batch_t *batch = get_batch(*arr_p);
+    size_t kept = 0;
+
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        Packet_t *packet = batch->packets[i];
+        if (consume(packet, arg))
+        {
+            free_packet(&packet);
+            continue;
+        }
+        batch->packets[kept++] = packet;
+    }
+
+    batch->count = kept;
+    batch->packets[kept] = NULL;
+    if (kept == 0)
+    {
+        pool_release_batch(batch);
+        *arr_p = NULL;
+    }
+}
+
 void free_packet(Packet_t **packet_p_p)
 {
     Packet_t *packet_p = *packet_p_p;
 
-    if (packet_p->data != NULL)
+    if (packet_p->attachments != NULL)
+    {
+        free_packet_arr(&packet_p->attachments);
+    }
+
+    if (packet_p->rx_buffer != NULL)
+    {
+        // view, drop the reference instead
+        rx_buffer_release(&packet_p->rx_buffer);
+    }
+    else if (packet_p->data != NULL && packet_p->data != packet_p->control_data)
     {
         free(packet_p->data);
-        packet_p->data = NULL;
     }
+    packet_p->data = NULL;
 
-    free(packet_p);
+    pool_release_packet(packet_p);
     *packet_p_p = NULL;
 }
 
@@ -87,70 +518,316 @@ int get_array_size(PacketPointerArray_t arr_p)
     {
         return 0;
     }
+    return get_batch(arr_p)->count;
+}
 
-    int i = 0;
-    while (arr_p[i] != NULL)
+void free_packet_arr(PacketPointerArray_t *arr_p)
+{
+    sio_packet_batch_t *batch = get_batch(*arr_p);
+
+    for (int i = 0; i < batch->count; i++)
     {
-        i++;
+        free_packet(&batch->packets[i]);
     }
-    return i;
+
+    pool_release_batch(batch);
+    *arr_p = NULL;
 }
 
-void free_packet_arr(PacketPointerArray_t *arr_p)
+void release_packet_arr(PacketPointerArray_t *arr_p)
 {
-    PacketPointerArray_t arr = *arr_p;
-
-    // print_packet_arr(arr);
+    pool_release_batch(get_batch(*arr_p));
+    *arr_p = NULL;
+}
 
-    int i = 0;
-    while (arr[i] != NULL)
+Packet_t *alloc_control_packet(eio_packet_t type)
+{
+    Packet_t *packet = pool_acquire_packet();
+    if (packet == NULL)
     {
-        Packet_t *p = arr[i];
-        free_packet(&p);
-        i++;
+        return NULL;
     }
-    free(arr);
-    *arr_p = NULL;
+
+    // single character packets need no extra allocation
+    packet->data = packet->control_data;
+    packet->len = 1;
+    setEioType(packet, type);
+    return packet;
 }
 
-Packet_t *alloc_message(const char *json_str, const char *event_str)
+// the root namespace is left out of packets, every other one is written as "/nsp,"
+static const char *nsp_prefix(const char *nsp)
+{
+    return (nsp == NULL || strcmp(nsp, "/") == 0) ? empty_str : nsp;
+}
+
+static const char *nsp_separator(const char *nsp)
+{
+    return (nsp == NULL || strcmp(nsp, "/") == 0) ? empty_str : ",";
+}
+
+Packet_t *alloc_event_message(const char *nsp, const char *json_str, const char *event_str, int32_t ack_id)
 {
     if (json_str == NULL)
     {
         json_str = empty_str;
     }
 
-    Packet_t *packet = calloc(1, sizeof(Packet_t));
+    Packet_t *packet = pool_acquire_packet();
     if (packet == NULL)
     {
-        ESP_LOGE(TAG, "Failed to allocate memory for packet");
         return NULL;
     }
 
     packet->eio_type = EIO_PACKET_MESSAGE;
     packet->sio_type = SIO_PACKET_EVENT;
+    packet->ack_id = ack_id;
+
+    char id_str[12] = "";
+    if (ack_id >= 0)
+    {
+        sprintf(id_str, "%ld", (long)ack_id);
+    }
+    const char *prefix = nsp_prefix(nsp);
+    const char *separator = nsp_separator(nsp);
 
     if (event_str == NULL)
     {
 
-        packet->len = 2 + strlen(json_str);
+        packet->len = 2 + strlen(prefix) + strlen(separator) + strlen(id_str) + strlen(json_str);
         packet->data = calloc(1, packet->len + 1);
+        if (packet->data == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to allocate memory for packet data");
+            pool_release_packet(packet);
+            return NULL;
+        }
 
-        sprintf(packet->data, "42%s", json_str);
+        sprintf(packet->data, "42%s%s%s%s", prefix, separator, id_str, json_str);
     }
     else
     {
         // Events attach something before the json and make it an array
         // 42["event",json]
 
-        packet->len = 2 + strlen("[\"") + strlen(event_str) + strlen("\",") + strlen(json_str) + strlen("]");
+        size_t event_len = strlen(event_str);
+        size_t escaped_len = util_json_escape(NULL, event_str, event_len);
+
+        packet->len = 2 + strlen(prefix) + strlen(separator) + strlen(id_str) +
+                      strlen("[\"") + escaped_len + strlen("\",") + strlen(json_str) + strlen("]");
         packet->data = calloc(1, packet->len + 1);
+        if (packet->data == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to allocate memory for packet data");
+            pool_release_packet(packet);
+            return NULL;
+        }
 
-        sprintf(packet->data, "42[\"%s\",%s]", event_str, json_str);
+        char *write_p = packet->data + sprintf(packet->data, "42%s%s%s[\"", prefix, separator, id_str);
+        write_p += util_json_escape(write_p, event_str, event_len);
+        sprintf(write_p, "\",%s]", json_str);
     }
     return packet;
 }
 
+Packet_t *alloc_message(const char *json_str, const char *event_str)
+{
+    return alloc_event_message(NULL, json_str, event_str, -1);
+}
+
+Packet_t *alloc_ack_message(const char *nsp, const char *json_str, uint32_t ack_id)
+{
+    if (json_str == NULL)
+    {
+        json_str = empty_str;
+    }
+
+    Packet_t *packet = pool_acquire_packet();
+    if (packet == NULL)
+    {
+        return NULL;
+    }
+
+    packet->eio_type = EIO_PACKET_MESSAGE;
+    packet->sio_type = SIO_PACKET_ACK;
+    packet->ack_id = ack_id;
+
+    // 43<id>[json], no json means an ack without arguments
+    const char *prefix = nsp_prefix(nsp);
+    const char *separator = nsp_separator(nsp);
+    packet->len = 2 + strlen(prefix) + strlen(separator) + 10 + strlen("[]") + strlen(json_str);
+    packet->data = calloc(1, packet->len + 1);
+    if (packet->data == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate memory for packet data");
+        pool_release_packet(packet);
+        return NULL;
+    }
+    packet->len = sprintf(packet->data, "43%s%s%lu[%s]", prefix, separator, (unsigned long)ack_id, json_str);
+    return packet;
+}
+
+Packet_t *alloc_namespace_message(const char *nsp, sio_packet_t type, const char *json_str)
+{
+    if (json_str == NULL)
+    {
+        json_str = empty_str;
+    }
+
+    Packet_t *packet = pool_acquire_packet();
+    if (packet == NULL)
+    {
+        return NULL;
+    }
+
+    packet->eio_type = EIO_PACKET_MESSAGE;
+    packet->sio_type = type;
+
+    // 40/nsp,{auth} or 41/nsp,
+    const char *prefix = nsp_prefix(nsp);
+    const char *separator = nsp_separator(nsp);
+    packet->len = 2 + strlen(prefix) + strlen(separator) + strlen(json_str);
+    packet->data = calloc(1, packet->len + 1);
+    if (packet->data == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate memory for packet data");
+        pool_release_packet(packet);
+        return NULL;
+    }
+    sprintf(packet->data, "4%d%s%s%s", type, prefix, separator, json_str);
+    return packet;
+}
+
+Packet_t *alloc_binary_message(const char *nsp, const char *json_str, const char *event_str, size_t attachment_count)
+{
+    static const char placeholder_fmt[] = "{\"_placeholder\":true,\"num\":%u}";
+
+    if (json_str == NULL)
+    {
+        json_str = empty_str;
+    }
+    if (attachment_count > UINT8_MAX)
+    {
+        ESP_LOGE(TAG, "Too many attachments %d", (int)attachment_count);
+        return NULL;
+    }
+
+    Packet_t *packet = pool_acquire_packet();
+    if (packet == NULL)
+    {
+        return NULL;
+    }
+
+    const char *prefix = nsp_prefix(nsp);
+    const char *separator = nsp_separator(nsp);
+
+    // upper bound, the placeholder format grows by at most one digit per character of %u
+    size_t event_len = event_str == NULL ? 0 : strlen(event_str);
+    size_t max_len = strlen("45255-[\"\",") + strlen(prefix) + strlen(separator) + strlen(json_str) + strlen(",]") +
+                     util_json_escape(NULL, event_str, event_len) +
+                     attachment_count * (sizeof(placeholder_fmt) + 2);
+
+    packet->data = calloc(1, max_len + 1);
+    if (packet->data == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate memory for packet data");
+        pool_release_packet(packet);
+        return NULL;
+    }
+
+    packet->eio_type = EIO_PACKET_MESSAGE;
+    packet->sio_type = SIO_PACKET_BINARY_EVENT;
+    packet->attachments_expected = attachment_count;
+
+    char *write_p = packet->data;
+    write_p += sprintf(write_p, "45%u-%s%s[", (unsigned)attachment_count, prefix, separator);
+
+    bool first = true;
+    if (event_str != NULL)
+    {
+        *write_p++ = '"';
+        write_p += util_json_escape(write_p, event_str, event_len);
+        *write_p++ = '"';
+        first = false;
+    }
+    if (json_str[0] != '\0')
+    {
+        write_p += sprintf(write_p, first ? "%s" : ",%s", json_str);
+        first = false;
+    }
+    for (size_t i = 0; i < attachment_count; i++)
+    {
+        if (!first)
+        {
+            *write_p++ = ',';
+        }
+        write_p += sprintf(write_p, placeholder_fmt, (unsigned)i);
+        first = false;
+    }
+    *write_p++ = ']';
+    *write_p = '\0';
+
+    packet->len = write_p - packet->data;
+    return packet;
+}
+
+Packet_t *alloc_base64_attachment(const sio_binary_t *attachment)
+{
+    Packet_t *packet = pool_acquire_packet();
+    if (packet == NULL)
+    {
+        return NULL;
+    }
+
+    packet->len = 1 + util_base64_encoded_len(attachment->len);
+    packet->data = calloc(1, packet->len + 1);
+    if (packet->data == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes for attachment", (int)packet->len);
+        pool_release_packet(packet);
+        return NULL;
+    }
+
+    packet->eio_type = EIO_PACKET_BINARY;
+    packet->sio_type = SIO_PACKET_NONE;
+    packet->data[0] = 'b';
+    util_base64_encode(attachment->data, attachment->len, packet->data + 1);
+    return packet;
+}
+
+Packet_t *alloc_packet_copy(const Packet_t *packet)
+{
+    Packet_t *copy = pool_acquire_packet();
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    copy->eio_type = packet->eio_type;
+    copy->sio_type = packet->sio_type;
+    copy->ack_id = packet->ack_id;
+    copy->len = packet->len;
+    copy->data = calloc(1, packet->len + 1);
+    if (copy->data == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate memory for packet data");
+        pool_release_packet(copy);
+        return NULL;
+    }
+    memcpy(copy->data, packet->data, packet->len);
+
+    if (packet->json_start != NULL)
+    {
+        copy->json_start = copy->data + (packet->json_start - packet->data);
+    }
+    if (packet->nsp != NULL)
+    {
+        copy->nsp = copy->data + (packet->nsp - packet->data);
+        copy->nsp_len = packet->nsp_len;
+    }
+    return copy;
+}
+
 void setEioType(Packet_t *packet, eio_packet_t type)
 {
     packet->eio_type = type;
@@ -170,8 +847,13 @@ void setSioType(Packet_t *packet, sio_packet_t type)
 
 void print_packet(const Packet_t *packet)
 {
+    if (packet->eio_type == EIO_PACKET_BINARY)
+    {
+        ESP_LOGI(TAG, "Packet: %p BINARY len:%d", packet, (int)packet->len);
+        return;
+    }
     ESP_LOGI(TAG, "Packet: %p EIO:%d SIO:%d len:%d  -- %s",
-             packet, packet->eio_type, packet->sio_type, packet->len,
+             packet, packet->eio_type, packet->sio_type, (int)packet->len,
              packet->data);
 }
 
@@ -0,0 +1,287 @@
+#include <internal/sio_pool.h>
+#include <esp_log.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "[sio:pool]";
+
+// All pools are free lists of fixed slots, acquire and release are a push or pop
+// under a spinlock. An empty pool hands out heap memory instead of failing.
+
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool pool_inited = false;
+static sio_pool_stats_t pool_stats = {0};
+
+#if SIO_PACKET_POOL_SIZE > 0
+static Packet_t packet_slots[SIO_PACKET_POOL_SIZE];
+static Packet_t *packet_free_list[SIO_PACKET_POOL_SIZE];
+static size_t packet_free_count = 0;
+#endif
+
+#define BATCH_SLOT_SIZE (sizeof(sio_packet_batch_t) + (SIO_BATCH_POOL_CAPACITY + 1) * sizeof(Packet_t *))
+
+#if SIO_BATCH_POOL_SIZE > 0
+static uint8_t batch_slots[SIO_BATCH_POOL_SIZE][BATCH_SLOT_SIZE] __attribute__((aligned(sizeof(void *))));
+static sio_packet_batch_t *batch_free_list[SIO_BATCH_POOL_SIZE];
+static size_t batch_free_count = 0;
+#endif
+
+#define RX_BUFFER_SLOT_SIZE (sizeof(sio_rx_buffer_t) + SIO_RX_BUFFER_POOL_CAPACITY + 1)
+
+#if SIO_RX_BUFFER_POOL_SIZE > 0
+static uint8_t rx_buffer_slots[SIO_RX_BUFFER_POOL_SIZE][RX_BUFFER_SLOT_SIZE] __attribute__((aligned(sizeof(void *))));
+static sio_rx_buffer_t *rx_buffer_free_list[SIO_RX_BUFFER_POOL_SIZE];
+static size_t rx_buffer_free_count = 0;
+#endif
+
+// call with pool_lock held
+static void pool_init_locked(void)
+{
+    if (pool_inited)
+    {
+        return;
+    }
+#if SIO_PACKET_POOL_SIZE > 0
+    for (size_t i = 0; i < SIO_PACKET_POOL_SIZE; i++)
+    {
+        packet_free_list[i] = &packet_slots[i];
+    }
+    packet_free_count = SIO_PACKET_POOL_SIZE;
+#endif
+#if SIO_BATCH_POOL_SIZE > 0
+    for (size_t i = 0; i < SIO_BATCH_POOL_SIZE; i++)
+    {
+        batch_free_list[i] = (sio_packet_batch_t *)batch_slots[i];
+    }
+    batch_free_count = SIO_BATCH_POOL_SIZE;
+#endif
+#if SIO_RX_BUFFER_POOL_SIZE > 0
+    for (size_t i = 0; i < SIO_RX_BUFFER_POOL_SIZE; i++)
+    {
+        rx_buffer_free_list[i] = (sio_rx_buffer_t *)rx_buffer_slots[i];
+    }
+    rx_buffer_free_count = SIO_RX_BUFFER_POOL_SIZE;
+#endif
+    pool_inited = true;
+}
+
+Packet_t *pool_acquire_packet(void)
+{
+    Packet_t *packet = NULL;
+
+    portENTER_CRITICAL(&pool_lock);
+    pool_init_locked();
+#if SIO_PACKET_POOL_SIZE > 0
+    if (packet_free_count > 0)
+    {
+        packet = packet_free_list[--packet_free_count];
+    }
+#endif
+    if (packet == NULL)
+    {
+        pool_stats.packet_heap_fallbacks++;
+    }
+    pool_stats.packets_in_use++;
+    if (pool_stats.packets_in_use > pool_stats.packets_peak)
+    {
+        pool_stats.packets_peak = pool_stats.packets_in_use;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (packet == NULL)
+    {
+        packet = (Packet_t *)malloc(sizeof(Packet_t));
+        if (packet == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to allocate packet");
+            portENTER_CRITICAL(&pool_lock);
+            pool_stats.packets_in_use--;
+            portEXIT_CRITICAL(&pool_lock);
+            return NULL;
+        }
+    }
+
+    memset(packet, 0, sizeof(Packet_t));
+    packet->ack_id = -1; // 0 is a valid id
+    return packet;
+}
+
+void pool_release_packet(Packet_t *packet)
+{
+    if (packet == NULL)
+    {
+        return;
+    }
+
+    bool pooled = false;
+#if SIO_PACKET_POOL_SIZE > 0
+    pooled = packet >= &packet_slots[0] && packet < &packet_slots[SIO_PACKET_POOL_SIZE];
+#endif
+
+    portENTER_CRITICAL(&pool_lock);
+#if SIO_PACKET_POOL_SIZE > 0
+    if (pooled)
+    {
+        packet_free_list[packet_free_count++] = packet;
+    }
+#endif
+    pool_stats.packets_in_use--;
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (!pooled)
+    {
+        free(packet);
+    }
+}
+
+sio_packet_batch_t *pool_acquire_batch(size_t capacity)
+{
+    sio_packet_batch_t *batch = NULL;
+
+    portENTER_CRITICAL(&pool_lock);
+    pool_init_locked();
+#if SIO_BATCH_POOL_SIZE > 0
+    if (capacity <= SIO_BATCH_POOL_CAPACITY && batch_free_count > 0)
+    {
+        batch = batch_free_list[--batch_free_count];
+    }
+#endif
+    if (batch == NULL)
+    {
+        pool_stats.batch_heap_fallbacks++;
+    }
+    pool_stats.batches_in_use++;
+    if (pool_stats.batches_in_use > pool_stats.batches_peak)
+    {
+        pool_stats.batches_peak = pool_stats.batches_in_use;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (batch != NULL)
+    {
+        batch->pooled = true;
+        batch->capacity = SIO_BATCH_POOL_CAPACITY;
+    }
+    else
+    {
+        batch = (sio_packet_batch_t *)malloc(sizeof(sio_packet_batch_t) + (capacity + 1) * sizeof(Packet_t *));
+        if (batch == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to allocate batch of %d", (int)capacity);
+            portENTER_CRITICAL(&pool_lock);
+            pool_stats.batches_in_use--;
+            portEXIT_CRITICAL(&pool_lock);
+            return NULL;
+        }
+        batch->pooled = false;
+        batch->capacity = capacity;
+    }
+
+    batch->count = 0;
+    batch->packets[0] = NULL;
+    return batch;
+}
+
+void pool_release_batch(sio_packet_batch_t *batch)
+{
+    if (batch == NULL)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&pool_lock);
+#if SIO_BATCH_POOL_SIZE > 0
+    if (batch->pooled)
+    {
+        batch_free_list[batch_free_count++] = batch;
+    }
+#endif
+    pool_stats.batches_in_use--;
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (!batch->pooled)
+    {
+        free(batch);
+    }
+}
+
+sio_rx_buffer_t *pool_acquire_rx_buffer(size_t capacity)
+{
+    sio_rx_buffer_t *buffer = NULL;
+
+    portENTER_CRITICAL(&pool_lock);
+    pool_init_locked();
+#if SIO_RX_BUFFER_POOL_SIZE > 0
+    if (capacity <= SIO_RX_BUFFER_POOL_CAPACITY && rx_buffer_free_count > 0)
+    {
+        buffer = rx_buffer_free_list[--rx_buffer_free_count];
+    }
+#endif
+    if (buffer == NULL)
+    {
+        pool_stats.rx_buffer_heap_fallbacks++;
+    }
+    pool_stats.rx_buffers_in_use++;
+    if (pool_stats.rx_buffers_in_use > pool_stats.rx_buffers_peak)
+    {
+        pool_stats.rx_buffers_peak = pool_stats.rx_buffers_in_use;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (buffer != NULL)
+    {
+        buffer->pooled = true;
+        buffer->capacity = SIO_RX_BUFFER_POOL_CAPACITY;
+    }
+    else
+    {
+        // +1 so the content can always be terminated
+        buffer = (sio_rx_buffer_t *)malloc(sizeof(sio_rx_buffer_t) + capacity + 1);
+        if (buffer == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to allocate receive buffer of %d bytes", (int)capacity);
+            portENTER_CRITICAL(&pool_lock);
+            pool_stats.rx_buffers_in_use--;
+            portEXIT_CRITICAL(&pool_lock);
+            return NULL;
+        }
+        buffer->pooled = false;
+        buffer->capacity = capacity;
+    }
+
+    buffer->refcount = 1;
+    buffer->len = 0;
+    buffer->data[0] = '\0';
+    return buffer;
+}
+
+void pool_release_rx_buffer(sio_rx_buffer_t *buffer)
+{
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&pool_lock);
+#if SIO_RX_BUFFER_POOL_SIZE > 0
+    if (buffer->pooled)
+    {
+        rx_buffer_free_list[rx_buffer_free_count++] = buffer;
+    }
+#endif
+    pool_stats.rx_buffers_in_use--;
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (!buffer->pooled)
+    {
+        free(buffer);
+    }
+}
+
+void sio_pool_get_stats(sio_pool_stats_t *stats)
+{
+    portENTER_CRITICAL(&pool_lock);
+    *stats = pool_stats;
+    portEXIT_CRITICAL(&pool_lock);
+}
@@ -0,0 +1,172 @@
+#include <internal/sio_registry.h>
+#include <esp_log.h>
+#include <stdlib.h>
+
+static const char *TAG = "[sio:registry]";
+
+#define CHUNK_COUNT ((SIO_REGISTRY_MAX_CLIENTS + SIO_REGISTRY_CHUNK_SIZE - 1) / SIO_REGISTRY_CHUNK_SIZE)
+#define INDEX_MASK ((1 << SIO_REGISTRY_INDEX_BITS) - 1)
+#define GENERATION_MASK (0x7FFFFFFF >> SIO_REGISTRY_INDEX_BITS) /* handles stay positive */
+
+#define SLOT_FREE 0
+#define SLOT_CLAIMED 1 /* taken, client not published yet */
+#define SLOT_LIVE 3
+
+_Static_assert(SIO_REGISTRY_MAX_CLIENTS <= INDEX_MASK + 1, "SIO_MAX_PARALLEL_SOCKETS does not fit into the handle index");
+
+// tag is generation << 2 | state, every change of the slot changes it
+typedef struct
+{
+    uint32_t tag;
+    struct sio_client_t *client;
+} registry_slot_t;
+
+static registry_slot_t *chunks[CHUNK_COUNT];
+
+static uint32_t tag_generation(uint32_t tag)
+{
+    return tag >> 2;
+}
+
+static uint32_t tag_state(uint32_t tag)
+{
+    return tag & 3;
+}
+
+static uint32_t make_tag(uint32_t generation, uint32_t state)
+{
+    return generation << 2 | state;
+}
+
+// generation 0 is never handed out, so small integers are never valid handles
+static uint32_t next_generation(uint32_t generation)
+{
+    generation = (generation + 1) & GENERATION_MASK;
+    return generation == 0 ? 1 : generation;
+}
+
+static registry_slot_t *chunk_get(size_t chunk_index, bool add)
+{
+    registry_slot_t *chunk = __atomic_load_n(&chunks[chunk_index], __ATOMIC_ACQUIRE);
+    if (chunk != NULL || !add)
+    {
+        return chunk;
+    }
+
+    registry_slot_t *fresh = calloc(SIO_REGISTRY_CHUNK_SIZE, sizeof(registry_slot_t));
+    if (fresh == NULL)
+    {
+        return NULL;
+    }
+    if (__atomic_compare_exchange_n(&chunks[chunk_index], &chunk, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        return fresh;
+    }
+    // another init added it first
+    free(fresh);
+    return chunk;
+}
+
+static registry_slot_t *slot_of(sio_client_id_t id)
+{
+    if (id < 0)
+    {
+        return NULL;
+    }
+    uint32_t index = (uint32_t)id & INDEX_MASK;
+    if (index >= SIO_REGISTRY_MAX_CLIENTS)
+    {
+        return NULL;
+    }
+    registry_slot_t *chunk = chunk_get(index / SIO_REGISTRY_CHUNK_SIZE, false);
+    return chunk == NULL ? NULL : &chunk[index % SIO_REGISTRY_CHUNK_SIZE];
+}
+
+esp_err_t registry_reserve(sio_client_id_t *id)
+{
+    for (uint32_t index = 0; index < SIO_REGISTRY_MAX_CLIENTS; index++)
+    {
+        registry_slot_t *chunk = chunk_get(index / SIO_REGISTRY_CHUNK_SIZE, true);
+        if (chunk == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to allocate client slots");
+            return ESP_ERR_NO_MEM;
+        }
+        registry_slot_t *slot = &chunk[index % SIO_REGISTRY_CHUNK_SIZE];
+
+        uint32_t tag = __atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE);
+        if (tag_state(tag) != SLOT_FREE)
+        {
+            continue;
+        }
+        uint32_t generation = next_generation(tag_generation(tag));
+        if (!__atomic_compare_exchange_n(&slot->tag, &tag, make_tag(generation, SLOT_CLAIMED), false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            continue; // taken by a concurrent init
+        }
+
+        *id = (sio_client_id_t)(generation << SIO_REGISTRY_INDEX_BITS | index);
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "No slot available, destroy a client or increase SIO_MAX_PARALLEL_SOCKETS");
+    return ESP_ERR_NO_MEM;
+}
+
+void registry_publish(sio_client_id_t id, struct sio_client_t *client)
+{
+    registry_slot_t *slot = slot_of(id);
+    if (slot == NULL)
+    {
+        return;
+    }
+    uint32_t generation = (uint32_t)id >> SIO_REGISTRY_INDEX_BITS;
+    __atomic_store_n(&slot->client, client, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->tag, make_tag(generation, SLOT_LIVE), __ATOMIC_RELEASE);
+}
+
+struct sio_client_t *registry_get(sio_client_id_t id)
+{
+    registry_slot_t *slot = slot_of(id);
+    if (slot == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t expected = make_tag((uint32_t)id >> SIO_REGISTRY_INDEX_BITS, SLOT_LIVE);
+    if (__atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE) != expected)
+    {
+        return NULL;
+    }
+    struct sio_client_t *client = __atomic_load_n(&slot->client, __ATOMIC_ACQUIRE);
+    // the slot could have been removed and reused while the pointer was read
+    if (__atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE) != expected)
+    {
+        return NULL;
+    }
+    return client;
+}
+
+bool registry_remove(sio_client_id_t id)
+{
+    registry_slot_t *slot = slot_of(id);
+    if (slot == NULL)
+    {
+        return false;
+    }
+
+    // the pointer stays behind, the tag alone tells lookups the slot is gone
+    uint32_t generation = (uint32_t)id >> SIO_REGISTRY_INDEX_BITS;
+    uint32_t states[] = {SLOT_LIVE, SLOT_CLAIMED};
+    for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++)
+    {
+        uint32_t expected = make_tag(generation, states[i]);
+        if (__atomic_compare_exchange_n(&slot->tag, &expected, make_tag(generation, SLOT_FREE), false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -7,143 +7,340 @@
 #include <sio_types.h>
 #include <utility.h>
 #include <esp_types.h>
+#include <esp_random.h>
 
 static const char *TAG = "[SIO_TASK:polling]";
 
-void sio_polling_task(void *pvParameters)
+sio_poll_result_t polling_handle_response(sio_client_t *client, esp_err_t err, int status, uint8_t *failed_polls)
 {
-    sio_client_id_t *clientId = (sio_client_id_t *)pvParameters;
+    // only the polling side uses its receive context
+    PacketPointerArray_t response_packets = client->polling_rx.packets;
+    client->polling_rx.packets = NULL;
+    sio_poll_result_t result = SIO_POLL_NEXT;
 
-    static PacketPointerArray_t response_packets;
-    ESP_LOGI(TAG, "Started polling task");
-    while (true)
+    metrics_poll_end(&client->metrics, err == ESP_OK && status == 200);
+    if (err != ESP_OK)
     {
-        response_packets = NULL;
-        sio_client_t *client = sio_client_get_and_lock(*clientId);
-
-        if (!client->polling_client_running)
+        // half a response is no response, a binary event waiting for attachments stays
+        rx_parser_reset(&client->polling_rx.parser);
+    }
+    if (err == ESP_ERR_TIMEOUT)
+    {
+        // the GET waited out pingInterval + pingTimeout without even a ping, the server's
+        // own rules call the session dead and another try would wait another window
+        ESP_LOGE(TAG, "Polling GET timed out, no ping within the heartbeat window");
+        result = SIO_POLL_SESSION_LOST;
+        goto cleanup;
+    }
+    if (err != ESP_OK || status >= 500)
+    {
+        // the server keeps the session for a ping window, a flaky GET does not end it
+        if (*failed_polls < SIO_POLL_RETRIES)
         {
-            ESP_LOGI(TAG, "Stopping polling task");
-            unlockClient(client);
-            break;
+            (*failed_polls)++;
+            ESP_LOGW(TAG, "Polling GET failed (%s, status %d), retry %d", esp_err_to_name(err), status, *failed_polls);
+            result = SIO_POLL_RETRY;
+            goto cleanup;
         }
+        ESP_LOGE(TAG, "HTTP POLLING GET request failed: %s", esp_err_to_name(err));
+        result = SIO_POLL_SESSION_LOST;
+        goto cleanup;
+    }
+    *failed_polls = 0;
+
+    if (status != 200)
+    {
+        ESP_LOGW(TAG, "Polling HTTP request failed with status code %d", status);
+        result = SIO_POLL_SESSION_LOST;
+        goto cleanup;
+    }
+    metrics_count_in(&client->metrics, 0, get_array_size(response_packets) + client->polling_rx.records_dropped);
 
+    // chunked responses carry no content length, judge by what was parsed
+    if (response_packets == NULL && client->polling_rx.records_dropped > 0)
+    {
+        goto cleanup; // only events nobody listens to
+    }
+    if (response_packets == NULL)
+    {
+        ESP_LOGW(TAG, "Polling HTTP request failed: No content returned.");
+        result = SIO_POLL_SESSION_LOST;
+        goto cleanup;
+    }
+
+    // binary events can span several responses, they stay with the context until complete
+    packet_arr_collect_attachments(&response_packets, &client->polling_rx.binary_pending);
+    if (response_packets != NULL)
+    {
+        // acks go to their callbacks instead of the event loop
+        ack_table_take_acks(&client->acks, &response_packets);
+    }
+    if (response_packets == NULL)
+    {
+        goto cleanup;
+    }
+
+    // go through all messages and handle all non message related messages
+
+    int packet_count = get_array_size(response_packets);
+    for (int i = 0; i < packet_count; i++)
+    {
+
+        Packet_t *response_packet = response_packets[i];
+
+        switch (response_packet->eio_type)
         {
-            char *url = alloc_polling_get_url(client);
+        case EIO_PACKET_PING:
+            // the pong goes out with the next post, the next GET starts right away
+            ESP_LOGD(TAG, "Received ping packet, sending pong back");
+            heartbeat_ping(&client->heartbeat);
+            metrics_ping(&client->metrics);
 
-            if (client->polling_client == NULL)
-            {
-                esp_http_client_config_t config = {
-                    .url = url,
-                    .event_handler = http_client_polling_get_handler,
-                    .user_data = &response_packets,
-                    .disable_auto_redirect = true,
-                    .timeout_ms = client->server_ping_timeout_ms * 2 * 1000,
-
-                };
-                client->polling_client = esp_http_client_init(&config);
-            }
-            else
+            if (sio_client_send_pong(client) != ESP_OK)
             {
-                esp_http_client_set_url(client->polling_client, url);
+                ESP_LOGE(TAG, "Failed to send PONG packet");
             }
-            ESP_LOGD(TAG, "Polling URL: %s", url);
-            freeIfNotNull(&url);
+            break;
+
+        case EIO_PACKET_CLOSE:
+            ESP_LOGD(TAG, "Received close packet");
+            result = SIO_POLL_SESSION_LOST;
+            goto cleanup;
+            break;
+
+        case EIO_PACKET_MESSAGE:
+            // do nothing, will get forwarded
+            ESP_LOGD(TAG, "EIO_PACKET_MESSAGE");
+            ESP_LOGD(TAG, "response_packet->data=%s", response_packet->data);
+            break;
+
+        default:
+            ESP_LOGW(TAG, "unhandled packet type %d", response_packet->eio_type);
+            break;
         }
+    }
+
+    if (packet_count == 1 && response_packets[0]->eio_type != EIO_PACKET_MESSAGE)
+    {
+        ESP_LOGD(TAG, "Single packet no messages");
+        goto cleanup;
+    }
+
+    ESP_LOGD(TAG, "Poller Received %d packets", packet_count);
+    namespace_dispatch_packets(&client->dispatch, &client->namespaces, &client->handlers, response_packets);
+    response_packets = NULL; // belongs to the event receivers now
+
+cleanup:
+    if (response_packets != NULL)
+    {
+        // nothing in the response was handed out
+        free_packet_arr(&response_packets);
+    }
+    return result;
+}
+
+void polling_session_end(sio_client_t *client, sio_polling_end_t how)
+{
+    if (how != SIO_POLLING_UPGRADED)
+    {
+        // the session is gone, queued packets stay for the next session
+        lockClient(client);
+        sio_client_state_clear(client, SIO_STATE_POSTING);
+        heartbeat_stop(&client->heartbeat);
+        namespace_table_session_lost(&client->namespaces);
         unlockClient(client);
-        esp_err_t err = esp_http_client_perform(client->polling_client);
 
-        if (err != ESP_OK)
+        dispatch_queue_post(&client->dispatch, SIO_EVENT_DISCONNECTED, 0, NULL);
+    }
+
+    // the session lives on after an upgrade, only the polling side is torn down
+    lockClient(client);
+
+    sio_client_state_clear(client, SIO_STATE_POLLING | SIO_STATE_IO_SCHEDULED);
+    // the polling task of the session is done with the client, the shared one never had one
+    http_conn_close(&client->polling_conn);
+    client->polling_task = NULL;
+    http_rx_context_reset(&client->polling_rx);
+
+    unlockClient(client);
+
+    if (how == SIO_POLLING_LOST)
+    {
+        sio_client_schedule_reconnect(client);
+    }
+}
+
+void sio_polling_task(void *pvParameters)
+{
+    sio_client_id_t *clientId = (sio_client_id_t *)pvParameters;
+
+    uint8_t failed_polls = 0;
+    sio_polling_end_t how = SIO_POLLING_LOST;
+    ESP_LOGI(TAG, "Started polling task");
+
+    // The handshake already finished on polling, try to move the session
+    // over to a websocket before settling into the polling loop.
+    sio_client_t *client = sio_client_get_and_lock(*clientId);
+    bool try_upgrade = client->upgrade_transport && client->server_upgrade_websocket;
+    unlockClient(client);
+
+    if (try_upgrade && sio_client_upgrade_transport(client) == ESP_OK)
+    {
+        how = SIO_POLLING_UPGRADED;
+        goto end;
+    }
+
+    // the server answers within pingInterval with at least a ping, a GET that outlives
+    // interval + timeout means the link is dead
+    uint32_t window_ms = client->server_ping_interval_ms + client->server_ping_timeout_ms;
+
+    // Like the posting connection the request head is built once for the session, every GET
+    // only moves the cache buster on in place and nothing touches the heap.
+    const char *url = sio_client_session_url(client);
+    if (url == NULL || http_conn_open(&client->polling_conn, url, client->session_url_token, false,
+                                      &client->server_addr, client->server_addr_len) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to set up the polling connection");
+        goto end;
+    }
+    ESP_LOGD(TAG, "Polling URL: %s", url);
+
+    // the loop never takes the client lock, the session url belongs to this task while it runs
+    while (true)
+    {
+        if (!(sio_client_state(client) & SIO_STATE_POLLING))
         {
-            // todo: emit DISCONNECTED event on any fail
-            int r = esp_http_client_get_errno(client->polling_client);
-            ESP_LOGE(TAG, "HTTP POLLING GET request failed: %s %i", esp_err_to_name(err), r);
+            ESP_LOGI(TAG, "Stopping polling task");
+            how = SIO_POLLING_STOPPED;
             goto end;
         }
 
-        int http_response_status_code = esp_http_client_get_status_code(client->polling_client);
-        int http_response_content_length = esp_http_client_get_content_length(client->polling_client);
+        metrics_poll_begin(&client->metrics);
+        esp_err_t err = http_conn_perform(&client->polling_conn, NULL, 0, window_ms);
 
-        if (http_response_status_code != 200)
+        int http_response_status_code = err == ESP_OK ? client->polling_conn.status : 0;
+        sio_poll_result_t result = polling_handle_response(client, err, http_response_status_code, &failed_polls);
+        if (result == SIO_POLL_RETRY)
         {
-            ESP_LOGW(TAG, "Polling HTTP request failed with status code %d", http_response_status_code);
-            goto end;
+            vTaskDelay(pdMS_TO_TICKS(SIO_POLL_RETRY_DELAY_MS * failed_polls));
         }
-        if (http_response_content_length <= 0)
+        else if (result == SIO_POLL_SESSION_LOST)
         {
-            ESP_LOGW(TAG, "Polling HTTP request failed: No content returned.");
-            goto end;
+            break;
         }
+    }
 
-        // go through all messages and handle all non message related messages
+end:
+    polling_session_end(client, how);
+    vTaskDelete(NULL);
+}
 
-        for (int i = 0; i < get_array_size(response_packets); i++)
-        {
+// socket.io style backoff: doubles per attempt up to max_ms, then spread by the jitter
+static uint32_t reconnect_delay_ms(uint32_t attempt, uint32_t base_ms, uint32_t max_ms)
+{
+    uint64_t delay = base_ms;
+    for (uint32_t i = 0; i < attempt && delay < max_ms; i++)
+    {
+        delay *= 2;
+    }
+    if (delay > max_ms)
+    {
+        delay = max_ms;
+    }
 
-            Packet_t *response_packet = response_packets[0];
+    uint32_t spread = delay * SIO_RECONNECT_JITTER_PERCENT / 100;
+    if (spread > 0)
+    {
+        delay = delay - spread + esp_random() % (2 * spread + 1);
+    }
+    return delay;
+}
 
-            switch (response_packet->eio_type)
-            {
-            case EIO_PACKET_PING:
-                // send pong back
-
-                ESP_LOGD(TAG, "Received ping packet, sending pong back");
-
-                Packet_t *p = (Packet_t *)calloc(1, sizeof(Packet_t));
-                p->data = calloc(1, 2);
-                p->len = 2;
-                setEioType(p, EIO_PACKET_PONG);
-                esp_err_t ret = sio_send_packet(client->client_id, p);
-                if (ret != ESP_OK)
-                {
-                    ESP_LOGE(TAG, "Failed to send PONG packet");
-                }
-                free_packet(&p);
-                break;
-
-            case EIO_PACKET_CLOSE:
-                ESP_LOGD(TAG, "Received close packet");
-                goto end;
-                break;
-
-            case EIO_PACKET_MESSAGE:
-                // do nothing, will get forwarded
-                ESP_LOGD(TAG, "EIO_PACKET_MESSAGE");
-                ESP_LOGD(TAG, "response_packet->data=%s", response_packet->data);
-                break;
-
-            default:
-                ESP_LOGW(TAG, "unhandled packet type %d", response_packet->eio_type);
-                break;
-            }
-        }
+void sio_reconnect_task(void *pvParameters)
+{
+    sio_client_id_t *clientId = (sio_client_id_t *)pvParameters;
 
-        if (get_array_size(response_packets) == 1 && response_packets[0]->eio_type != EIO_PACKET_MESSAGE)
+    sio_client_t *client = sio_client_get_and_lock(*clientId);
+    uint16_t max_attempts = client->reconnect_max_attempts;
+    uint32_t base_ms = client->reconnect_delay_ms;
+    uint32_t max_ms = client->reconnect_delay_max_ms;
+    unlockClient(client);
+
+    ESP_LOGI(TAG, "Started reconnect task");
+    esp_err_t err = ESP_FAIL;
+    for (uint32_t attempt = 0; max_attempts == 0 || attempt < max_attempts; attempt++)
+    {
+        uint32_t delay_ms = reconnect_delay_ms(attempt, base_ms, max_ms);
+        ESP_LOGI(TAG, "Reconnecting in %u ms, attempt %u", (unsigned)delay_ms, (unsigned)attempt + 1);
+
+        // sio_client_close wakes us up early
+        if (xSemaphoreTake(client->reconnect_wake, pdMS_TO_TICKS(delay_ms)) == pdTRUE &&
+            __atomic_load_n(&client->reconnect_cancelled, __ATOMIC_SEQ_CST))
         {
-            ESP_LOGD(TAG, "Single packet no messages");
-            continue;
+            err = ESP_ERR_INVALID_STATE;
+            break;
         }
 
-        ESP_LOGI(TAG, "Poller Received %d packets", get_array_size(response_packets));
-        sio_event_data_t event_data = {
-            .client_id = *clientId,
-            .packets_pointer = response_packets,
-            .len = get_array_size(response_packets)};
+        dispatch_queue_post(&client->dispatch, SIO_EVENT_RECONNECTING, 0, NULL);
+        metrics_reconnect(&client->metrics);
+        err = sio_client_reconnect(client);
+        if (err == ESP_OK || err == ESP_ERR_INVALID_STATE)
+        {
+            break;
+        }
+    }
 
-        esp_event_post(SIO_EVENT, SIO_EVENT_RECEIVED_MESSAGE, &event_data, sizeof(sio_event_data_t), pdMS_TO_TICKS(50));
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(TAG, "Giving up after %u reconnect attempts", (unsigned)max_attempts);
+        dispatch_queue_post(&client->dispatch, SIO_EVENT_RECONNECT_FAILED, 0, NULL);
     }
-end: ;
-    sio_event_data_t event_data = {.client_id = *clientId, .packets_pointer = NULL, .len = 0};
 
-    esp_event_post(SIO_EVENT, SIO_EVENT_DISCONNECTED, &event_data, sizeof(sio_event_data_t), pdMS_TO_TICKS(50));
+    // sio_client_close may be waiting for this
+    sio_client_state_clear(client, SIO_STATE_RECONNECTING);
+    xSemaphoreGive(client->reconnect_done);
 
-    sio_client_t *client = sio_client_get_and_lock(*clientId);
+    vTaskDelete(NULL);
+}
 
-    client->polling_client_running = false;
-    esp_http_client_cleanup(client->polling_client);
-    client->polling_client = NULL;
+void sio_posting_task(void *pvParameters)
+{
+    sio_client_id_t *clientId = (sio_client_id_t *)pvParameters;
 
+    // the queue lives as long as the client
+    sio_client_t *client = sio_client_get_and_lock(*clientId);
+    QueueHandle_t send_queue = client->send_queue;
     unlockClient(client);
 
+    ESP_LOGI(TAG, "Started posting task");
+    while (true)
+    {
+        Packet_t *first = NULL;
+        if (xQueuePeek(send_queue, &first, pdMS_TO_TICKS(1000)) == pdTRUE)
+        {
+            // give the sender a moment to add more, they all go out in one request
+            vTaskDelay(pdMS_TO_TICKS(SIO_SEND_LINGER_MS));
+        }
+
+        // under the client lock so a handshake either sees the task gone or keeps it going
+        lockClient(client);
+        if (!(sio_client_state(client) & SIO_STATE_POSTING))
+        {
+            ESP_LOGI(TAG, "Stopping posting task");
+            client->posting_task = NULL;
+            unlockClient(client);
+            break;
+        }
+        unlockClient(client);
+
+        // posts only hold the send lock, emitters keep queueing meanwhile
+        if (sio_client_transport(client) == SIO_TRANSPORT_POLLING)
+        {
+            sio_client_flush_outbound(client);
+            // emits from while the session was down, once namespace 0 is back
+            sio_client_replay_journal(client);
+        }
+    }
+
     vTaskDelete(NULL);
-}
\ No newline at end of file
+}
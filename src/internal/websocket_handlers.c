@@ -0,0 +1,296 @@
+#include <internal/websocket_handlers.h>
+#include <internal/sio_packet.h>
+#include <internal/sio_io_scheduler.h>
+#include <sio_client.h>
+#include <sio_types.h>
+#include <utility.h>
+#include <esp_log.h>
+
+static const char *TAG = "[sio:websocket_handlers]";
+
+#define WS_OPCODE_TEXT 0x01
+#define WS_OPCODE_BINARY 0x02
+
+static void send_websocket_packet(sio_client_t *client, esp_websocket_client_handle_t ws, const Packet_t *packet)
+{
+    int sent = esp_websocket_client_send_text(ws, packet->data, packet->len, pdMS_TO_TICKS(SIO_WEBSOCKET_SEND_TIMEOUT_MS));
+    if (sent < 0)
+    {
+        ESP_LOGE(TAG, "Failed to send packet %s", packet->data);
+        return;
+    }
+    metrics_count_out(&client->metrics, packet->len, 1);
+}
+
+static void websocket_connection_lost(sio_client_t *client)
+{
+    sio_websocket_state_t previous_state = client->websocket_state;
+    client->websocket_state = SIO_WEBSOCKET_STATE_CLOSED;
+
+    rx_buffer_release(&client->websocket_recv_buffer);
+    if (client->websocket_binary_pending != NULL)
+    {
+        free_packet(&client->websocket_binary_pending);
+    }
+
+    if (previous_state == SIO_WEBSOCKET_STATE_HANDSHAKE || previous_state == SIO_WEBSOCKET_STATE_PROBE)
+    {
+        // wake up the handshake or upgrade, it will see the state and fail
+        xSemaphoreGive(client->websocket_handshake_done);
+        io_scheduler_wake();
+        return;
+    }
+
+    websocket_session_dead(client);
+}
+
+void websocket_session_dead(sio_client_t *client)
+{
+    // the handler and the heartbeat can both get here, only one of them ends the session
+    if (sio_client_state_clear(client, SIO_STATE_WEBSOCKET) & SIO_STATE_WEBSOCKET)
+    {
+        heartbeat_stop(&client->heartbeat);
+        namespace_table_session_lost(&client->namespaces);
+        dispatch_queue_post(&client->dispatch, SIO_EVENT_DISCONNECTED, 0, NULL);
+        sio_client_schedule_reconnect(client);
+    }
+}
+
+typedef struct
+{
+    sio_client_t *client;
+    esp_websocket_client_handle_t ws;
+} journal_send_t;
+
+static esp_err_t send_journal_record(const char *records, size_t len, size_t count, void *arg)
+{
+    journal_send_t *send = (journal_send_t *)arg;
+    int sent = esp_websocket_client_send_text(send->ws, records, len, pdMS_TO_TICKS(SIO_WEBSOCKET_SEND_TIMEOUT_MS));
+    if (sent < 0)
+    {
+        return ESP_FAIL;
+    }
+    metrics_count_out(&send->client->metrics, len, count);
+    return ESP_OK;
+}
+
+esp_err_t websocket_replay_journal(sio_client_t *client, esp_websocket_client_handle_t ws, TickType_t wait)
+{
+    if (!client->journal_enabled || !(sio_client_state(client) & SIO_STATE_WEBSOCKET) ||
+        namespace_table_get_state(&client->namespaces, 0) != SIO_NAMESPACE_CONNECTED ||
+        journal_is_empty(&client->journal))
+    {
+        return ESP_OK;
+    }
+
+    // a sender holding the send lock replays after its own frame
+    if (xSemaphoreTake(client->send_lock, wait) != pdTRUE)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    // batches would need the polling separator, a frame carries exactly one packet
+    journal_send_t send = {.client = client, .ws = ws};
+    esp_err_t err = journal_replay(&client->journal, 0, wait, send_journal_record, &send);
+    xSemaphoreGive(client->send_lock);
+    if (err != ESP_OK && err != ESP_ERR_TIMEOUT)
+    {
+        ESP_LOGW(TAG, "Journal replay stopped, trying again later: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+// takes ownership of the buffer
+static void handle_websocket_message(sio_client_t *client, esp_websocket_client_handle_t ws, sio_rx_buffer_t *buffer, bool binary)
+{
+    // bytes are counted as the frame parts come in
+    metrics_count_in(&client->metrics, 0, 1);
+
+    if (!binary && !event_handler_accept_record(buffer->data, buffer->len, client))
+    {
+        // event nobody listens to
+        rx_buffer_release(&buffer);
+        return;
+    }
+
+    // a frame holds exactly one packet, it still comes out as a view like on polling
+    PacketPointerArray_t packets = binary ? parse_binary_buffer(buffer) : parse_packet_buffer(buffer);
+    if (packets == NULL)
+    {
+        return;
+    }
+    Packet_t *packet = packets[0];
+
+    if (client->websocket_state == SIO_WEBSOCKET_STATE_PROBE)
+    {
+        // only the probe answer is expected while the session still lives on polling
+        if (packet->eio_type == EIO_PACKET_PONG && packet->len == 6 && strncmp(packet->data, "3probe", 6) == 0)
+        {
+            client->websocket_state = SIO_WEBSOCKET_STATE_UPGRADE;
+        }
+        else
+        {
+            ESP_LOGW(TAG, "Unexpected packet during probe: %s", packet->data);
+            client->websocket_state = SIO_WEBSOCKET_STATE_CLOSED;
+        }
+        xSemaphoreGive(client->websocket_handshake_done);
+        // the shared I/O task probes without waiting on the semaphore
+        io_scheduler_wake();
+        free_packet_arr(&packets);
+        return;
+    }
+
+    // binary events wait for their attachment frames, they come out with the last one
+    packet_arr_collect_attachments(&packets, &client->websocket_binary_pending);
+    if (packets != NULL)
+    {
+        // acks go to their callbacks instead of the event loop
+        ack_table_take_acks(&client->acks, &packets);
+    }
+    if (packets == NULL)
+    {
+        return;
+    }
+    packet = packets[0];
+
+    switch (packet->eio_type)
+    {
+    case EIO_PACKET_OPEN:
+        if (client->websocket_state != SIO_WEBSOCKET_STATE_HANDSHAKE)
+        {
+            ESP_LOGW(TAG, "Open packet outside of handshake, ignoring");
+            break;
+        }
+
+        if (sio_client_apply_open_packet(client, packet) != ESP_OK)
+        {
+            xSemaphoreGive(client->websocket_handshake_done);
+            break;
+        }
+
+        Packet_t *connect_packet = namespace_table_alloc_connect(&client->namespaces, 0, NULL);
+        namespace_table_set_state(&client->namespaces, 0, SIO_NAMESPACE_CONNECTING);
+        send_websocket_packet(client, ws, connect_packet);
+        free_packet(&connect_packet);
+
+        client->websocket_state = SIO_WEBSOCKET_STATE_OPEN;
+        xSemaphoreGive(client->websocket_handshake_done);
+        break;
+
+    case EIO_PACKET_PING:
+        ESP_LOGD(TAG, "Received ping packet, sending pong back");
+        heartbeat_ping(&client->heartbeat);
+        metrics_ping(&client->metrics);
+
+        if (sio_client_send_pong(client) != ESP_OK)
+        {
+            // we hear the server but it does not hear us
+            ESP_LOGE(TAG, "Failed to send pong, connection is half-open");
+            websocket_session_dead(client);
+        }
+        break;
+
+    case EIO_PACKET_CLOSE:
+        ESP_LOGD(TAG, "Received close packet");
+        websocket_connection_lost(client);
+        break;
+
+    case EIO_PACKET_MESSAGE:
+        // the array and the packet now belong to the event receivers
+        namespace_dispatch_packets(&client->dispatch, &client->namespaces, &client->handlers, packets);
+
+        // after a reconnect this is where namespace 0 comes back. Never wait for the journal here,
+        // whoever holds it may be sending and waiting for this very task.
+        websocket_replay_journal(client, ws, 0);
+        return;
+
+    default:
+        ESP_LOGW(TAG, "unhandled packet type %d", packet->eio_type);
+        break;
+    }
+
+    free_packet_arr(&packets);
+}
+
+void websocket_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    // Runs inside the websocket client task, never take the client lock in here:
+    // a sender holding it might be waiting for this very task to release the socket.
+    sio_client_t *client = (sio_client_t *)handler_args;
+    esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)event_data;
+
+    switch (event_id)
+    {
+    case WEBSOCKET_EVENT_CONNECTED:
+        ESP_LOGD(TAG, "WEBSOCKET_EVENT_CONNECTED");
+        if (client->websocket_state == SIO_WEBSOCKET_STATE_PROBE)
+        {
+            int sent = esp_websocket_client_send_text(data->client, "2probe", 6, pdMS_TO_TICKS(SIO_WEBSOCKET_SEND_TIMEOUT_MS));
+            if (sent < 0)
+            {
+                ESP_LOGE(TAG, "Failed to send probe");
+            }
+            else
+            {
+                metrics_count_out(&client->metrics, 6, 1);
+            }
+        }
+        break;
+
+    case WEBSOCKET_EVENT_DISCONNECTED:
+    case WEBSOCKET_EVENT_CLOSED:
+        ESP_LOGD(TAG, "WEBSOCKET_EVENT_DISCONNECTED/CLOSED %d", event_id);
+        websocket_connection_lost(client);
+        break;
+
+    case WEBSOCKET_EVENT_ERROR:
+        ESP_LOGD(TAG, "WEBSOCKET_EVENT_ERROR");
+        break;
+
+    case WEBSOCKET_EVENT_DATA:
+        if (data->op_code != WS_OPCODE_TEXT && data->op_code != WS_OPCODE_BINARY)
+        {
+            // control frames are handled by the websocket client
+            break;
+        }
+
+        ESP_LOGD(TAG, "WEBSOCKET_EVENT_DATA len=%d offset=%d total=%d", data->data_len, data->payload_offset, data->payload_len);
+        metrics_count_in(&client->metrics, data->data_len, 0);
+
+        // frames bigger than the client buffer arrive in several parts
+        if (data->payload_offset == 0)
+        {
+            rx_buffer_release(&client->websocket_recv_buffer);
+            client->websocket_recv_buffer = alloc_rx_buffer(data->payload_len);
+            if (client->websocket_recv_buffer == NULL)
+            {
+                break;
+            }
+        }
+        else if (client->websocket_recv_buffer == NULL)
+        {
+            // first part was dropped already
+            break;
+        }
+
+        if (data->payload_offset + data->data_len > client->websocket_recv_buffer->capacity)
+        {
+            ESP_LOGE(TAG, "Frame part outside of its payload");
+            rx_buffer_release(&client->websocket_recv_buffer);
+            break;
+        }
+
+        memcpy(client->websocket_recv_buffer->data + data->payload_offset, data->data_ptr, data->data_len);
+        client->websocket_recv_buffer->len = data->payload_offset + data->data_len;
+
+        if (client->websocket_recv_buffer->len >= data->payload_len)
+        {
+            sio_rx_buffer_t *message = client->websocket_recv_buffer;
+            client->websocket_recv_buffer = NULL;
+            handle_websocket_message(client, data->client, message, data->op_code == WS_OPCODE_BINARY);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
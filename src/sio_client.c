@@ -1,26 +1,14 @@
 
 
 #include <sio_client.h>
+#include <internal/sio_registry.h>
 #include <utility.h>
 #include <string.h>
 
 static const char *TAG = "[sio_client]";
 
-sio_client_t **sio_client_map = (sio_client_t **)NULL;
-
 sio_client_id_t sio_client_init(const sio_client_config_t *config)
 {
-
-    if (sio_client_map == NULL)
-    {
-        sio_client_map = calloc(SIO_MAX_PARALLEL_SOCKETS, sizeof(sio_client_t *));
-        // set all pointers to null
-        for (uint8_t i = 0; i < SIO_MAX_PARALLEL_SOCKETS; i++)
-        {
-            sio_client_map[i] = NULL;
-        }
-    }
-
     // some basic error checks
     if (config->server_address == NULL)
     {
@@ -28,80 +16,159 @@ sio_client_id_t sio_client_init(const sio_client_config_t *config)
         return -1;
     }
 
-    // get open slot
-    uint8_t slot = SIO_MAX_PARALLEL_SOCKETS;
-    for (uint8_t i = 0; i < SIO_MAX_PARALLEL_SOCKETS; i++)
+    // the ack table and the delivery queue carry the handle, it is known before the client is
+    // complete but only found once published at the end
+    sio_client_id_t slot = -1;
+    if (registry_reserve(&slot) != ESP_OK)
     {
-        if (sio_client_map[i] == NULL)
-        {
-            slot = i;
-            break;
-        }
+        return -1;
     }
 
-    // check if none was free
-    if (slot == SIO_MAX_PARALLEL_SOCKETS)
+    sio_client_t *client = calloc(1, sizeof(sio_client_t));
+    if (client == NULL)
     {
-        ESP_LOGE(TAG, "No slot available, clear a socket or increase the SIO_MAX_PARALLEL_SOCKETS define");
+        ESP_LOGE(TAG, "Failed to allocate client");
+        registry_remove(slot);
         return -1;
     }
 
     // copy from config everyting over
 
-    sio_client_t *client = calloc(1, sizeof(sio_client_t));
-
     client->client_id = slot;
     client->client_lock = xSemaphoreCreateBinary();
 
     assert(client->client_lock != NULL && "Could not create client lock");
     xSemaphoreGive(client->client_lock);
 
+    client->send_lock = xSemaphoreCreateMutex();
+    assert(client->send_lock != NULL && "Could not create send lock");
+    client->queue_lock = xSemaphoreCreateMutex();
+    assert(client->queue_lock != NULL && "Could not create queue lock");
+
     // client->eio_version = config->eio_version == 0 ? SIO_DEFAULT_EIO_VERSION : config->eio_version;
     client->eio_version = SIO_DEFAULT_EIO_VERSION;
     
     client->server_address = strdup(config->server_address);
     client->base_mac = strdup(config->base_mac);
-    // client->sio_url_path = strdup(config->sio_url_path == NULL ? SIO_DEFAULT_SIO_URL_PATH : config->sio_url_path);
-    client->sio_url_path = SIO_DEFAULT_SIO_URL_PATH;
-    // client->nspc = strdup(config->nspc == NULL ? SIO_DEFAULT_SIO_NAMESPACE : config->nspc);
-    client->transport = config->transport;
+    // owned like the other strings, sio_client_destroy frees it
+    client->sio_url_path = strdup(config->sio_url_path == NULL ? SIO_DEFAULT_SIO_URL_PATH : config->sio_url_path);
+    client->nspc = strdup(config->nspc == NULL ? SIO_DEFAULT_SIO_NAMESPACE : config->nspc);
+    client->state = 0;
+    sio_client_set_transport(client, config->transport);
+    client->preferred_transport = config->transport;
+    client->upgrade_transport = config->upgrade_transport;
+
+    client->reconnect = config->reconnect;
+    client->reconnect_max_attempts = config->reconnect_max_attempts;
+    client->reconnect_delay_ms = config->reconnect_delay_ms == 0 ? SIO_RECONNECT_DELAY_MS : config->reconnect_delay_ms;
+    client->reconnect_delay_max_ms = config->reconnect_delay_max_ms == 0 ? SIO_RECONNECT_DELAY_MAX_MS : config->reconnect_delay_max_ms;
+    client->reconnect_cancelled = false;
+    client->reconnect_wake = xSemaphoreCreateBinary();
+    assert(client->reconnect_wake != NULL && "Could not create reconnect wake");
+    client->reconnect_done = xSemaphoreCreateBinary();
+    assert(client->reconnect_done != NULL && "Could not create reconnect done");
+
+    client->journal_enabled = false;
+    if (config->journal_storage != NULL)
+    {
+        esp_err_t journal_err = journal_open(&client->journal, config->journal_storage, config->journal_eviction);
+        if (journal_err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Journal not usable, emits while offline are lost: %s", esp_err_to_name(journal_err));
+            journal_close(&client->journal);
+        }
+        client->journal_enabled = journal_err == ESP_OK;
+    }
 
     client->server_ping_interval_ms = 0;
     client->server_ping_timeout_ms = 0;
+    client->server_upgrade_websocket = false;
+    client->server_max_payload = SIO_DEFAULT_MAX_PAYLOAD;
 
     client->server_session_id = NULL;
+    client->session_url = NULL;
+    client->session_url_token = 0;
     client->handshake_client = NULL;
     client->alloc_auth_body_cb = config->alloc_auth_body_cb;
 
     // all of the clients need to be null
 
-    client->polling_client = NULL;
-    client->posting_client = NULL;
+    http_conn_init(&client->polling_conn, &client->polling_rx);
+    client->polling_task = NULL;
+    http_conn_init(&client->posting_conn, &client->posting_rx);
     client->handshake_client = NULL;
 
-    client->polling_client_running = false;
+    client->send_queue = xQueueCreate(SIO_DEFAULT_MESSAGE_QUEUE_SIZE, sizeof(Packet_t *));
+    client->outbound_carry = NULL;
+    client->pong_owed = false;
+    client->post_buffer = NULL;
+    client->post_buffer_capacity = 0;
+    assert(client->send_queue != NULL && "Could not create send queue");
+    client->posting_task = NULL;
+
+    client->websocket_client = NULL;
+    client->websocket_state = SIO_WEBSOCKET_STATE_CLOSED;
+    client->websocket_handshake_done = NULL;
+    client->websocket_recv_buffer = NULL;
+    client->websocket_binary_pending = NULL;
+
+    esp_err_t ack_err = ack_table_init(&client->acks, slot);
+    assert(ack_err == ESP_OK && "Could not create ack table");
+
+    esp_err_t heartbeat_err = heartbeat_init(&client->heartbeat, sio_client_heartbeat_expired, client);
+    assert(heartbeat_err == ESP_OK && "Could not create heartbeat timer");
+
+    namespace_table_init(&client->namespaces, client->nspc);
+    event_handler_table_init(&client->handlers);
 
-    sio_client_map[slot] = client;
+    esp_err_t dispatch_err = dispatch_queue_init(&client->dispatch, slot, config->dispatch_overflow);
+    assert(dispatch_err == ESP_OK && "Could not create dispatch queue");
 
-    ESP_LOGD(TAG, "inited client %d @ %p", slot, client);
+    // unhandled events are dropped before they become packets
+    client->polling_rx.record_filter = event_handler_accept_record;
+    client->polling_rx.record_filter_arg = client;
+
+    esp_err_t metrics_err = metrics_init(&client->metrics, slot, config->metrics_interval_ms, sio_client_metrics_report, client);
+    assert(metrics_err == ESP_OK && "Could not create metrics timer");
+    client->handshake_rx.metrics = &client->metrics;
+    client->polling_rx.metrics = &client->metrics;
+    client->posting_rx.metrics = &client->metrics;
+    metrics_heap(&client->metrics, sizeof(sio_client_t) + strlen(client->server_address) + strlen(client->nspc) + 2);
+
+    client->emit_lock = xSemaphoreCreateMutex();
+    assert(client->emit_lock != NULL && "Could not create emit lock");
+    client->emit_buffer = NULL;
+    client->emit_buffer_capacity = 0;
+
+    registry_publish(slot, client);
+
+    ESP_LOGD(TAG, "inited client %d @ %p", (int)slot, client);
 
     return (sio_client_id_t)slot;
 }
 
 void sio_client_destroy(sio_client_id_t clientId)
 {
-    if (!sio_client_is_inited(clientId))
+    sio_client_t *client = sio_client_get(clientId);
+    if (client == NULL)
     {
         return;
     }
 
-    sio_client_t *client = sio_client_map[clientId];
+    uint32_t state = sio_client_state(client);
+    if ((state & (SIO_STATE_POLLING | SIO_STATE_WEBSOCKET | SIO_STATE_IO_SCHEDULED | SIO_STATE_RECONNECTING)) ||
+        client->posting_task != NULL)
+    {
+        ESP_LOGE(TAG, "Client is running, stop it first");
+        return;
+    }
 
-    if (client->polling_client_running)
+    // from here on the handle is stale, a concurrent destroy of the same handle backs off
+    if (!registry_remove(clientId))
     {
-        ESP_LOGE(TAG, "Polling client is running, stop it first");
         return;
     }
+    metrics_deinit(&client->metrics);
 
     freeIfNotNull(&client->server_address);
     freeIfNotNull(&client->sio_url_path);
@@ -109,71 +176,180 @@ void sio_client_destroy(sio_client_id_t clientId)
 
     // could be allocated
     freeIfNotNull(&client->server_session_id);
+    freeIfNotNull(&client->session_url);
+    freeIfNotNull(&client->post_buffer);
 
-    // Remove the semaphore, cleanup all handlers
-    vSemaphoreDelete(client->client_lock);
-    if (client->polling_client != NULL)
+    // drop whatever was never sent
+    if (client->outbound_carry != NULL)
     {
-        ESP_ERROR_CHECK(esp_http_client_cleanup(client->polling_client));
+        free_packet(&client->outbound_carry);
     }
-    if (client->posting_client != NULL)
+    Packet_t *pending = NULL;
+    while (xQueueReceive(client->send_queue, &pending, 0) == pdTRUE)
     {
-        ESP_ERROR_CHECK(esp_http_client_cleanup(client->posting_client));
+        free_packet(&pending);
     }
+    vQueueDelete(client->send_queue);
+
+    // Remove the semaphore, cleanup all handlers
+    vSemaphoreDelete(client->client_lock);
+    vSemaphoreDelete(client->send_lock);
+    vSemaphoreDelete(client->queue_lock);
+    vSemaphoreDelete(client->reconnect_wake);
+    vSemaphoreDelete(client->reconnect_done);
+    http_conn_close(&client->polling_conn);
+    http_conn_close(&client->posting_conn);
     if (client->handshake_client != NULL)
     {
         ESP_ERROR_CHECK(esp_http_client_cleanup(client->handshake_client));
     }
+    if (client->websocket_client != NULL)
+    {
+        ESP_ERROR_CHECK(esp_websocket_client_destroy(client->websocket_client));
+    }
+    if (client->websocket_handshake_done != NULL)
+    {
+        vSemaphoreDelete(client->websocket_handshake_done);
+    }
+    rx_buffer_release(&client->websocket_recv_buffer);
+    if (client->websocket_binary_pending != NULL)
+    {
+        free_packet(&client->websocket_binary_pending);
+    }
+
+    ack_table_deinit(&client->acks);
+    heartbeat_deinit(&client->heartbeat);
+    dispatch_queue_deinit(&client->dispatch);
+    if (client->journal_enabled)
+    {
+        journal_close(&client->journal);
+    }
+
+    vSemaphoreDelete(client->emit_lock);
+    freeIfNotNull(&client->emit_buffer);
+
+    http_rx_context_reset(&client->handshake_rx);
+    http_rx_context_reset(&client->polling_rx);
+    http_rx_context_reset(&client->posting_rx);
 
     freeIfNotNull(&client);
-    sio_client_map[clientId] = NULL;
-    // if all of them are freed then free the map
+}
+
+bool sio_client_is_inited(const sio_client_id_t clientId)
+{
+    return registry_get(clientId) != NULL;
+}
 
-    bool allFreed = true;
-    for (uint8_t i = 0; i < SIO_MAX_PARALLEL_SOCKETS; i++)
+esp_err_t sio_client_get_dispatch_stats(const sio_client_id_t clientId, sio_dispatch_stats_t *stats)
+{
+    sio_client_t *client = registry_get(clientId);
+    if (client == NULL)
     {
-        if (sio_client_map[i] != NULL)
-        {
-            allFreed = false;
-            break;
-        }
+        return ESP_ERR_INVALID_ARG;
     }
+    dispatch_queue_get_stats(&client->dispatch, stats);
+    return ESP_OK;
+}
+
+static void client_metrics(sio_client_t *client, sio_metrics_t *metrics)
+{
+    metrics_snapshot(&client->metrics, metrics);
+
+    sio_dispatch_stats_t dispatch;
+    dispatch_queue_get_stats(&client->dispatch, &dispatch);
+    metrics->dropped_in = dispatch.dropped;
+    metrics->dispatch_queue_depth = dispatch.queued;
+    metrics->dispatch_high_water = dispatch.high_water;
+
+    // plain reads, a snapshot may be a packet off
+    metrics->send_queue_depth = uxQueueMessagesWaiting(client->send_queue);
+    metrics->acks_pending = client->acks.pending;
+    metrics->journal_bytes = client->journal_enabled ? client->journal.head - client->journal.tail : 0;
+}
 
-    if (allFreed)
+esp_err_t sio_client_get_metrics(const sio_client_id_t clientId, sio_metrics_t *metrics)
+{
+    sio_client_t *client = registry_get(clientId);
+    if (client == NULL)
     {
-        freeIfNotNull(&sio_client_map);
-        sio_client_map = NULL;
+        return ESP_ERR_INVALID_ARG;
     }
+    client_metrics(client, metrics);
+    return ESP_OK;
 }
 
-bool sio_client_is_inited(const sio_client_id_t clientId)
+void sio_client_metrics_report(void *arg)
 {
+    sio_client_t *client = (sio_client_t *)arg;
+    sio_metrics_t metrics;
+    client_metrics(client, &metrics);
 
-    if (sio_client_map == NULL)
+    // never wait in the timer task, a full event loop skips a report
+    if (esp_event_post(SIO_METRICS_EVENT, SIO_METRICS_EVENT_SNAPSHOT, &metrics, sizeof(sio_metrics_t), 0) != ESP_OK)
     {
-        return false;
+        ESP_LOGD(TAG, "Metrics report of client %d skipped", (int)client->client_id);
     }
+}
 
-    if (clientId >= SIO_MAX_PARALLEL_SOCKETS || clientId < 0)
+sio_client_t *sio_client_get_and_lock(const sio_client_id_t clientId)
+{
+    ESP_LOGD(TAG, "Getting and locking client %d", (int)clientId);
+    sio_client_t *client = sio_client_get(clientId);
+    if (client != NULL)
     {
-        return false;
+        lockClient(client);
     }
+    return client;
+}
 
-    return sio_client_map[clientId] != NULL;
+sio_client_t *sio_client_get(const sio_client_id_t clientId)
+{
+    sio_client_t *client = registry_get(clientId);
+    if (client == NULL)
+    {
+        ESP_LOGW(TAG, "Client %d is not inited", (int)clientId);
+    }
+    return client;
 }
 
-sio_client_t *sio_client_get_and_lock(const sio_client_id_t clientId)
+uint32_t sio_client_state(const sio_client_t *client)
+{
+    return __atomic_load_n(&client->state, __ATOMIC_ACQUIRE);
+}
+
+uint32_t sio_client_state_set(sio_client_t *client, uint32_t flags)
 {
-    ESP_LOGD(TAG, "Getting and locking client %d", clientId);
-    if (sio_client_is_inited(clientId))
+    return __atomic_fetch_or(&client->state, flags, __ATOMIC_ACQ_REL);
+}
+
+uint32_t sio_client_state_clear(sio_client_t *client, uint32_t flags)
+{
+    return __atomic_fetch_and(&client->state, ~flags, __ATOMIC_ACQ_REL);
+}
+
+uint32_t sio_client_state_change(sio_client_t *client, uint32_t set, uint32_t clear)
+{
+    uint32_t state = sio_client_state(client);
+    while (!__atomic_compare_exchange_n(&client->state, &state, (state & ~clear) | set, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+    }
+    return state;
+}
+
+sio_transport_t sio_client_transport(const sio_client_t *client)
+{
+    return (sio_client_state(client) & SIO_STATE_TRANSPORT_WEBSOCKET) ? SIO_TRANSPORT_WEBSOCKETS : SIO_TRANSPORT_POLLING;
+}
+
+void sio_client_set_transport(sio_client_t *client, sio_transport_t transport)
+{
+    if (transport == SIO_TRANSPORT_WEBSOCKETS)
     {
-        lockClient(sio_client_map[clientId]);
-        return sio_client_map[clientId];
+        sio_client_state_set(client, SIO_STATE_TRANSPORT_WEBSOCKET);
     }
     else
     {
-        ESP_LOGW(TAG, "Client %d is not inited", clientId);
-        return NULL;
+        sio_client_state_clear(client, SIO_STATE_TRANSPORT_WEBSOCKET);
     }
 }
 
@@ -192,15 +368,16 @@ void lockClient(sio_client_t *client)
 bool sio_client_is_locked(const sio_client_id_t clientId)
 {
 
-    if (!sio_client_is_inited(clientId))
+    sio_client_t *client = registry_get(clientId);
+    if (client == NULL)
     {
-        return NULL;
+        return false;
     }
     else
     {
-        if (xSemaphoreTake(sio_client_map[clientId]->client_lock, (TickType_t)0) == pdTRUE)
+        if (xSemaphoreTake(client->client_lock, (TickType_t)0) == pdTRUE)
         {
-            unlockClient(sio_client_map[clientId]);
+            unlockClient(client);
             return false;
         }
         else
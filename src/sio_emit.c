@@ -0,0 +1,254 @@
+#include <sio_emit.h>
+#include <utility.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "[sio:emit]";
+
+#define SIO_EMIT_BUFFER_MIN 128
+
+// room for len more bytes and the terminator
+static esp_err_t emit_reserve(sio_emit_t *emit, size_t len)
+{
+    if (emit->err != ESP_OK)
+    {
+        return emit->err;
+    }
+
+    sio_client_t *client = emit->client;
+    size_t needed = emit->len + len + 1;
+    if (needed <= client->emit_buffer_capacity)
+    {
+        return ESP_OK;
+    }
+
+    size_t capacity = client->emit_buffer_capacity < SIO_EMIT_BUFFER_MIN ? SIO_EMIT_BUFFER_MIN : client->emit_buffer_capacity;
+    while (capacity < needed)
+    {
+        capacity *= 2;
+    }
+
+    char *buffer = realloc(client->emit_buffer, capacity);
+    if (buffer == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to grow emit buffer to %d", (int)capacity);
+        emit->err = ESP_ERR_NO_MEM;
+        return emit->err;
+    }
+    metrics_heap(&client->metrics, capacity - client->emit_buffer_capacity);
+    client->emit_buffer = buffer;
+    client->emit_buffer_capacity = capacity;
+    return ESP_OK;
+}
+
+static void emit_append(sio_emit_t *emit, const char *data, size_t len)
+{
+    memcpy(emit->client->emit_buffer + emit->len, data, len);
+    emit->len += len;
+}
+
+static void emit_append_quoted(sio_emit_t *emit, const char *value, size_t len, size_t escaped_len)
+{
+    char *write_p = emit->client->emit_buffer + emit->len;
+    *write_p++ = '"';
+    write_p += util_json_escape(write_p, value, len);
+    *write_p++ = '"';
+    emit->len += escaped_len + 2;
+}
+
+static void emit_release(sio_emit_t *emit)
+{
+    if (emit->client != NULL)
+    {
+        xSemaphoreGive(emit->client->emit_lock);
+        emit->client = NULL;
+    }
+}
+
+esp_err_t sio_emit_begin(sio_emit_t *emit, const sio_client_id_t clientId, sio_namespace_id_t nsp, const char *event)
+{
+    emit->client = NULL;
+    emit->len = 0;
+    emit->err = ESP_OK;
+
+    if (!sio_client_is_inited(clientId) || event == NULL)
+    {
+        emit->err = ESP_ERR_INVALID_ARG;
+        return emit->err;
+    }
+
+    char nsp_name[SIO_MAX_NAMESPACE_LEN];
+    sio_client_t *client = sio_client_get(clientId);
+    if (!namespace_table_get_name(&client->namespaces, nsp, nsp_name))
+    {
+        ESP_LOGE(TAG, "Unknown namespace %d", nsp);
+        emit->err = ESP_ERR_INVALID_ARG;
+        return emit->err;
+    }
+
+    xSemaphoreTake(client->emit_lock, portMAX_DELAY);
+    emit->client = client;
+
+    bool root = strcmp(nsp_name, "/") == 0;
+    size_t nsp_len = root ? 0 : strlen(nsp_name) + 1;
+    size_t event_len = strlen(event);
+    size_t escaped_len = util_json_escape(NULL, event, event_len);
+
+    if (emit_reserve(emit, 2 + nsp_len + 1 + escaped_len + 2) != ESP_OK)
+    {
+        return emit->err;
+    }
+
+    emit_append(emit, "42", 2);
+    if (!root)
+    {
+        emit_append(emit, nsp_name, nsp_len - 1);
+        emit_append(emit, ",", 1);
+    }
+    emit_append(emit, "[", 1);
+    emit_append_quoted(emit, event, event_len, escaped_len);
+    return ESP_OK;
+}
+
+// reserves the separating comma and len bytes of argument
+static esp_err_t emit_begin_arg(sio_emit_t *emit, size_t len)
+{
+    if (emit->client == NULL && emit->err == ESP_OK)
+    {
+        emit->err = ESP_ERR_INVALID_STATE;
+    }
+    if (emit_reserve(emit, 1 + len) != ESP_OK)
+    {
+        return emit->err;
+    }
+    emit_append(emit, ",", 1);
+    return ESP_OK;
+}
+
+esp_err_t sio_emit_int(sio_emit_t *emit, int64_t value)
+{
+    if (emit_begin_arg(emit, 20) != ESP_OK)
+    {
+        return emit->err;
+    }
+    emit->len += sprintf(emit->client->emit_buffer + emit->len, "%lld", (long long)value);
+    return ESP_OK;
+}
+
+esp_err_t sio_emit_double(sio_emit_t *emit, double value)
+{
+    if (!isfinite(value))
+    {
+        return sio_emit_null(emit);
+    }
+    if (emit_begin_arg(emit, 24) != ESP_OK)
+    {
+        return emit->err;
+    }
+    // shortest of 15 or 17 digits that reads back the same, like cJSON does
+    char *write_p = emit->client->emit_buffer + emit->len;
+    int len = snprintf(write_p, 25, "%.15g", value);
+    if (strtod(write_p, NULL) != value)
+    {
+        len = snprintf(write_p, 25, "%.17g", value);
+    }
+    emit->len += len;
+    return ESP_OK;
+}
+
+esp_err_t sio_emit_bool(sio_emit_t *emit, bool value)
+{
+    return sio_emit_json(emit, value ? "true" : "false");
+}
+
+esp_err_t sio_emit_null(sio_emit_t *emit)
+{
+    return sio_emit_json(emit, "null");
+}
+
+esp_err_t sio_emit_string(sio_emit_t *emit, const char *value)
+{
+    if (value == NULL)
+    {
+        return sio_emit_null(emit);
+    }
+    size_t len = strlen(value);
+    size_t escaped_len = util_json_escape(NULL, value, len);
+    if (emit_begin_arg(emit, escaped_len + 2) != ESP_OK)
+    {
+        return emit->err;
+    }
+    emit_append_quoted(emit, value, len, escaped_len);
+    return ESP_OK;
+}
+
+esp_err_t sio_emit_json(sio_emit_t *emit, const char *json)
+{
+    size_t len = strlen(json);
+    if (emit_begin_arg(emit, len) != ESP_OK)
+    {
+        return emit->err;
+    }
+    emit_append(emit, json, len);
+    return ESP_OK;
+}
+
+esp_err_t sio_emit_cjson(sio_emit_t *emit, cJSON *json)
+{
+    if (emit_begin_arg(emit, 0) != ESP_OK)
+    {
+        return emit->err;
+    }
+
+    // cJSON cannot tell the size up front, grow until it fits
+    while (true)
+    {
+        sio_client_t *client = emit->client;
+        size_t available = client->emit_buffer_capacity - emit->len;
+        if (cJSON_PrintPreallocated(json, client->emit_buffer + emit->len, available, false))
+        {
+            emit->len += strlen(client->emit_buffer + emit->len);
+            return ESP_OK;
+        }
+        if (emit_reserve(emit, available * 2) != ESP_OK)
+        {
+            return emit->err;
+        }
+    }
+}
+
+esp_err_t sio_emit_send(sio_emit_t *emit)
+{
+    if (emit->client == NULL)
+    {
+        return emit->err == ESP_OK ? ESP_ERR_INVALID_STATE : emit->err;
+    }
+    if (emit_reserve(emit, 1) != ESP_OK)
+    {
+        esp_err_t err = emit->err;
+        emit_release(emit);
+        return err;
+    }
+    emit_append(emit, "]", 1);
+    emit->client->emit_buffer[emit->len] = '\0';
+
+    // the polling side queues a copy, websockets send straight from the buffer
+    Packet_t packet = {
+        .eio_type = EIO_PACKET_MESSAGE,
+        .sio_type = SIO_PACKET_EVENT,
+        .json_start = NULL,
+        .data = emit->client->emit_buffer,
+        .len = emit->len,
+        .ack_id = -1};
+
+    esp_err_t err = sio_send_packet(emit->client->client_id, &packet);
+    emit_release(emit);
+    return err;
+}
+
+void sio_emit_abort(sio_emit_t *emit)
+{
+    emit_release(emit);
+}
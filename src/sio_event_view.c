@@ -0,0 +1,437 @@
+#include <sio_event_view.h>
+#include <esp_log.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "[sio:event_view]";
+
+static const char *skip_whitespace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    {
+        p++;
+    }
+    return p;
+}
+
+// end of the string starting after its opening quote, points at the closing quote
+static const char *scan_string(const char *p, const char *end)
+{
+    while (p < end && *p != '"')
+    {
+        p += (*p == '\\') ? 2 : 1;
+    }
+    return p < end ? p : NULL;
+}
+
+// end of the object or array starting at p, one past the closing bracket
+static const char *scan_container(const char *p, const char *end)
+{
+    int depth = 0;
+    while (p < end)
+    {
+        switch (*p)
+        {
+        case '"':
+            p = scan_string(p + 1, end);
+            if (p == NULL)
+            {
+                return NULL;
+            }
+            break;
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            if (--depth == 0)
+            {
+                return p + 1;
+            }
+            break;
+        default:
+            break;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+// one json value at p, returns the position after it or NULL if it is broken
+static const char *scan_value(const char *p, const char *end, sio_arg_t *arg)
+{
+    const char *value_end = NULL;
+
+    switch (*p)
+    {
+    case '"':
+        value_end = scan_string(p + 1, end);
+        if (value_end == NULL)
+        {
+            return NULL;
+        }
+        arg->type = SIO_ARG_STRING;
+        arg->start = p + 1;
+        arg->len = value_end - (p + 1);
+        return value_end + 1;
+
+    case '{':
+    case '[':
+        value_end = scan_container(p, end);
+        arg->type = *p == '{' ? SIO_ARG_OBJECT : SIO_ARG_ARRAY;
+        break;
+
+    default:
+        // number or literal, runs until the next separator
+        value_end = p;
+        while (value_end < end && *value_end != ',' && *value_end != ']' && *value_end != ' ' &&
+               *value_end != '\t' && *value_end != '\n' && *value_end != '\r')
+        {
+            value_end++;
+        }
+        if (*p == 't' || *p == 'f')
+        {
+            arg->type = SIO_ARG_BOOL;
+        }
+        else if (*p == 'n')
+        {
+            arg->type = SIO_ARG_NULL;
+        }
+        else if (*p == '-' || (*p >= '0' && *p <= '9'))
+        {
+            arg->type = SIO_ARG_NUMBER;
+        }
+        else
+        {
+            return NULL;
+        }
+        break;
+    }
+
+    if (value_end == NULL || value_end == p)
+    {
+        return NULL;
+    }
+    arg->start = p;
+    arg->len = value_end - p;
+    return value_end;
+}
+
+esp_err_t sio_event_view_parse(sio_event_view_t *view, const Packet_t *packet)
+{
+    memset(view, 0, sizeof(sio_event_view_t));
+    view->ack_id = packet->ack_id;
+
+    if (packet->eio_type != EIO_PACKET_MESSAGE || packet->json_start == NULL || *packet->json_start != '[')
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bool has_event = packet->sio_type == SIO_PACKET_EVENT || packet->sio_type == SIO_PACKET_BINARY_EVENT;
+    const char *end = packet->data + packet->len;
+    const char *p = skip_whitespace(packet->json_start + 1, end);
+
+    bool first = true;
+    while (p < end && *p != ']')
+    {
+        if (!first)
+        {
+            if (*p != ',')
+            {
+                goto invalid;
+            }
+            p = skip_whitespace(p + 1, end);
+        }
+
+        sio_arg_t arg;
+        p = p < end ? scan_value(p, end, &arg) : NULL;
+        if (p == NULL)
+        {
+            goto invalid;
+        }
+        p = skip_whitespace(p, end);
+
+        if (first && has_event)
+        {
+            if (arg.type != SIO_ARG_STRING)
+            {
+                goto invalid;
+            }
+            view->event = arg.start;
+            view->event_len = arg.len;
+        }
+        else if (view->arg_count < SIO_EVENT_VIEW_MAX_ARGS)
+        {
+            view->args[view->arg_count++] = arg;
+        }
+        else
+        {
+            // everything the view has room for is there, the rest stays untouched
+            return ESP_OK;
+        }
+        first = false;
+    }
+
+    if (p >= end || (has_event && view->event == NULL))
+    {
+        goto invalid;
+    }
+    return ESP_OK;
+
+invalid:
+    ESP_LOGW(TAG, "Malformed event: %.*s", (int)packet->len, packet->data);
+    return ESP_ERR_INVALID_RESPONSE;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static bool read_hex4(const char *p, const char *end, uint32_t *value)
+{
+    if (end - p < 4)
+    {
+        return false;
+    }
+    *value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int digit = hex_value(p[i]);
+        if (digit < 0)
+        {
+            return false;
+        }
+        *value = (*value << 4) | digit;
+    }
+    return true;
+}
+
+// Unescapes the character at *src_p into out as utf-8, advances *src_p.
+// Returns the number of bytes written, 0 for broken escapes.
+static int unescape_next(const char **src_p, const char *end, char out[4])
+{
+    const char *p = *src_p;
+    if (*p != '\\')
+    {
+        out[0] = *p;
+        *src_p = p + 1;
+        return 1;
+    }
+    if (p + 1 >= end)
+    {
+        return 0;
+    }
+
+    uint32_t codepoint;
+    switch (p[1])
+    {
+    case '"':
+    case '\\':
+    case '/':
+        out[0] = p[1];
+        *src_p = p + 2;
+        return 1;
+    case 'b':
+        out[0] = '\b';
+        *src_p = p + 2;
+        return 1;
+    case 'f':
+        out[0] = '\f';
+        *src_p = p + 2;
+        return 1;
+    case 'n':
+        out[0] = '\n';
+        *src_p = p + 2;
+        return 1;
+    case 'r':
+        out[0] = '\r';
+        *src_p = p + 2;
+        return 1;
+    case 't':
+        out[0] = '\t';
+        *src_p = p + 2;
+        return 1;
+    case 'u':
+        if (!read_hex4(p + 2, end, &codepoint))
+        {
+            return 0;
+        }
+        p += 6;
+        if (codepoint >= 0xD800 && codepoint <= 0xDBFF)
+        {
+            // high surrogate, the low half follows as another \u
+            uint32_t low;
+            if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !read_hex4(p + 2, end, &low) || low < 0xDC00 || low > 0xDFFF)
+            {
+                return 0;
+            }
+            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+            p += 6;
+        }
+        *src_p = p;
+        break;
+    default:
+        return 0;
+    }
+
+    if (codepoint < 0x80)
+    {
+        out[0] = codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800)
+    {
+        out[0] = 0xC0 | (codepoint >> 6);
+        out[1] = 0x80 | (codepoint & 0x3F);
+        return 2;
+    }
+    if (codepoint < 0x10000)
+    {
+        out[0] = 0xE0 | (codepoint >> 12);
+        out[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+        out[2] = 0x80 | (codepoint & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (codepoint >> 18);
+    out[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+    out[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+    out[3] = 0x80 | (codepoint & 0x3F);
+    return 4;
+}
+
+static bool raw_string_equals(const char *raw, size_t raw_len, const char *str)
+{
+    size_t str_len = strlen(str);
+    if (memchr(raw, '\\', raw_len) == NULL)
+    {
+        // the usual case, nothing escaped
+        return raw_len == str_len && memcmp(raw, str, raw_len) == 0;
+    }
+
+    const char *p = raw;
+    const char *end = raw + raw_len;
+    size_t matched = 0;
+    while (p < end)
+    {
+        char decoded[4];
+        int n = unescape_next(&p, end, decoded);
+        if (n == 0 || matched + n > str_len || memcmp(str + matched, decoded, n) != 0)
+        {
+            return false;
+        }
+        matched += n;
+    }
+    return matched == str_len;
+}
+
+bool sio_event_view_is(const sio_event_view_t *view, const char *event)
+{
+    return view->event != NULL && raw_string_equals(view->event, view->event_len, event);
+}
+
+esp_err_t sio_arg_get_int(const sio_arg_t *arg, int64_t *value)
+{
+    if (arg->type != SIO_ARG_NUMBER)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // the span ends at a separator, strtoll stops there on its own
+    char *parsed_end;
+    long long parsed = strtoll(arg->start, &parsed_end, 10);
+    if (parsed_end != arg->start + arg->len)
+    {
+        // fraction or exponent, go through double
+        double d;
+        esp_err_t err = sio_arg_get_double(arg, &d);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        parsed = (long long)d;
+    }
+    *value = parsed;
+    return ESP_OK;
+}
+
+esp_err_t sio_arg_get_double(const sio_arg_t *arg, double *value)
+{
+    if (arg->type != SIO_ARG_NUMBER)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char *parsed_end;
+    double parsed = strtod(arg->start, &parsed_end);
+    if (parsed_end != arg->start + arg->len)
+    {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    *value = parsed;
+    return ESP_OK;
+}
+
+esp_err_t sio_arg_get_bool(const sio_arg_t *arg, bool *value)
+{
+    if (arg->type != SIO_ARG_BOOL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *value = arg->start[0] == 't';
+    return ESP_OK;
+}
+
+esp_err_t sio_arg_copy_string(const sio_arg_t *arg, char *dst, size_t dst_size)
+{
+    if (arg->type != SIO_ARG_STRING)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char *p = arg->start;
+    const char *end = arg->start + arg->len;
+    size_t written = 0;
+    while (p < end)
+    {
+        char decoded[4];
+        int n = unescape_next(&p, end, decoded);
+        if (n == 0)
+        {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (written + n >= dst_size)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(dst + written, decoded, n);
+        written += n;
+    }
+    dst[written] = '\0';
+    return ESP_OK;
+}
+
+bool sio_arg_string_equals(const sio_arg_t *arg, const char *str)
+{
+    return arg->type == SIO_ARG_STRING && raw_string_equals(arg->start, arg->len, str);
+}
+
+cJSON *sio_arg_parse_json(const sio_arg_t *arg)
+{
+    if (arg->type == SIO_ARG_INVALID)
+    {
+        return NULL;
+    }
+    if (arg->type == SIO_ARG_STRING)
+    {
+        // the span leaves out the quotes, they are right around it
+        return cJSON_ParseWithLength(arg->start - 1, arg->len + 2);
+    }
+    return cJSON_ParseWithLength(arg->start, arg->len);
+}
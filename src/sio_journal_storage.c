@@ -0,0 +1,174 @@
+#include <sio_journal.h>
+#include <esp_log.h>
+#include <nvs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "[sio:journal_storage]";
+
+#define SIO_JOURNAL_NVS_PAGE_SIZE 512 /* one blob per page, a write rewrites the pages it touches */
+
+// nvs
+
+typedef struct
+{
+    nvs_handle_t handle;
+    uint8_t page[SIO_JOURNAL_NVS_PAGE_SIZE];
+} nvs_storage_t;
+
+static void nvs_page_key(char key[16], size_t page)
+{
+    snprintf(key, 16, "p%u", (unsigned)page);
+}
+
+// missing pages were never written and read as zeros
+static esp_err_t nvs_load_page(nvs_storage_t *nvs, size_t page)
+{
+    char key[16];
+    nvs_page_key(key, page);
+    size_t len = SIO_JOURNAL_NVS_PAGE_SIZE;
+    memset(nvs->page, 0, SIO_JOURNAL_NVS_PAGE_SIZE);
+    esp_err_t err = nvs_get_blob(nvs->handle, key, nvs->page, &len);
+    return err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+}
+
+static esp_err_t nvs_storage_read(void *ctx, size_t offset, void *dst, size_t len)
+{
+    nvs_storage_t *nvs = (nvs_storage_t *)ctx;
+    uint8_t *out = (uint8_t *)dst;
+    while (len > 0)
+    {
+        size_t page = offset / SIO_JOURNAL_NVS_PAGE_SIZE;
+        size_t in_page = offset % SIO_JOURNAL_NVS_PAGE_SIZE;
+        size_t chunk = SIO_JOURNAL_NVS_PAGE_SIZE - in_page < len ? SIO_JOURNAL_NVS_PAGE_SIZE - in_page : len;
+
+        esp_err_t err = nvs_load_page(nvs, page);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        memcpy(out, nvs->page + in_page, chunk);
+        out += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t nvs_storage_write(void *ctx, size_t offset, const void *src, size_t len)
+{
+    nvs_storage_t *nvs = (nvs_storage_t *)ctx;
+    const uint8_t *in = (const uint8_t *)src;
+    while (len > 0)
+    {
+        size_t page = offset / SIO_JOURNAL_NVS_PAGE_SIZE;
+        size_t in_page = offset % SIO_JOURNAL_NVS_PAGE_SIZE;
+        size_t chunk = SIO_JOURNAL_NVS_PAGE_SIZE - in_page < len ? SIO_JOURNAL_NVS_PAGE_SIZE - in_page : len;
+
+        esp_err_t err = ESP_OK;
+        if (chunk < SIO_JOURNAL_NVS_PAGE_SIZE)
+        {
+            err = nvs_load_page(nvs, page);
+        }
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        memcpy(nvs->page + in_page, in, chunk);
+
+        char key[16];
+        nvs_page_key(key, page);
+        err = nvs_set_blob(nvs->handle, key, nvs->page, SIO_JOURNAL_NVS_PAGE_SIZE);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        in += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+    return nvs_commit(nvs->handle);
+}
+
+static void nvs_storage_close(void *ctx)
+{
+    nvs_storage_t *nvs = (nvs_storage_t *)ctx;
+    nvs_close(nvs->handle);
+    free(nvs);
+}
+
+esp_err_t sio_journal_storage_nvs(sio_journal_storage_t *storage, const char *nvs_namespace, size_t size)
+{
+    nvs_storage_t *nvs = calloc(1, sizeof(nvs_storage_t));
+    if (nvs == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = nvs_open(nvs_namespace, NVS_READWRITE, &nvs->handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open nvs namespace %s: %s", nvs_namespace, esp_err_to_name(err));
+        free(nvs);
+        return err;
+    }
+
+    storage->read = nvs_storage_read;
+    storage->write = nvs_storage_write;
+    storage->close = nvs_storage_close;
+    storage->size = size;
+    storage->ctx = nvs;
+    return ESP_OK;
+}
+
+// file
+
+static esp_err_t file_storage_read(void *ctx, size_t offset, void *dst, size_t len)
+{
+    FILE *file = (FILE *)ctx;
+    if (fseek(file, offset, SEEK_SET) != 0)
+    {
+        return ESP_FAIL;
+    }
+    size_t read = fread(dst, 1, len, file);
+    // past the end of the file was never written
+    memset((uint8_t *)dst + read, 0, len - read);
+    return ferror(file) ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t file_storage_write(void *ctx, size_t offset, const void *src, size_t len)
+{
+    FILE *file = (FILE *)ctx;
+    if (fseek(file, offset, SEEK_SET) != 0 || fwrite(src, 1, len, file) != len || fflush(file) != 0)
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static void file_storage_close(void *ctx)
+{
+    fclose((FILE *)ctx);
+}
+
+esp_err_t sio_journal_storage_file(sio_journal_storage_t *storage, const char *path, size_t size)
+{
+    FILE *file = fopen(path, "r+b");
+    if (file == NULL)
+    {
+        file = fopen(path, "w+b");
+    }
+    if (file == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to open journal file %s", path);
+        return ESP_FAIL;
+    }
+
+    storage->read = file_storage_read;
+    storage->write = file_storage_write;
+    storage->close = file_storage_close;
+    storage->size = size;
+    storage->ctx = file;
+    return ESP_OK;
+}
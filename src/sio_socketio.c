@@ -2,6 +2,7 @@
 #include <sio_types.h>
 #include <internal/sio_packet.h>
 #include <internal/task_functions.h>
+#include <internal/sio_io_scheduler.h>
 #include <utility.h>
 #include <cJSON.h>
 
@@ -9,6 +10,7 @@
 static const char *TAG = "[sio_socketio]";
 
 ESP_EVENT_DEFINE_BASE(SIO_EVENT);
+ESP_EVENT_DEFINE_BASE(SIO_METRICS_EVENT);
 
 esp_err_t handshake(sio_client_t *client);
 esp_err_t handshake_polling(sio_client_t *client);
@@ -19,11 +21,26 @@ esp_err_t sio_send_packet_websocket(sio_client_t *client, const Packet_t *packet
 
 char *alloc_post_url(const sio_client_t *client);
 char *alloc_handshake_get_url(const sio_client_t *client);
+char *alloc_websocket_upgrade_url(const sio_client_t *client);
+
+static esp_err_t init_websocket_client(sio_client_t *client, const char *url);
+static void cleanup_websocket_client(sio_client_t *client);
+
+static esp_err_t posting_connection_open(sio_client_t *client);
+static void posting_connection_close(sio_client_t *client);
+
+static esp_err_t enqueue_packet_polling(sio_client_t *client, const Packet_t *packet);
+static esp_err_t enqueue_owned_packets_polling(sio_client_t *client, Packet_t **packets, size_t count);
+static esp_err_t flush_outbound(sio_client_t *client);
+static char *reserve_post_buffer(sio_client_t *client, size_t size);
 
 esp_err_t sio_client_begin(const sio_client_id_t clientId)
 {
 
     sio_client_t *client = sio_client_get_and_lock(clientId);
+    __atomic_store_n(&client->reconnect_cancelled, false, __ATOMIC_SEQ_CST);
+    // a wake-up the last close left behind would cut the first backoff short
+    xSemaphoreTake(client->reconnect_wake, 0);
     esp_err_t handshake_result = handshake(client);
 
     if (handshake_result == ESP_OK)
@@ -42,30 +59,23 @@ esp_err_t sio_client_begin(const sio_client_id_t clientId)
 esp_err_t handshake(sio_client_t *client)
 {
 
-    if (client->transport == SIO_TRANSPORT_WEBSOCKETS)
+    if (sio_client_transport(client) == SIO_TRANSPORT_WEBSOCKETS)
     {
         return handshake_websocket(client);
     }
-    else if (client->transport == SIO_TRANSPORT_POLLING)
-    {
-        return handshake_polling(client);
-    }
-    else
-    {
-        return ESP_ERR_INVALID_ARG;
-    }
+    return handshake_polling(client);
 }
 
 esp_err_t handshake_polling(sio_client_t *client)
 {
-    if (client->polling_client_running)
+    if (sio_client_state(client) & SIO_STATE_POLLING)
     {
         ESP_LOGE(TAG, "Polling client already running, close it properly first");
         return ESP_FAIL;
     }
 
-    static PacketPointerArray_t packets;
-    packets = NULL;
+    PacketPointerArray_t packets = NULL;
+    http_rx_context_reset(&client->handshake_rx);
     { // scope for first url without session id
 
         char *url = alloc_handshake_get_url(client);
@@ -75,12 +85,12 @@ esp_err_t handshake_polling(sio_client_t *client)
 
             // Form the request URL
 
-            ESP_LOGW(TAG, "Handshake URL: >%s< len:%d", url, strlen(url));
+            ESP_LOGW(TAG, "Handshake URL: >%s< len:%d", url, (int)strlen(url));
 
             esp_http_client_config_t config = {
                 .url = url,
                 .event_handler = http_client_polling_get_handler,
-                .user_data = &packets,
+                .user_data = &client->handshake_rx,
                 .disable_auto_redirect = true,
                 .method = HTTP_METHOD_GET,
             };
@@ -102,6 +112,11 @@ esp_err_t handshake_polling(sio_client_t *client)
     }
 
     esp_err_t err = esp_http_client_perform(client->handshake_client);
+
+    // the array goes out with the connected / error event
+    packets = client->handshake_rx.packets;
+    client->handshake_rx.packets = NULL;
+
     if (err != ESP_OK || packets == NULL)
     {
         ESP_LOGE(TAG, "HTTP GET request failed: %s, packets pointer %p ", esp_err_to_name(err), packets);
@@ -123,56 +138,75 @@ esp_err_t handshake_polling(sio_client_t *client)
         err = ESP_FAIL;
         goto cleanup;
     }
-    cJSON *json = cJSON_Parse(packet->json_start);
-    if (json == NULL)
+    err = sio_client_apply_open_packet(client, packet);
+    if (err != ESP_OK)
     {
-        ESP_LOGE(TAG, "Failed to parse JSON: %s", cJSON_GetErrorPtr());
-        const char *error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr != NULL)
-        {
-            fprintf(stderr, "Error before: %s\n", error_ptr);
-        }
-
-        err = ESP_FAIL;
         goto cleanup;
-    };
-    client->server_session_id = strdup(cJSON_GetObjectItemCaseSensitive(json, "sid")->valuestring);
-    client->server_ping_interval_ms = cJSON_GetObjectItem(json, "pingInterval")->valueint;
-    client->server_ping_timeout_ms = cJSON_GetObjectItem(json, "pingTimeout")->valueint;
-    cJSON_Delete(json);
-    // send back the ok with the new url
-
-    // Post an OK, or rather the auth message
-    // const char *auth_data = client->alloc_auth_body_cb == NULL ? strdup("") : client->alloc_auth_body_cb(client);
-    const char *auth_data = "";
-    Packet_t *init_packet = alloc_message(auth_data, NULL);
-    // freeIfNotNull(&auth_data);
-    setSioType(init_packet, SIO_PACKET_CONNECT);
-    err = sio_send_packet_polling(client, init_packet);
-    ESP_LOGI(TAG, "free init packet");
-    free_packet(&init_packet);
+    }
+    // looked up once per session, the polling and posting connections both connect to it
+    err = http_conn_resolve(client->server_address, &client->server_addr, &client->server_addr_len);
+    if (err != ESP_OK)
+    {
+        goto cleanup;
+    }
+    // a pong the last session owed means nothing to this one
+    __atomic_store_n(&client->pong_owed, false, __ATOMIC_SEQ_CST);
+
+    // set up the posting connection now, the connect below opens it and later emits reuse it.
+    // A posting task of the last session may still be winding down, it waits on the send lock.
+    xSemaphoreTake(client->send_lock, portMAX_DELAY);
+    posting_connection_close(client);
+    err = posting_connection_open(client);
+    if (err == ESP_OK)
+    {
+        // send back the ok with the new url
+
+        // Post an OK, or rather the auth message
+        // const char *auth_data = client->alloc_auth_body_cb == NULL ? strdup("") : client->alloc_auth_body_cb(client);
+        const char *auth_data = "";
+        Packet_t *init_packet = namespace_table_alloc_connect(&client->namespaces, 0, auth_data);
+        // freeIfNotNull(&auth_data);
+        namespace_table_set_state(&client->namespaces, 0, SIO_NAMESPACE_CONNECTING);
+        err = sio_send_packet_polling(client, init_packet);
+        ESP_LOGI(TAG, "free init packet");
+        free_packet(&init_packet);
+    }
+    xSemaphoreGive(client->send_lock);
 
 cleanup:
     if (err == ESP_OK)
     {
 
-        client->polling_client_running = true;
-        xTaskCreate(&sio_polling_task, "sio_polling", 4096, (void *)&client->client_id, 6, NULL);
+        sio_client_state_set(client, SIO_STATE_POLLING | SIO_STATE_POSTING);
+
+        // the shared I/O task polls and posts for every client, without it each gets its own tasks
+        bool io_scheduled = SIO_SHARED_IO_TASK && client->posting_task == NULL;
+        if (io_scheduled)
+        {
+            sio_client_state_set(client, SIO_STATE_IO_SCHEDULED);
+            io_scheduled = io_scheduler_add(client) == ESP_OK;
+            if (!io_scheduled)
+            {
+                sio_client_state_clear(client, SIO_STATE_IO_SCHEDULED);
+            }
+        }
+        if (!io_scheduled)
+        {
+            xTaskCreate(&sio_polling_task, "sio_polling", 4096, (void *)&client->client_id, 6, &client->polling_task);
+
+            // a posting task that is still winding down just keeps going
+            if (client->posting_task == NULL)
+            {
+                xTaskCreate(&sio_posting_task, "sio_posting", 4096, (void *)&client->client_id, 6, &client->posting_task);
+            }
+        }
 
-        sio_event_data_t event_data = {
-            .client_id = client->client_id,
-            .packets_pointer = packets,
-            .len = get_array_size(packets)};
-        esp_event_post(SIO_EVENT, SIO_EVENT_CONNECTED, &event_data, sizeof(sio_event_data_t), pdMS_TO_TICKS(50));
+        dispatch_queue_post(&client->dispatch, SIO_EVENT_CONNECTED, 0, packets);
     }
     else
     {
         ESP_LOGW(TAG, "Handshake failed, sending error event");
-        sio_event_data_t event_data = {
-            .client_id = client->client_id,
-            .packets_pointer = packets,
-            .len = get_array_size(packets)};
-        esp_event_post(SIO_EVENT, SIO_EVENT_CONNECT_ERROR, &event_data, sizeof(sio_event_data_t), pdMS_TO_TICKS(50));
+        dispatch_queue_post(&client->dispatch, SIO_EVENT_CONNECT_ERROR, 0, packets);
     }
 
     return err;
@@ -180,258 +214,1369 @@ cleanup:
 
 esp_err_t handshake_websocket(sio_client_t *client)
 {
-    assert(false && "Not implemented");
-}
-
-// sending
+    if (sio_client_state(client) & SIO_STATE_WEBSOCKET)
+    {
+        ESP_LOGE(TAG, "Websocket client already running, close it properly first");
+        return ESP_FAIL;
+    }
 
-esp_err_t sio_send_string(const sio_client_id_t clientId, const char *event, const char *data)
-{
-    ESP_LOGW(TAG, "Sending event with data: %s %s", event, data);
+    sio_client_state_clear(client, SIO_STATE_SESSION);
+    freeIfNotNull(&client->server_session_id);
 
-    Packet_t *p = alloc_message(data, event);
-    print_packet(p);
-    esp_err_t ret = sio_send_packet(clientId, p);
-    free_packet(&p);
-    return ret;
-}
+    char *url = alloc_handshake_get_url(client);
+    ESP_LOGW(TAG, "Handshake URL: >%s< len:%d", url, (int)strlen(url));
 
-esp_err_t sio_send_packet(const sio_client_id_t clientId, const Packet_t *packet)
-{
-    sio_client_t *client = sio_client_get_and_lock(clientId);
+    client->websocket_state = SIO_WEBSOCKET_STATE_HANDSHAKE;
+    esp_err_t err = init_websocket_client(client, url);
+    freeIfNotNull(&url);
 
-    if (client->server_session_id == NULL)
+    if (err != ESP_OK)
     {
-        ESP_LOGE(TAG, "Server session id not set, was this client initialized?");
-        unlockClient(client);
+        goto cleanup;
+    }
 
-        return ESP_FAIL;
+    // the handler runs the open packet / connect exchange in the websocket task
+    if (xSemaphoreTake(client->websocket_handshake_done, pdMS_TO_TICKS(SIO_WEBSOCKET_HANDSHAKE_TIMEOUT_MS)) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Websocket handshake timed out");
+        err = ESP_ERR_TIMEOUT;
+        goto cleanup;
     }
-    esp_err_t ret = ESP_FAIL;
 
-    if (client->transport == SIO_TRANSPORT_WEBSOCKETS)
+    if (client->websocket_state != SIO_WEBSOCKET_STATE_OPEN)
     {
-        ret = sio_send_packet_websocket(client, packet);
+        ESP_LOGE(TAG, "Websocket handshake failed");
+        err = ESP_FAIL;
     }
-    else if (client->transport == SIO_TRANSPORT_POLLING)
+
+cleanup:
+    if (err == ESP_OK)
     {
-        ret = sio_send_packet_polling(client, packet);
+        sio_client_state_set(client, SIO_STATE_WEBSOCKET);
+
+        dispatch_queue_post(&client->dispatch, SIO_EVENT_CONNECTED, 0, NULL);
     }
     else
     {
-        ret = ESP_ERR_INVALID_ARG;
+        ESP_LOGW(TAG, "Handshake failed, sending error event");
+        cleanup_websocket_client(client);
+        sio_client_state_clear(client, SIO_STATE_SESSION);
+        freeIfNotNull(&client->server_session_id);
+
+        dispatch_queue_post(&client->dispatch, SIO_EVENT_CONNECT_ERROR, 0, NULL);
     }
 
-    unlockClient(client);
-    return ret;
+    return err;
 }
 
-// TODO: figure out why this is necessary,
-// https://github.com/ZweiEuro/socketio-esp-idf/issues/1
-#define REBUILD_CLIENT_POST 1
-
-esp_err_t sio_send_packet_polling(sio_client_t *client, const Packet_t *packet)
+// sets up and starts the websocket client, the handler continues depending on websocket_state
+static esp_err_t init_websocket_client(sio_client_t *client, const char *url)
 {
-    static PacketPointerArray_t packets;
-    packets = NULL;
+    // a previous session leaves its handle behind
+    if (client->websocket_client != NULL)
+    {
+        esp_websocket_client_destroy(client->websocket_client);
+        client->websocket_client = NULL;
+    }
 
-    { // scope for first url without session id
+    if (client->websocket_handshake_done == NULL)
+    {
+        client->websocket_handshake_done = xSemaphoreCreateBinary();
+        if (client->websocket_handshake_done == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to create websocket handshake semaphore");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    // clear a stale signal of a previous attempt
+    xSemaphoreTake(client->websocket_handshake_done, 0);
 
-        char *url = alloc_post_url(client);
+    char *headers = NULL;
+    if (client->base_mac != NULL)
+    {
+        headers = calloc(1, strlen("MAC: \r\n") + strlen(client->base_mac) + 1);
+        sprintf(headers, "MAC: %s\r\n", client->base_mac);
+    }
 
-        if (client->posting_client == NULL)
-        {
+    esp_websocket_client_config_t config = {
+        .uri = url,
+        .headers = headers,
+        .disable_auto_reconnect = true, // a new connection needs a new session
+        .buffer_size = MAX_HTTP_RECV_BUFFER,
+    };
 
-            // Form the request URL
+    client->websocket_client = esp_websocket_client_init(&config);
 
-            esp_http_client_config_t config = {
-                .url = url,
-                .event_handler = http_client_polling_post_handler,
-                .user_data = &packets,
-                .disable_auto_redirect = true,
-                .method = HTTP_METHOD_POST,
-            };
-            client->posting_client = esp_http_client_init(&config);
+    // the config is copied during init
+    freeIfNotNull(&headers);
 
-            if (client->posting_client == NULL)
-            {
-                ESP_LOGE(TAG, "Failed to initialize HTTP client");
-                return ESP_FAIL;
-            }
-        }
-        esp_http_client_set_header(client->posting_client, "Content-Type", "text/plain;charset=UTF-8");
-        esp_http_client_set_header(client->posting_client, "Accept", "*/*");
-        esp_http_client_set_method(client->posting_client, HTTP_METHOD_POST);
-        esp_http_client_set_post_field(client->posting_client, packet->data, packet->len);
+    if (client->websocket_client == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to initialize websocket client");
+        return ESP_FAIL;
+    }
 
-        esp_http_client_set_url(client->posting_client, url);
+    esp_websocket_register_events(client->websocket_client, WEBSOCKET_EVENT_ANY, websocket_event_handler, (void *)client);
 
-        freeIfNotNull(&url);
+    esp_err_t err = esp_websocket_client_start(client->websocket_client);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start websocket client: %s", esp_err_to_name(err));
     }
+    return err;
+}
 
-    esp_err_t err = esp_http_client_perform(client->posting_client);
-    if (err != ESP_OK || packets == NULL)
+static void cleanup_websocket_client(sio_client_t *client)
+{
+    if (client->websocket_client != NULL)
     {
-        ESP_LOGE(TAG, "HTTP POST request failed: %s response: %p ", esp_err_to_name(err), packets);
-        goto cleanup;
+        esp_websocket_client_destroy(client->websocket_client);
+        client->websocket_client = NULL;
     }
+    client->websocket_state = SIO_WEBSOCKET_STATE_CLOSED;
+}
 
-    if (get_array_size(packets) != 1)
+// upgrade
+
+esp_err_t sio_client_upgrade_start(sio_client_t *client)
+{
+    char *url = alloc_websocket_upgrade_url(client);
+    if (url == NULL)
     {
-        ESP_LOGE(TAG, "Expected one 'ok' from server, got something else");
-        goto cleanup;
+        return ESP_FAIL;
     }
+    ESP_LOGI(TAG, "Probing websocket upgrade: %s", url);
 
-    // allocate posting user if not present
-    if (packets[0]->eio_type == EIO_PACKET_OK_SERVER)
+    // the handler sends 2probe once connected and signals on 3probe
+    client->websocket_state = SIO_WEBSOCKET_STATE_PROBE;
+    esp_err_t err = init_websocket_client(client, url);
+    freeIfNotNull(&url);
+
+    if (err != ESP_OK)
     {
-        ESP_LOGW(TAG, "Ok from server response array %p", packets);
+        cleanup_websocket_client(client);
+        dispatch_queue_post(&client->dispatch, SIO_EVENT_UPGRADE_TRANSPORT_ERROR, 0, NULL);
     }
-    else
+    return err;
+}
+
+void sio_client_upgrade_abandon(sio_client_t *client, bool report)
+{
+    // the handler ignores whatever the websocket still does, the server drops an upgrade that
+    // never completes on its own
+    client->websocket_state = SIO_WEBSOCKET_STATE_CLOSED;
+    if (report)
     {
-        ESP_LOGE(TAG, "Not ok from server after send");
+        dispatch_queue_post(&client->dispatch, SIO_EVENT_UPGRADE_TRANSPORT_ERROR, 0, NULL);
     }
+}
 
-cleanup:
-    if (packets != NULL)
+esp_err_t sio_client_upgrade_switch(sio_client_t *client)
+{
+    if (!(sio_client_state(client) & SIO_STATE_POLLING))
     {
-        free_packet_arr(&packets);
+        // closed while probing
+        return ESP_ERR_INVALID_STATE;
     }
-#if REBUILD_CLIENT_POST
-    if (client->posting_client != NULL)
+
+    client->websocket_state = SIO_WEBSOCKET_STATE_OPEN;
+    sio_client_state_set(client, SIO_STATE_WEBSOCKET);
+
+    Packet_t *upgrade_packet = alloc_control_packet(EIO_PACKET_UPGRADE);
+    esp_err_t err = sio_send_packet_websocket(client, upgrade_packet);
+    free_packet(&upgrade_packet);
+
+    if (err != ESP_OK)
     {
-        esp_http_client_cleanup(client->posting_client);
-        client->posting_client = NULL;
+        // server never saw the upgrade, polling stays valid
+        sio_client_state_clear(client, SIO_STATE_WEBSOCKET);
+        return err;
     }
 
-#endif
-    return err;
-}
+    // one step, a reader never sees the session on neither transport
+    sio_client_state_change(client, SIO_STATE_TRANSPORT_WEBSOCKET, SIO_STATE_POLLING | SIO_STATE_POSTING);
+    posting_connection_close(client);
 
-esp_err_t sio_send_packet_websocket(sio_client_t *client, const Packet_t *packet)
-{
-    assert(false && "Not implemented");
+    ESP_LOGI(TAG, "Upgraded client %d to websocket", (int)client->client_id);
     return ESP_OK;
 }
 
-// close
-
-esp_err_t sio_client_close(sio_client_id_t clientId)
+esp_err_t sio_client_upgrade_transport(sio_client_t *client)
 {
+    esp_err_t err = sio_client_upgrade_start(client);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
 
-    Packet_t *p = (Packet_t *)calloc(1, sizeof(Packet_t));
-    p->data = calloc(1, 2);
-    p->len = 2;
-    setEioType(p, EIO_PACKET_CLOSE);
-
-    // close the listener and wait for it to close
-    sio_client_t *client = sio_client_get_and_lock(clientId);
+    if (xSemaphoreTake(client->websocket_handshake_done, pdMS_TO_TICKS(SIO_WEBSOCKET_HANDSHAKE_TIMEOUT_MS)) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Websocket probe timed out");
+        err = ESP_ERR_TIMEOUT;
+    }
+    else if (client->websocket_state != SIO_WEBSOCKET_STATE_UPGRADE)
+    {
+        ESP_LOGE(TAG, "Websocket probe failed");
+        err = ESP_FAIL;
+    }
 
-    if (client->server_session_id == NULL)
+    if (err == ESP_OK)
     {
-        ESP_LOGE(TAG, "Server session id not set, socket not connected?");
-        unlockClient(client);
-        return ESP_FAIL;
+        // Enqueuers hold the queue lock and senders the send lock, so everything queued before
+        // this point goes out over polling and everything after goes out over the websocket.
+        xSemaphoreTake(client->queue_lock, portMAX_DELAY);
+        xSemaphoreTake(client->send_lock, portMAX_DELAY);
+
+        // whatever is still queued belongs on polling, ahead of the upgrade packet
+        if (sio_client_state(client) & SIO_STATE_POLLING)
+        {
+            flush_outbound(client);
+        }
+        err = sio_client_upgrade_switch(client);
+
+        xSemaphoreGive(client->send_lock);
+        xSemaphoreGive(client->queue_lock);
     }
 
-    client->polling_client_running = false;
-    unlockClient(client);
-    // wait until the task has deleted itself
-    while (client->polling_client != NULL)
+    if (err != ESP_OK)
     {
-        vTaskDelay(1 / portTICK_PERIOD_MS); // do a yield
+        cleanup_websocket_client(client);
+        if (err != ESP_ERR_INVALID_STATE)
+        {
+            dispatch_queue_post(&client->dispatch, SIO_EVENT_UPGRADE_TRANSPORT_ERROR, 0, NULL);
+        }
     }
+    return err;
+}
 
-    sio_send_packet(clientId, p);
-    return ESP_OK;
+// sending
+
+esp_err_t sio_send_string(const sio_client_id_t clientId, const char *event, const char *data)
+{
+    return sio_send_string_to(clientId, 0, event, data);
 }
 
-bool sio_client_is_connected(sio_client_id_t clientId)
+esp_err_t sio_send_string_to(const sio_client_id_t clientId, sio_namespace_id_t nsp, const char *event, const char *data)
 {
-    sio_client_t *client = sio_client_get_and_lock(clientId);
-    bool ret = client->server_session_id != NULL && client->polling_client_running;
-    unlockClient(client);
+    char nsp_name[SIO_MAX_NAMESPACE_LEN];
+    sio_client_t *client = sio_client_get(clientId);
+    if (client == NULL || !namespace_table_get_name(&client->namespaces, nsp, nsp_name))
+    {
+        ESP_LOGE(TAG, "Unknown namespace %d", nsp);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    Packet_t *p = alloc_event_message(nsp_name, data, event, -1);
+    if (p == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = sio_send_packet(clientId, p);
+    free_packet(&p);
     return ret;
 }
-// util
 
-char *alloc_handshake_get_url(const sio_client_t *client)
+esp_err_t sio_send_string_ack(const sio_client_id_t clientId, const char *event, const char *data,
+                              sio_ack_cb_t cb, void *user_arg, uint32_t timeout_ms)
 {
+    // the ack table has its own lock and nspc never changes
+    sio_client_t *client = sio_client_get(clientId);
+    if (client == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sio_ack_table_t *acks = &client->acks;
+    const char *nsp = client->nspc;
 
-    char *token = alloc_random_string(SIO_TOKEN_SIZE);
-    size_t url_length =
-        strlen(client->transport == SIO_TRANSPORT_POLLING ? SIO_TRANSPORT_POLLING_PROTO_STRING : SIO_TRANSPORT_WEBSOCKETS_PROTO_STRING) +
-        strlen("://") +
-        strlen(client->server_address) +
-        strlen(client->sio_url_path) +
-        strlen("/?EIO=X&transport=") +
-        strlen(SIO_TRANSPORT_POLLING_STRING) +
-        strlen("&t=") + strlen(token);
-
-    char *url = calloc(1, url_length + 1);
-    if (url == NULL)
+    // registered before sending, the ack can come back before the send returns
+    uint32_t ack_id = 0;
+    esp_err_t ret = ack_table_register(acks, cb, user_arg, timeout_ms, &ack_id);
+    if (ret != ESP_OK)
     {
-        assert(false && "Failed to allocate memory for handshake url");
-        return NULL;
+        return ret;
     }
 
-    sprintf(
-        url,
-        "%s://%s%s/?EIO=%d&transport=%s&t=%s",
-        SIO_TRANSPORT_POLLING_PROTO_STRING,
-        client->server_address,
-        client->sio_url_path,
-        client->eio_version,
-        SIO_TRANSPORT_POLLING_STRING,
-        token);
+    Packet_t *p = alloc_event_message(nsp, data, event, ack_id);
+    if (p == NULL)
+    {
+        ack_table_forget(acks, ack_id);
+        return ESP_ERR_NO_MEM;
+    }
 
-    freeIfNotNull(&token);
-    return url;
+    ret = sio_send_packet(clientId, p);
+    free_packet(&p);
+    if (ret != ESP_OK)
+    {
+        ack_table_forget(acks, ack_id);
+    }
+    return ret;
 }
 
-char *alloc_post_url(const sio_client_t *client)
+esp_err_t sio_send_ack(const sio_client_id_t clientId, const Packet_t *event, const char *data)
 {
-    if (client == NULL || client->server_session_id == NULL)
+    if (event->ack_id < 0)
     {
-        ESP_LOGE(TAG, "Server session id not set, was this client initialized? Client: %p", client);
-        return NULL;
+        ESP_LOGE(TAG, "Event did not ask for an ack");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    char *token = alloc_random_string(SIO_TOKEN_SIZE);
-    size_t url_length =
-        strlen(client->transport == SIO_TRANSPORT_POLLING ? SIO_TRANSPORT_POLLING_PROTO_STRING : SIO_TRANSPORT_WEBSOCKETS_PROTO_STRING) +
-        strlen("://") +
-        strlen(client->server_address) +
-        strlen(client->sio_url_path) +
-        strlen("/?EIO=X&transport=") +
-        strlen(SIO_TRANSPORT_POLLING_STRING) +
-        strlen("&t=") + strlen(token) +
-        strlen("&sid=") + strlen(client->server_session_id);
-
-    char *url = calloc(1, url_length + 1);
-
-    if (url == NULL)
+    // the ack goes back on the namespace of the event
+    char nsp[SIO_MAX_NAMESPACE_LEN] = "/";
+    if (event->nsp != NULL)
     {
-        assert(false && "Failed to allocate memory for handshake url");
-        return NULL;
+        snprintf(nsp, sizeof(nsp), "%.*s", (int)event->nsp_len, event->nsp);
     }
 
-    sprintf(
-        url,
-        "%s://%s%s/?EIO=%d&transport=%s&t=%s&sid=%s",
-        SIO_TRANSPORT_POLLING_PROTO_STRING,
-        client->server_address,
-        client->sio_url_path,
-        client->eio_version,
-        SIO_TRANSPORT_POLLING_STRING,
-        token,
-        client->server_session_id);
-
-    freeIfNotNull(&token);
-    return url;
+    Packet_t *p = alloc_ack_message(nsp, data, event->ack_id);
+    if (p == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = sio_send_packet(clientId, p);
+    free_packet(&p);
+    return ret;
 }
 
-char *alloc_polling_get_url(const sio_client_t *client)
+// the group goes into the queue back to back, nothing gets between the header and its attachments
+static esp_err_t send_binary_polling(sio_client_t *client, const Packet_t *header,
+                                     const sio_binary_t *attachments, size_t attachment_count)
 {
-    return alloc_post_url(client);
+    Packet_t **group = calloc(attachment_count + 1, sizeof(Packet_t *));
+    if (group == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ESP_OK;
+    group[0] = alloc_packet_copy(header);
+    for (size_t i = 0; i < attachment_count && group[i] != NULL; i++)
+    {
+        group[i + 1] = alloc_base64_attachment(&attachments[i]);
+    }
+    for (size_t i = 0; i <= attachment_count; i++)
+    {
+        if (group[i] == NULL)
+        {
+            ret = ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (ret == ESP_OK)
+    {
+        ret = enqueue_owned_packets_polling(client, group, attachment_count + 1);
+    }
+    else
+    {
+        for (size_t i = 0; i <= attachment_count; i++)
+        {
+            if (group[i] != NULL)
+            {
+                free_packet(&group[i]);
+            }
+        }
+    }
+    free(group);
+    return ret;
+}
+
+static esp_err_t send_binary_websocket(sio_client_t *client, const Packet_t *header,
+                                       const sio_binary_t *attachments, size_t attachment_count)
+{
+    // header and attachments go out under one lock so no other frame gets between them
+    xSemaphoreTake(client->send_lock, portMAX_DELAY);
+    esp_err_t ret = sio_send_packet_websocket(client, header);
+
+    for (size_t i = 0; i < attachment_count && ret == ESP_OK; i++)
+    {
+        int sent = esp_websocket_client_send_bin(client->websocket_client, (const char *)attachments[i].data,
+                                                 attachments[i].len, pdMS_TO_TICKS(SIO_WEBSOCKET_SEND_TIMEOUT_MS));
+        if (sent < 0)
+        {
+            ESP_LOGE(TAG, "Websocket send of attachment %d failed", (int)i);
+            ret = ESP_FAIL;
+        }
+        else
+        {
+            metrics_count_out(&client->metrics, attachments[i].len, 1);
+        }
+    }
+    xSemaphoreGive(client->send_lock);
+    return ret;
+}
+
+esp_err_t sio_send_binary(const sio_client_id_t clientId, const char *event, const char *data,
+                          const sio_binary_t *attachments, size_t attachment_count)
+{
+    sio_client_t *client = sio_client_get(clientId);
+    if (client == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!(sio_client_state(client) & SIO_STATE_SESSION))
+    {
+        ESP_LOGE(TAG, "Server session id not set, was this client initialized?");
+        return ESP_FAIL;
+    }
+
+    Packet_t *header = alloc_binary_message(client->nspc, data, event, attachment_count);
+    if (header == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    if (sio_client_transport(client) == SIO_TRANSPORT_POLLING)
+    {
+        ret = send_binary_polling(client, header, attachments, attachment_count);
+    }
+    if (ret == ESP_ERR_INVALID_STATE && sio_client_transport(client) == SIO_TRANSPORT_WEBSOCKETS)
+    {
+        ret = send_binary_websocket(client, header, attachments, attachment_count);
+    }
+
+    free_packet(&header);
+    return ret;
+}
+
+// lock free, the namespace table has its own lock
+static bool session_up(sio_client_t *client)
+{
+    uint32_t state = sio_client_state(client);
+    uint32_t transport_up = (state & SIO_STATE_TRANSPORT_WEBSOCKET) ? SIO_STATE_WEBSOCKET : SIO_STATE_POSTING;
+    return (state & SIO_STATE_SESSION) && (state & transport_up) &&
+           namespace_table_get_state(&client->namespaces, 0) == SIO_NAMESPACE_CONNECTED;
+}
+
+// Plain events wait in the journal while the session is down, and behind the ones already
+// waiting so the order holds. Acks and ack requests make no sense after the fact.
+static bool journal_takes(sio_client_t *client, const Packet_t *packet)
+{
+    if (!client->journal_enabled || packet->sio_type != SIO_PACKET_EVENT || packet->ack_id >= 0)
+    {
+        return false;
+    }
+    return !session_up(client) || !journal_is_empty(&client->journal);
+}
+
+esp_err_t sio_send_packet(const sio_client_id_t clientId, const Packet_t *packet)
+{
+    // never takes the client lock, a post or poll in progress does not hold up the caller
+    sio_client_t *client = sio_client_get(clientId);
+    if (client == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (journal_takes(client, packet))
+    {
+        esp_err_t ret = journal_append(&client->journal, packet->data, strnlen(packet->data, packet->len));
+        if (ret == ESP_OK && session_up(client) && sio_client_transport(client) == SIO_TRANSPORT_WEBSOCKETS)
+        {
+            // nothing drains the journal on websockets but sends and received messages
+            sio_client_replay_journal(client);
+        }
+        return ret;
+    }
+
+    if (!(sio_client_state(client) & SIO_STATE_SESSION))
+    {
+        ESP_LOGE(TAG, "Server session id not set, was this client initialized?");
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    if (sio_client_transport(client) == SIO_TRANSPORT_POLLING)
+    {
+        ret = enqueue_packet_polling(client, packet);
+    }
+    if (ret == ESP_ERR_INVALID_STATE && sio_client_transport(client) == SIO_TRANSPORT_WEBSOCKETS)
+    {
+        // also where a packet that raced the upgrade ends up, right behind the upgrade packet
+        xSemaphoreTake(client->send_lock, portMAX_DELAY);
+        ret = sio_send_packet_websocket(client, packet);
+        xSemaphoreGive(client->send_lock);
+    }
+    return ret;
+}
+
+// outbound queue
+
+static esp_err_t enqueue_packet_polling(sio_client_t *client, const Packet_t *packet)
+{
+    Packet_t *copy = alloc_packet_copy(packet);
+    if (copy == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to copy packet for the send queue");
+        return ESP_ERR_NO_MEM;
+    }
+    return enqueue_owned_packets_polling(client, &copy, 1);
+}
+
+// The queue takes over the packets, the ones it does not get are freed here. They go in back to
+// back under the queue lock. ESP_ERR_INVALID_STATE when the session does not post (anymore).
+static esp_err_t enqueue_owned_packets_polling(sio_client_t *client, Packet_t **packets, size_t count)
+{
+    esp_err_t ret = ESP_OK;
+    size_t queued = 0;
+
+    xSemaphoreTake(client->queue_lock, portMAX_DELAY);
+    uint32_t state = sio_client_state(client);
+    if (!(state & SIO_STATE_POSTING))
+    {
+        if (!(state & SIO_STATE_TRANSPORT_WEBSOCKET))
+        {
+            ESP_LOGE(TAG, "Posting task not running, was this client connected?");
+        }
+        ret = ESP_ERR_INVALID_STATE;
+    }
+
+    while (ret == ESP_OK && queued < count)
+    {
+        // the posting task may free the packet as soon as it is in the queue
+        size_t len = packets[queued]->len;
+        if (xQueueSend(client->send_queue, &packets[queued], 0) == pdTRUE)
+        {
+            metrics_heap(&client->metrics, len);
+            queued++;
+            continue;
+        }
+
+        // queue is full, post what is waiting right here instead of waiting on the posting task
+        sio_client_flush_outbound(client);
+        if (uxQueueSpacesAvailable(client->send_queue) == 0)
+        {
+            ESP_LOGE(TAG, "Send queue still full");
+            ret = ESP_FAIL;
+        }
+    }
+    xSemaphoreGive(client->queue_lock);
+
+    if (queued > 0 && (state & SIO_STATE_IO_SCHEDULED))
+    {
+        io_scheduler_wake();
+    }
+    if (ret == ESP_FAIL)
+    {
+        metrics_drop_out(&client->metrics, count - queued);
+    }
+    for (size_t i = queued; i < count; i++)
+    {
+        free_packet(&packets[i]);
+    }
+    return ret;
+}
+
+// the post buffer only ever grows, steady traffic posts without touching the heap. Send lock held.
+static char *reserve_post_buffer(sio_client_t *client, size_t size)
+{
+    if (size > client->post_buffer_capacity)
+    {
+        char *bigger = realloc(client->post_buffer, size);
+        if (bigger == NULL)
+        {
+            return NULL;
+        }
+        metrics_heap(&client->metrics, size - client->post_buffer_capacity);
+        client->post_buffer = bigger;
+        client->post_buffer_capacity = size;
+    }
+    return client->post_buffer;
+}
+
+esp_err_t sio_client_flush_outbound(sio_client_t *client)
+{
+    xSemaphoreTake(client->send_lock, portMAX_DELAY);
+    esp_err_t ret = flush_outbound(client);
+    xSemaphoreGive(client->send_lock);
+    return ret;
+}
+
+// appends one record to the body in the post buffer, send lock held
+static bool post_buffer_append(sio_client_t *client, size_t *len, const char *data, size_t data_len)
+{
+    size_t at = *len == 0 ? 0 : *len + 1;
+    char *buffer = reserve_post_buffer(client, at + data_len + 1);
+    if (buffer == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate post body of %d bytes", (int)(at + data_len));
+        return false;
+    }
+    if (at > 0)
+    {
+        buffer[*len] = ASCII_RS;
+    }
+    memcpy(buffer + at, data, data_len);
+    *len = at + data_len;
+    buffer[*len] = '\0';
+    return true;
+}
+
+esp_err_t sio_client_take_outbound(sio_client_t *client, size_t *len, size_t *records)
+{
+    *len = 0;
+    *records = 0;
+
+    if (__atomic_exchange_n(&client->pong_owed, false, __ATOMIC_SEQ_CST))
+    {
+        char pong = '0' + EIO_PACKET_PONG;
+        if (post_buffer_append(client, len, &pong, 1))
+        {
+            (*records)++;
+        }
+        else
+        {
+            metrics_drop_out(&client->metrics, 1);
+        }
+    }
+
+    // as many packets as fit into the server's maxPayload, each one is a record
+    while (*records < SIO_DEFAULT_MESSAGE_QUEUE_SIZE)
+    {
+        Packet_t *packet = client->outbound_carry;
+        client->outbound_carry = NULL;
+        if (packet == NULL)
+        {
+            if (xQueueReceive(client->send_queue, &packet, 0) != pdTRUE)
+            {
+                break;
+            }
+            metrics_heap(&client->metrics, -(int32_t)packet->len);
+        }
+
+        size_t packet_len = strnlen(packet->data, packet->len);
+        if (*records > 0 && *len + 1 + packet_len > client->server_max_payload)
+        {
+            // opens the next post
+            client->outbound_carry = packet;
+            break;
+        }
+        if (post_buffer_append(client, len, packet->data, packet_len))
+        {
+            (*records)++;
+        }
+        else
+        {
+            metrics_drop_out(&client->metrics, 1);
+        }
+        free_packet(&packet);
+    }
+    return *records > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+// call with the send lock held
+static esp_err_t flush_outbound(sio_client_t *client)
+{
+    esp_err_t ret = ESP_OK;
+    size_t len = 0;
+    size_t records = 0;
+    // bounded, whatever emitters keep queueing meanwhile goes out with the next flush
+    for (int posts = 0; posts < SIO_DEFAULT_MESSAGE_QUEUE_SIZE && sio_client_take_outbound(client, &len, &records) == ESP_OK; posts++)
+    {
+        Packet_t batch = {
+            .eio_type = EIO_PACKET_MESSAGE,
+            .sio_type = SIO_PACKET_NONE,
+            .json_start = NULL,
+            .data = client->post_buffer,
+            .len = len};
+
+        ESP_LOGD(TAG, "Posting %d packets in one request", (int)records);
+        esp_err_t err = sio_send_packet_polling(client, &batch);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Lost %d queued packets: %s", (int)records, esp_err_to_name(err));
+            metrics_drop_out(&client->metrics, records);
+            ret = err;
+        }
+    }
+    return ret;
+}
+
+// journal
+
+static esp_err_t replay_batch_polling(const char *records, size_t len, size_t count, void *arg)
+{
+    Packet_t batch = {
+        .eio_type = EIO_PACKET_MESSAGE,
+        .sio_type = SIO_PACKET_NONE,
+        .json_start = NULL,
+        .data = (char *)records,
+        .len = len};
+    return sio_send_packet_polling((sio_client_t *)arg, &batch);
+}
+
+static size_t replay_batch_bytes(const sio_client_t *client)
+{
+    return client->server_max_payload < SIO_JOURNAL_REPLAY_BATCH ? client->server_max_payload : SIO_JOURNAL_REPLAY_BATCH;
+}
+
+static char *reserve_replay_batch(size_t size, void *arg)
+{
+    return reserve_post_buffer((sio_client_t *)arg, size);
+}
+
+esp_err_t sio_client_take_journal(sio_client_t *client, sio_journal_batch_t *batch)
+{
+    if (!client->journal_enabled || !session_up(client))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return journal_peek(&client->journal, replay_batch_bytes(client), 0, reserve_replay_batch, client, batch);
+}
+
+esp_err_t sio_client_replay_journal(sio_client_t *client)
+{
+    if (!client->journal_enabled || !session_up(client) || journal_is_empty(&client->journal))
+    {
+        return ESP_OK;
+    }
+
+    if (sio_client_transport(client) == SIO_TRANSPORT_WEBSOCKETS)
+    {
+        return websocket_replay_journal(client, client->websocket_client, portMAX_DELAY);
+    }
+
+    size_t batch_bytes = replay_batch_bytes(client);
+    xSemaphoreTake(client->send_lock, portMAX_DELAY);
+    esp_err_t err = journal_replay(&client->journal, batch_bytes, portMAX_DELAY, replay_batch_polling, client);
+    xSemaphoreGive(client->send_lock);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Journal replay stopped, trying again later: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t sio_client_send_pong(sio_client_t *client)
+{
+    uint32_t state = sio_client_state(client);
+    if (!(state & SIO_STATE_TRANSPORT_WEBSOCKET) && (state & SIO_STATE_IO_SCHEDULED))
+    {
+        // the shared I/O task answers from in between its polls and must never wait for the
+        // queue lock, its next post carries the pong ahead of the queue
+        __atomic_store_n(&client->pong_owed, true, __ATOMIC_SEQ_CST);
+        return ESP_OK;
+    }
+
+    Packet_t *pong = alloc_control_packet(EIO_PACKET_PONG);
+    if (pong == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // an upgrade or close changes the transport under the queue lock, a pong queued after
+    // the switch would never be posted
+    xSemaphoreTake(client->queue_lock, portMAX_DELAY);
+    state = sio_client_state(client);
+
+    esp_err_t ret = ESP_OK;
+    if (state & SIO_STATE_TRANSPORT_WEBSOCKET)
+    {
+        // the session never goes back to polling, the frame can go out without the lock
+        xSemaphoreGive(client->queue_lock);
+        int sent = esp_websocket_client_send_text(client->websocket_client, pong->data, pong->len, pdMS_TO_TICKS(SIO_WEBSOCKET_SEND_TIMEOUT_MS));
+        ret = sent < 0 ? ESP_FAIL : ESP_OK;
+        if (ret == ESP_OK)
+        {
+            metrics_count_out(&client->metrics, pong->len, 1);
+        }
+        free_packet(&pong);
+        return ret;
+    }
+
+    size_t len = pong->len;
+    if (!(state & SIO_STATE_POSTING))
+    {
+        ESP_LOGW(TAG, "Session does not post anymore, pong dropped");
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else if (xQueueSendToFront(client->send_queue, &pong, 0) != pdTRUE)
+    {
+        // the queue is full, so the posting task is about to post anyway
+        ESP_LOGW(TAG, "Send queue full, pong dropped");
+        ret = ESP_FAIL;
+    }
+    xSemaphoreGive(client->queue_lock);
+
+    if (ret != ESP_OK)
+    {
+        metrics_drop_out(&client->metrics, 1);
+        free_packet(&pong);
+        return ret;
+    }
+    metrics_heap(&client->metrics, len);
+    return ret;
+}
+
+void sio_client_heartbeat_expired(void *arg)
+{
+    sio_client_t *client = (sio_client_t *)arg;
+
+    if (sio_client_transport(client) == SIO_TRANSPORT_WEBSOCKETS)
+    {
+        // a half-open socket can look fine for minutes, end the session right away
+        websocket_session_dead(client);
+    }
+    // a polling GET times out after the same window and ends the session on its own,
+    // polling_handle_response does not retry a timed out GET
+}
+
+// reconnect
+
+void sio_client_schedule_reconnect(sio_client_t *client)
+{
+    if (!client->reconnect)
+    {
+        return;
+    }
+    // the polling task, the websocket handler and the heartbeat can all get here, one of them starts the task
+    if (sio_client_state_set(client, SIO_STATE_RECONNECTING) & SIO_STATE_RECONNECTING)
+    {
+        return;
+    }
+    // sio_client_close stores the flag before it looks at the state, one of us sees the other
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bool cancelled = __atomic_load_n(&client->reconnect_cancelled, __ATOMIC_SEQ_CST);
+    if (!cancelled && xTaskCreate(&sio_reconnect_task, "sio_reconnect", 4096, (void *)&client->client_id, 5, NULL) == pdPASS)
+    {
+        return;
+    }
+    if (!cancelled)
+    {
+        ESP_LOGE(TAG, "Failed to start reconnect task");
+    }
+    sio_client_state_clear(client, SIO_STATE_RECONNECTING);
+    xSemaphoreGive(client->reconnect_done);
+}
+
+esp_err_t sio_client_reconnect(sio_client_t *client)
+{
+    lockClient(client);
+    if (__atomic_load_n(&client->reconnect_cancelled, __ATOMIC_SEQ_CST))
+    {
+        unlockClient(client);
+        return ESP_ERR_INVALID_STATE;
+    }
+    // start over the way the config asked for, an upgrade happens again if wanted
+    sio_client_set_transport(client, client->preferred_transport);
+    esp_err_t err = handshake(client);
+    unlockClient(client);
+
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    // the handshake connected namespace 0, the others come back with their recovery ids too
+    for (sio_namespace_id_t id = 1; id < SIO_MAX_NAMESPACES; id++)
+    {
+        if (namespace_table_get_state(&client->namespaces, id) != SIO_NAMESPACE_DISCONNECTED)
+        {
+            continue;
+        }
+        Packet_t *p = namespace_table_alloc_connect(&client->namespaces, id, NULL);
+        if (p == NULL)
+        {
+            continue;
+        }
+        namespace_table_set_state(&client->namespaces, id, SIO_NAMESPACE_CONNECTING);
+        if (sio_send_packet(client->client_id, p) != ESP_OK)
+        {
+            namespace_table_set_state(&client->namespaces, id, SIO_NAMESPACE_DISCONNECTED);
+        }
+        free_packet(&p);
+    }
+    return ESP_OK;
+}
+
+// posting connection
+
+// Sets up the keep-alive posting connection during the handshake. The socket itself
+// is opened by the first post (the socketio connect right after the handshake)
+// and reused by every post after that.
+static esp_err_t posting_connection_open(sio_client_t *client)
+{
+    if (http_conn_is_open(&client->posting_conn))
+    {
+        return ESP_OK;
+    }
+
+    // posts are never cached, the connection keeps the token of its url for the whole session
+    const char *url = sio_client_session_url(client);
+    if (url == NULL)
+    {
+        return ESP_FAIL;
+    }
+    return http_conn_open(&client->posting_conn, url, 0, true, &client->server_addr, client->server_addr_len);
+}
+
+static void posting_connection_close(sio_client_t *client)
+{
+    http_conn_close(&client->posting_conn);
+}
+
+// records in a post body, batches separate them with ASCII_RS
+static uint32_t count_records(const char *data, size_t len)
+{
+    uint32_t records = 1;
+    const char *end = data + len;
+    while ((data = memchr(data, ASCII_RS, end - data)) != NULL)
+    {
+        records++;
+        data++;
+    }
+    return records;
+}
+
+esp_err_t sio_client_post_done(sio_client_t *client, esp_err_t err, int64_t started_us, const char *body, size_t len)
+{
+    PacketPointerArray_t posting_packets = client->posting_rx.packets;
+    client->posting_rx.packets = NULL;
+
+    if (err == ESP_OK && client->posting_conn.status != 200)
+    {
+        ESP_LOGE(TAG, "HTTP POST request failed with status code %d", client->posting_conn.status);
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+
+    metrics_post(&client->metrics, started_us, err == ESP_OK && posting_packets != NULL);
+    if (err == ESP_OK)
+    {
+        metrics_count_out(&client->metrics, len, count_records(body, len));
+    }
+
+    if (err != ESP_OK || posting_packets == NULL)
+    {
+        // the connection starts over with a new socket after a failed request
+        ESP_LOGE(TAG, "HTTP POST request failed: %s response: %p ", esp_err_to_name(err), posting_packets);
+        goto cleanup;
+    }
+
+    if (get_array_size(posting_packets) != 1)
+    {
+        ESP_LOGE(TAG, "Expected one 'ok' from server, got something else");
+        goto cleanup;
+    }
+
+    // allocate posting user if not present
+    if (posting_packets[0]->eio_type == EIO_PACKET_OK_SERVER)
+    {
+        ESP_LOGD(TAG, "Ok from server response array %p", posting_packets);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Not ok from server after send");
+    }
+
+cleanup:
+    if (posting_packets != NULL)
+    {
+        free_packet_arr(&posting_packets);
+    }
+    return err;
+}
+
+// call with the send lock held
+esp_err_t sio_send_packet_polling(sio_client_t *client, const Packet_t *packet)
+{
+    if (!http_conn_is_open(&client->posting_conn))
+    {
+        ESP_LOGE(TAG, "Posting connection not open, was this client connected?");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    http_rx_context_reset(&client->posting_rx);
+    size_t len = strnlen(packet->data, packet->len);
+
+    // a kept alive socket the server dropped meanwhile is replaced once by the connection itself
+    int64_t started_us = esp_timer_get_time();
+    esp_err_t err = http_conn_perform(&client->posting_conn, packet->data, len, SIO_POST_TIMEOUT_MS);
+    return sio_client_post_done(client, err, started_us, packet->data, len);
+}
+
+// call with the send lock held
+esp_err_t sio_send_packet_websocket(sio_client_t *client, const Packet_t *packet)
+{
+    if (!(sio_client_state(client) & SIO_STATE_WEBSOCKET) || client->websocket_client == NULL)
+    {
+        ESP_LOGE(TAG, "Websocket not connected");
+        return ESP_FAIL;
+    }
+
+    // frames carry their own length, the protocol has no trailing terminator
+    size_t len = strnlen(packet->data, packet->len);
+
+    int sent = esp_websocket_client_send_text(client->websocket_client, packet->data, len, pdMS_TO_TICKS(SIO_WEBSOCKET_SEND_TIMEOUT_MS));
+    if (sent < 0)
+    {
+        ESP_LOGE(TAG, "Websocket send failed");
+        return ESP_FAIL;
+    }
+    metrics_count_out(&client->metrics, len, 1);
+    return ESP_OK;
+}
+
+// close
+
+// namespaces
+
+sio_namespace_id_t sio_namespace_connect(const sio_client_id_t clientId, const char *nsp, const char *auth)
+{
+    // the namespace table has its own lock
+    sio_client_t *client = sio_client_get(clientId);
+    sio_namespace_id_t id = client == NULL ? -1 : namespace_table_add(&client->namespaces, nsp);
+    if (id < 0)
+    {
+        return -1;
+    }
+
+    Packet_t *p = namespace_table_alloc_connect(&client->namespaces, id, auth);
+    if (p == NULL)
+    {
+        return -1;
+    }
+
+    namespace_table_set_state(&client->namespaces, id, SIO_NAMESPACE_CONNECTING);
+    esp_err_t ret = sio_send_packet(clientId, p);
+    free_packet(&p);
+    if (ret != ESP_OK)
+    {
+        namespace_table_set_state(&client->namespaces, id, SIO_NAMESPACE_DISCONNECTED);
+        return -1;
+    }
+    return id;
+}
+
+esp_err_t sio_namespace_disconnect(const sio_client_id_t clientId, sio_namespace_id_t nsp)
+{
+    char nsp_name[SIO_MAX_NAMESPACE_LEN];
+    sio_client_t *client = sio_client_get(clientId);
+    if (client == NULL || !namespace_table_get_name(&client->namespaces, nsp, nsp_name))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    Packet_t *p = alloc_namespace_message(nsp_name, SIO_PACKET_DISCONNECT, NULL);
+    if (p == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = sio_send_packet(clientId, p);
+    free_packet(&p);
+
+    // the server does not answer a disconnect, forget the namespace right away
+    namespace_table_set_state(&client->namespaces, nsp, SIO_NAMESPACE_DISCONNECTED);
+    namespace_table_remove(&client->namespaces, nsp);
+    return ret;
+}
+
+sio_namespace_id_t sio_namespace_find(const sio_client_id_t clientId, const char *nsp)
+{
+    sio_client_t *client = sio_client_get(clientId);
+    return client == NULL ? -1 : namespace_table_find(&client->namespaces, nsp, strlen(nsp));
+}
+
+bool sio_namespace_recovered(const sio_client_id_t clientId, sio_namespace_id_t nsp)
+{
+    sio_client_t *client = sio_client_get(clientId);
+    return client != NULL && namespace_table_recovered(&client->namespaces, nsp);
+}
+
+// event handlers
+
+esp_err_t sio_on(const sio_client_id_t clientId, const char *event, sio_on_handler_t handler, void *ctx)
+{
+    return sio_on_namespace(clientId, 0, event, handler, ctx);
+}
+
+esp_err_t sio_off(const sio_client_id_t clientId, const char *event)
+{
+    return sio_off_namespace(clientId, 0, event);
+}
+
+esp_err_t sio_on_namespace(const sio_client_id_t clientId, sio_namespace_id_t nsp, const char *event,
+                           sio_on_handler_t handler, void *ctx)
+{
+    if (nsp < 0 || nsp >= SIO_MAX_NAMESPACES)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // the table has its own lock
+    sio_client_t *client = sio_client_get(clientId);
+    return client == NULL ? ESP_ERR_INVALID_ARG : event_handler_table_add(&client->handlers, nsp, event, handler, ctx);
+}
+
+esp_err_t sio_off_namespace(const sio_client_id_t clientId, sio_namespace_id_t nsp, const char *event)
+{
+    sio_client_t *client = sio_client_get(clientId);
+    return client == NULL ? ESP_ERR_INVALID_ARG : event_handler_table_remove(&client->handlers, nsp, event);
+}
+
+esp_err_t sio_client_close(sio_client_id_t clientId)
+{
+
+    // a reconnect in progress gives up first
+    sio_client_t *client = sio_client_get_and_lock(clientId);
+    __atomic_store_n(&client->reconnect_cancelled, true, __ATOMIC_SEQ_CST);
+    unlockClient(client);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // pairs with sio_client_schedule_reconnect
+    if (sio_client_state(client) & SIO_STATE_RECONNECTING)
+    {
+        xSemaphoreGive(client->reconnect_wake);
+        // every clear of the flag is followed by a give, a leftover one only costs another look
+        while (sio_client_state(client) & SIO_STATE_RECONNECTING)
+        {
+            xSemaphoreTake(client->reconnect_done, portMAX_DELAY);
+        }
+    }
+
+    Packet_t *p = alloc_control_packet(EIO_PACKET_CLOSE);
+
+    // close the listener and wait for it to close
+    client = sio_client_get_and_lock(clientId);
+
+    if (client->server_session_id == NULL)
+    {
+        ESP_LOGE(TAG, "Server session id not set, socket not connected?");
+        unlockClient(client);
+        free_packet(&p);
+        return ESP_FAIL;
+    }
+
+    if (sio_client_transport(client) == SIO_TRANSPORT_WEBSOCKETS)
+    {
+        xSemaphoreTake(client->send_lock, portMAX_DELAY);
+        sio_send_packet_websocket(client, p);
+        // the handler would report the close as a lost connection otherwise
+        sio_client_state_clear(client, SIO_STATE_WEBSOCKET);
+        xSemaphoreGive(client->send_lock);
+        free_packet(&p);
+        unlockClient(client);
+
+        heartbeat_stop(&client->heartbeat);
+        esp_websocket_client_close(client->websocket_client, pdMS_TO_TICKS(SIO_WEBSOCKET_SEND_TIMEOUT_MS));
+        ack_table_cancel_all(&client->acks);
+        namespace_table_session_lost(&client->namespaces);
+        return ESP_OK;
+    }
+
+    sio_client_state_clear(client, SIO_STATE_POLLING);
+    heartbeat_stop(&client->heartbeat);
+    unlockClient(client);
+    io_scheduler_wake();
+    // wait until the task has deleted itself, or the shared one let go of the client
+    while (client->polling_task != NULL || (sio_client_state(client) & SIO_STATE_IO_SCHEDULED))
+    {
+        vTaskDelay(1 / portTICK_PERIOD_MS); // do a yield
+    }
+
+    sio_send_packet(clientId, p);
+    free_packet(&p);
+
+    // post the close together with anything still queued, nothing gets queued after it
+    xSemaphoreTake(client->queue_lock, portMAX_DELAY);
+    xSemaphoreTake(client->send_lock, portMAX_DELAY);
+    flush_outbound(client);
+    sio_client_state_clear(client, SIO_STATE_POSTING);
+    posting_connection_close(client);
+    xSemaphoreGive(client->send_lock);
+    xSemaphoreGive(client->queue_lock);
+
+    while (client->posting_task != NULL)
+    {
+        vTaskDelay(1 / portTICK_PERIOD_MS); // do a yield
+    }
+
+    // nothing can be acknowledged anymore
+    ack_table_cancel_all(&client->acks);
+    namespace_table_session_lost(&client->namespaces);
+    return ESP_OK;
+}
+
+bool sio_client_is_connected(sio_client_id_t clientId)
+{
+    sio_client_t *client = sio_client_get(clientId);
+    if (client == NULL)
+    {
+        return false;
+    }
+    uint32_t state = sio_client_state(client);
+    return (state & SIO_STATE_SESSION) && (state & (SIO_STATE_POLLING | SIO_STATE_WEBSOCKET));
+}
+// util
+
+esp_err_t sio_client_apply_open_packet(sio_client_t *client, const Packet_t *packet)
+{
+    if (packet->eio_type != EIO_PACKET_OPEN || packet->json_start == NULL)
+    {
+        ESP_LOGE(TAG, "Expected open packet, got %d", packet->eio_type);
+        return ESP_FAIL;
+    }
+
+    cJSON *json = cJSON_Parse(packet->json_start);
+    if (json == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to parse JSON: %s", cJSON_GetErrorPtr());
+        const char *error_ptr = cJSON_GetErrorPtr();
+        if (error_ptr != NULL)
+        {
+            fprintf(stderr, "Error before: %s\n", error_ptr);
+        }
+
+        return ESP_FAIL;
+    };
+
+    cJSON *sid = cJSON_GetObjectItemCaseSensitive(json, "sid");
+    if (!cJSON_IsString(sid))
+    {
+        ESP_LOGE(TAG, "Open packet without session id");
+        cJSON_Delete(json);
+        return ESP_FAIL;
+    }
+
+    sio_client_state_clear(client, SIO_STATE_SESSION);
+    freeIfNotNull(&client->server_session_id);
+    client->server_session_id = strdup(sid->valuestring);
+
+    // every poll and post of the session goes to this url, only the token changes
+    freeIfNotNull(&client->session_url);
+    client->session_url = alloc_post_url(client);
+    const char *token = client->session_url == NULL ? NULL : strstr(client->session_url, "&t=");
+    if (token == NULL)
+    {
+        cJSON_Delete(json);
+        return ESP_ERR_NO_MEM;
+    }
+    client->session_url_token = token + strlen("&t=") - client->session_url;
+    // both can go past 16 bits, missing ones count as 0
+    cJSON *ping_interval = cJSON_GetObjectItemCaseSensitive(json, "pingInterval");
+    cJSON *ping_timeout = cJSON_GetObjectItemCaseSensitive(json, "pingTimeout");
+    client->server_ping_interval_ms = cJSON_IsNumber(ping_interval) && ping_interval->valuedouble > 0 ? (uint32_t)ping_interval->valuedouble : 0;
+    client->server_ping_timeout_ms = cJSON_IsNumber(ping_timeout) && ping_timeout->valuedouble > 0 ? (uint32_t)ping_timeout->valuedouble : 0;
+
+    cJSON *max_payload = cJSON_GetObjectItemCaseSensitive(json, "maxPayload");
+    client->server_max_payload = cJSON_IsNumber(max_payload) ? (uint32_t)max_payload->valuedouble : SIO_DEFAULT_MAX_PAYLOAD;
+
+    sio_client_state_set(client, SIO_STATE_SESSION);
+
+    client->server_upgrade_websocket = false;
+    cJSON *upgrades = cJSON_GetObjectItemCaseSensitive(json, "upgrades");
+    for (int i = 0; i < cJSON_GetArraySize(upgrades); i++)
+    {
+        cJSON *upgrade = cJSON_GetArrayItem(upgrades, i);
+        if (cJSON_IsString(upgrade) && strcmp(upgrade->valuestring, SIO_TRANSPORT_WEBSOCKETS_STRING) == 0)
+        {
+            client->server_upgrade_websocket = true;
+        }
+    }
+    cJSON_Delete(json);
+
+    // the server pings every pingInterval and gives up after pingTimeout, so do we
+    heartbeat_start(&client->heartbeat, client->server_ping_interval_ms, client->server_ping_timeout_ms);
+    return ESP_OK;
+}
+
+char *alloc_handshake_get_url(const sio_client_t *client)
+{
+
+    bool polling = sio_client_transport(client) == SIO_TRANSPORT_POLLING;
+    const char *proto = polling ? SIO_TRANSPORT_POLLING_PROTO_STRING : SIO_TRANSPORT_WEBSOCKETS_PROTO_STRING;
+    const char *transport = polling ? SIO_TRANSPORT_POLLING_STRING : SIO_TRANSPORT_WEBSOCKETS_STRING;
+
+    char *token = alloc_random_string(SIO_TOKEN_SIZE);
+    size_t url_length =
+        strlen(proto) +
+        strlen("://") +
+        strlen(client->server_address) +
+        strlen(client->sio_url_path) +
+        strlen("/?EIO=X&transport=") +
+        strlen(transport) +
+        strlen("&t=") + strlen(token);
+
+    char *url = calloc(1, url_length + 1);
+    if (url == NULL)
+    {
+        assert(false && "Failed to allocate memory for handshake url");
+        return NULL;
+    }
+
+    sprintf(
+        url,
+        "%s://%s%s/?EIO=%d&transport=%s&t=%s",
+        proto,
+        client->server_address,
+        client->sio_url_path,
+        client->eio_version,
+        transport,
+        token);
+
+    freeIfNotNull(&token);
+    return url;
+}
+
+static char *alloc_session_url(const sio_client_t *client, const char *proto, const char *transport)
+{
+    if (client == NULL || client->server_session_id == NULL)
+    {
+        ESP_LOGE(TAG, "Server session id not set, was this client initialized? Client: %p", client);
+        return NULL;
+    }
+
+    char *token = alloc_random_string(SIO_TOKEN_SIZE);
+    size_t url_length =
+        strlen(proto) +
+        strlen("://") +
+        strlen(client->server_address) +
+        strlen(client->sio_url_path) +
+        strlen("/?EIO=X&transport=") +
+        strlen(transport) +
+        strlen("&t=") + strlen(token) +
+        strlen("&sid=") + strlen(client->server_session_id);
+
+    char *url = calloc(1, url_length + 1);
+
+    if (url == NULL)
+    {
+        assert(false && "Failed to allocate memory for handshake url");
+        return NULL;
+    }
+
+    sprintf(
+        url,
+        "%s://%s%s/?EIO=%d&transport=%s&t=%s&sid=%s",
+        proto,
+        client->server_address,
+        client->sio_url_path,
+        client->eio_version,
+        transport,
+        token,
+        client->server_session_id);
+
+    freeIfNotNull(&token);
+    return url;
+}
+
+char *alloc_post_url(const sio_client_t *client)
+{
+    return alloc_session_url(client, SIO_TRANSPORT_POLLING_PROTO_STRING, SIO_TRANSPORT_POLLING_STRING);
+}
+
+char *alloc_websocket_upgrade_url(const sio_client_t *client)
+{
+    return alloc_session_url(client, SIO_TRANSPORT_WEBSOCKETS_PROTO_STRING, SIO_TRANSPORT_WEBSOCKETS_STRING);
+}
+
+char *alloc_polling_get_url(const sio_client_t *client)
+{
+    return alloc_post_url(client);
+}
+
+const char *sio_client_session_url(sio_client_t *client)
+{
+    if (client->session_url == NULL)
+    {
+        return NULL;
+    }
+    util_token_next(client->session_url + client->session_url_token, SIO_TOKEN_SIZE);
+    return client->session_url;
 }
\ No newline at end of file
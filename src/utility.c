@@ -4,6 +4,7 @@
 
 static const char *TAG = "[sio:util]";
 static const char token_charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+static const char base64_charset[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 void freeIfNotNull(void **ptr)
 {
@@ -23,7 +24,7 @@ char *alloc_random_string(const size_t length)
     {
         for (int n = 0; n < length; n++)
         {
-            randomString[n] = token_charset[rand() % sizeof(token_charset) - 1];
+            randomString[n] = token_charset[rand() % (sizeof(token_charset) - 1)];
         }
 
         randomString[length] = '\0';
@@ -36,6 +37,164 @@ char *alloc_random_string(const size_t length)
     return randomString;
 }
 
+void util_token_next(char *token, size_t len)
+{
+    // odometer over the charset, the last character turns fastest
+    for (size_t i = len; i-- > 0;)
+    {
+        const char *at = strchr(token_charset, token[i]);
+        size_t next = at == NULL ? 0 : (at - token_charset) + 1;
+        token[i] = token_charset[next % (sizeof(token_charset) - 1)];
+        if (next < sizeof(token_charset) - 1)
+        {
+            return;
+        }
+    }
+}
+
+size_t util_base64_encoded_len(size_t len)
+{
+    return 4 * ((len + 2) / 3);
+}
+
+void util_base64_encode(const uint8_t *src, size_t len, char *dst)
+{
+    size_t i = 0;
+    for (; i + 2 < len; i += 3)
+    {
+        uint32_t triple = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+        *dst++ = base64_charset[(triple >> 18) & 0x3F];
+        *dst++ = base64_charset[(triple >> 12) & 0x3F];
+        *dst++ = base64_charset[(triple >> 6) & 0x3F];
+        *dst++ = base64_charset[triple & 0x3F];
+    }
+
+    if (i < len)
+    {
+        uint32_t triple = src[i] << 16;
+        if (i + 1 < len)
+        {
+            triple |= src[i + 1] << 8;
+        }
+        *dst++ = base64_charset[(triple >> 18) & 0x3F];
+        *dst++ = base64_charset[(triple >> 12) & 0x3F];
+        *dst++ = i + 1 < len ? base64_charset[(triple >> 6) & 0x3F] : '=';
+        *dst++ = '=';
+    }
+}
+
+static int base64_value(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+int util_base64_decode_in_place(char *data, size_t len)
+{
+    // every 4 characters read give at most 3 bytes written, writing never overtakes reading
+    size_t write_i = 0;
+    uint32_t bits = 0;
+    int bit_count = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (data[i] == '=')
+        {
+            break;
+        }
+        int value = base64_value(data[i]);
+        if (value < 0)
+        {
+            return -1;
+        }
+        bits = (bits << 6) | value;
+        bit_count += 6;
+        if (bit_count >= 8)
+        {
+            bit_count -= 8;
+            data[write_i++] = (char)((bits >> bit_count) & 0xFF);
+        }
+    }
+    return write_i;
+}
+
+size_t util_json_escape(char *dst, const char *src, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t out = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)src[i];
+        char short_escape = 0;
+        switch (c)
+        {
+        case '"':
+            short_escape = '"';
+            break;
+        case '\\':
+            short_escape = '\\';
+            break;
+        case '\b':
+            short_escape = 'b';
+            break;
+        case '\f':
+            short_escape = 'f';
+            break;
+        case '\n':
+            short_escape = 'n';
+            break;
+        case '\r':
+            short_escape = 'r';
+            break;
+        case '\t':
+            short_escape = 't';
+            break;
+        default:
+            break;
+        }
+
+        if (short_escape != 0)
+        {
+            if (dst != NULL)
+            {
+                dst[out] = '\\';
+                dst[out + 1] = short_escape;
+            }
+            out += 2;
+        }
+        else if (c < 0x20)
+        {
+            // remaining control characters as \u00XX, everything else passes through as utf-8
+            if (dst != NULL)
+            {
+                memcpy(dst + out, "\\u00", 4);
+                dst[out + 4] = hex[c >> 4];
+                dst[out + 5] = hex[c & 0x0F];
+            }
+            out += 6;
+        }
+        else
+        {
+            if (dst != NULL)
+            {
+                dst[out] = c;
+            }
+            out++;
+        }
+    }
+    return out;
+}
+
 #if false
 
 char *util_str_cat(char *destination, char *source)
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <sio_client.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define LOOPBACK_DEFAULT_SERVER "127.0.0.1:8080"
+#define LOOPBACK_CONNECT_TIMEOUT_MS 10000
+#define LOOPBACK_REPLY_TIMEOUT_MS 5000
+
+// One client against the stand-in server, the event handler and sio_on callbacks fill it in
+typedef struct
+{
+    sio_client_id_t id;
+    SemaphoreHandle_t connected; // given when namespace 0 connects
+    SemaphoreHandle_t reply;     // given per echo and ack
+    uint32_t disconnects;        // SIO_EVENT_DISCONNECTED seen
+    char echo[64];               // first argument of the last bench_echo
+    int64_t ack_value;           // first argument of the last bench_sync ack, -1 without one
+} loopback_client_t;
+
+// host:port from SIO_TEST_SERVER
+const char *loopback_server(void);
+
+// connects and waits for namespace 0, fails the test otherwise
+void loopback_start(loopback_client_t *lc, sio_transport_t transport, bool upgrade);
+// closes if still connected and destroys the client
+void loopback_stop(loopback_client_t *lc);
+
+// bench_echo with text as the only argument, waits until it came back
+void loopback_echo(loopback_client_t *lc, const char *text);
+// bench_sync with an ack, returns the number of bench_sink events the server counted
+int64_t loopback_sync(loopback_client_t *lc);
+
+void test_websocket_cases(void);
+void test_polling_cases(void);
@@ -0,0 +1,133 @@
+// Loopback tests against bench/server/sio_stand_in.py, run_tests.py starts the server and runs
+// both configurations.
+//
+//   SIO_TEST_SERVER  host:port of the stand-in server, 127.0.0.1:8080
+
+#include "test_loopback.h"
+
+#include <sio_event_view.h>
+#include <unity.h>
+#include <esp_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *loopback_server(void)
+{
+    const char *server = getenv("SIO_TEST_SERVER");
+    return server != NULL ? server : LOOPBACK_DEFAULT_SERVER;
+}
+
+static void on_client_event(void *handler_arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    loopback_client_t *lc = (loopback_client_t *)handler_arg;
+    sio_event_data_t *data = (sio_event_data_t *)event_data;
+
+    if (data->client_id == lc->id)
+    {
+        if (event_id == SIO_EVENT_NAMESPACE_CONNECTED && data->namespace_id == 0)
+        {
+            xSemaphoreGive(lc->connected);
+        }
+        else if (event_id == SIO_EVENT_DISCONNECTED)
+        {
+            lc->disconnects++;
+        }
+    }
+    // the packets belong to the receiver
+    if (data->packets_pointer != NULL)
+    {
+        free_packet_arr(&data->packets_pointer);
+    }
+}
+
+static void on_echo(sio_client_id_t client_id, const Packet_t *packet, const sio_event_view_t *view, void *ctx)
+{
+    loopback_client_t *lc = (loopback_client_t *)ctx;
+    if (view->arg_count < 1 || sio_arg_copy_string(&view->args[0], lc->echo, sizeof(lc->echo)) != ESP_OK)
+    {
+        lc->echo[0] = '\0';
+    }
+    xSemaphoreGive(lc->reply);
+}
+
+static void on_sync_ack(sio_client_id_t client_id, sio_ack_status_t status, const Packet_t *ack, void *user_arg)
+{
+    loopback_client_t *lc = (loopback_client_t *)user_arg;
+    sio_event_view_t view;
+    lc->ack_value = -1;
+    if (status == SIO_ACK_RECEIVED && sio_event_view_parse(&view, ack) == ESP_OK && view.arg_count > 0)
+    {
+        sio_arg_get_int(&view.args[0], &lc->ack_value);
+    }
+    xSemaphoreGive(lc->reply);
+}
+
+void loopback_start(loopback_client_t *lc, sio_transport_t transport, bool upgrade)
+{
+    memset(lc, 0, sizeof(loopback_client_t));
+    lc->ack_value = -1;
+    lc->connected = xSemaphoreCreateBinary();
+    lc->reply = xSemaphoreCreateCounting(1000, 0);
+    TEST_ASSERT_NOT_NULL(lc->connected);
+    TEST_ASSERT_NOT_NULL(lc->reply);
+
+    sio_client_config_t config = {
+        .server_address = loopback_server(),
+        .base_mac = "00:00:00:00:00:00",
+        .transport = transport,
+        .upgrade_transport = upgrade,
+    };
+    lc->id = sio_client_init(&config);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, lc->id);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_handler_register(SIO_EVENT, ESP_EVENT_ANY_ID, on_client_event, lc));
+    TEST_ASSERT_EQUAL(ESP_OK, sio_on(lc->id, "bench_echo", on_echo, lc));
+
+    TEST_ASSERT_EQUAL(ESP_OK, sio_client_begin(lc->id));
+    TEST_ASSERT_TRUE_MESSAGE(xSemaphoreTake(lc->connected, pdMS_TO_TICKS(LOOPBACK_CONNECT_TIMEOUT_MS)) == pdTRUE,
+                             "namespace connect timed out");
+    TEST_ASSERT_TRUE(sio_client_is_connected(lc->id));
+}
+
+void loopback_stop(loopback_client_t *lc)
+{
+    if (sio_client_is_connected(lc->id))
+    {
+        sio_client_close(lc->id);
+    }
+    sio_client_destroy(lc->id);
+    esp_event_handler_unregister(SIO_EVENT, ESP_EVENT_ANY_ID, on_client_event);
+    vSemaphoreDelete(lc->connected);
+    vSemaphoreDelete(lc->reply);
+}
+
+void loopback_echo(loopback_client_t *lc, const char *text)
+{
+    char data[80];
+    snprintf(data, sizeof(data), "\"%s\"", text);
+    lc->echo[0] = '\0';
+    TEST_ASSERT_EQUAL(ESP_OK, sio_send_string(lc->id, "bench_echo", data));
+    TEST_ASSERT_TRUE_MESSAGE(xSemaphoreTake(lc->reply, pdMS_TO_TICKS(LOOPBACK_REPLY_TIMEOUT_MS)) == pdTRUE,
+                             "no echo");
+    TEST_ASSERT_EQUAL_STRING(text, lc->echo);
+}
+
+int64_t loopback_sync(loopback_client_t *lc)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, sio_send_string_ack(lc->id, "bench_sync", "0", on_sync_ack, lc, LOOPBACK_REPLY_TIMEOUT_MS));
+    TEST_ASSERT_TRUE_MESSAGE(xSemaphoreTake(lc->reply, pdMS_TO_TICKS(LOOPBACK_REPLY_TIMEOUT_MS * 2)) == pdTRUE,
+                             "no sync ack");
+    return lc->ack_value;
+}
+
+void app_main(void)
+{
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    UNITY_BEGIN();
+    test_websocket_cases();
+    test_polling_cases();
+    fflush(stdout);
+    exit(UNITY_END());
+}
@@ -0,0 +1,141 @@
+// Steady state of a polling session, counted with the bench_alloc malloc wrappers. GETs and posts
+// go over the keep-alive connections of sio_http_conn on both the shared I/O task and the
+// per-client tasks, neither a poll nor a post may touch the heap at all.
+
+#include "test_loopback.h"
+
+#include <bench_alloc.h>
+#include <sio_event_view.h>
+#include <unity.h>
+#include <stdio.h>
+
+#define STREAM_EVENTS 24
+#define STREAM_INTERVAL_MS 20
+#define STREAM_FIRST_MARK 4 // pools and buffers have their size once the first events are through
+#define STREAM_ATTEMPTS 3   // a window with a server ping (and its pong post) is measured again
+#define POST_WARMUP 4
+#define POST_COUNT 16
+
+typedef struct
+{
+    uint32_t received;
+    SemaphoreHandle_t done; // given with the last event
+    uint64_t allocs[2];     // at the first mark and the last event
+    int64_t live[2];
+    sio_metrics_t metrics[2];
+} stream_t;
+
+static void mark(sio_client_id_t id, stream_t *stream, int at)
+{
+    stream->allocs[at] = bench_alloc_count();
+    stream->live[at] = bench_alloc_live();
+    sio_client_get_metrics(id, &stream->metrics[at]);
+}
+
+// runs in the receiving task, both marks are taken at the same point of the poll cycle
+static void on_stream(sio_client_id_t client_id, const Packet_t *packet, const sio_event_view_t *view, void *ctx)
+{
+    stream_t *stream = (stream_t *)ctx;
+    uint32_t received = ++stream->received;
+    if (received == STREAM_FIRST_MARK)
+    {
+        mark(client_id, stream, 0);
+    }
+    else if (received == STREAM_EVENTS)
+    {
+        mark(client_id, stream, 1);
+        xSemaphoreGive(stream->done);
+    }
+}
+
+static bool window_quiet(const stream_t *stream)
+{
+    // nothing but polls: no ping came in and nothing was posted
+    return stream->metrics[1].pings == stream->metrics[0].pings && stream->metrics[1].posts == stream->metrics[0].posts;
+}
+
+static void test_polling_receive_cycle_allocations(void)
+{
+    loopback_client_t lc;
+    loopback_start(&lc, SIO_TRANSPORT_POLLING, false);
+
+    stream_t stream = {.done = xSemaphoreCreateBinary()};
+    TEST_ASSERT_NOT_NULL(stream.done);
+    TEST_ASSERT_EQUAL(ESP_OK, sio_on(lc.id, "bench_stream", on_stream, &stream));
+
+    char args[32];
+    snprintf(args, sizeof(args), "%d,%d,%d", STREAM_EVENTS, STREAM_INTERVAL_MS, 64);
+
+    bool quiet = false;
+    for (int attempt = 0; attempt < STREAM_ATTEMPTS && !quiet; attempt++)
+    {
+        stream.received = 0;
+        TEST_ASSERT_EQUAL(ESP_OK, sio_send_string(lc.id, "bench_stream", args));
+        TEST_ASSERT_TRUE_MESSAGE(xSemaphoreTake(stream.done, pdMS_TO_TICKS(LOOPBACK_REPLY_TIMEOUT_MS)) == pdTRUE,
+                                 "stream incomplete");
+        quiet = window_quiet(&stream);
+    }
+    TEST_ASSERT_TRUE_MESSAGE(quiet, "every window had a ping or a post in it");
+
+    uint32_t cycles = STREAM_EVENTS - STREAM_FIRST_MARK;
+    uint64_t allocs = stream.allocs[1] - stream.allocs[0];
+    printf("receive: %u polls, %llu allocations, %lld not freed\n", (unsigned)cycles, (unsigned long long)allocs,
+           (long long)(stream.live[1] - stream.live[0]));
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, stream.live[1] - stream.live[0], "the poll cycle keeps heap");
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(0, allocs, "the poll cycle allocates");
+
+    sio_off(lc.id, "bench_stream");
+    loopback_stop(&lc);
+    vSemaphoreDelete(stream.done);
+}
+
+static void test_polling_post_cycle_allocations(void)
+{
+    loopback_client_t lc;
+    loopback_start(&lc, SIO_TRANSPORT_POLLING, false);
+    sio_client_t *client = sio_client_get(lc.id);
+
+    for (int i = 0; i < POST_WARMUP; i++)
+    {
+        TEST_ASSERT_EQUAL(ESP_OK, sio_send_string(lc.id, "bench_sink", "0"));
+        TEST_ASSERT_EQUAL(ESP_OK, sio_client_flush_outbound(client));
+    }
+    // the second flush waits out a post the posting side had already started
+    sio_client_flush_outbound(client);
+
+    stream_t window = {0};
+    uint64_t allocs = 0;
+    int attempt = 0;
+    do
+    {
+        allocs = 0;
+        mark(lc.id, &window, 0);
+        for (int i = 0; i < POST_COUNT; i++)
+        {
+            TEST_ASSERT_EQUAL(ESP_OK, sio_send_string(lc.id, "bench_sink", "1"));
+            // the emit builds its packet on the heap, only the post is counted
+            uint64_t before = bench_alloc_count();
+            TEST_ASSERT_EQUAL(ESP_OK, sio_client_flush_outbound(client));
+            allocs += bench_alloc_count() - before;
+        }
+        sio_client_flush_outbound(client);
+        mark(lc.id, &window, 1);
+        // a ping answered in between was posted (and received) alongside
+    } while (window.metrics[1].pings != window.metrics[0].pings && ++attempt < STREAM_ATTEMPTS);
+    TEST_ASSERT_TRUE_MESSAGE(window.metrics[1].pings == window.metrics[0].pings, "every window had a ping in it");
+
+    int64_t live = window.live[1] - window.live[0];
+    printf("post: %d posts, %llu allocations, %lld not freed\n", POST_COUNT, (unsigned long long)allocs, (long long)live);
+    TEST_ASSERT_EQUAL_MESSAGE(0, live, "the post cycle keeps heap");
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(0, allocs, "the post cycle allocates");
+    TEST_ASSERT_EQUAL(POST_WARMUP + POST_COUNT * (attempt + 1), loopback_sync(&lc));
+
+    loopback_stop(&lc);
+}
+
+void test_polling_cases(void)
+{
+    RUN_TEST(test_polling_receive_cycle_allocations);
+    RUN_TEST(test_polling_post_cycle_allocations);
+}
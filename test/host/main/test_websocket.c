@@ -0,0 +1,61 @@
+// websocket transport: handshake, emits both ways, acks and close, directly and upgraded from polling
+
+#include "test_loopback.h"
+
+#include <unity.h>
+
+#define UPGRADE_TIMEOUT_MS 5000
+
+static void test_websocket_handshake_emit_close(void)
+{
+    loopback_client_t lc;
+    loopback_start(&lc, SIO_TRANSPORT_WEBSOCKETS, false);
+    TEST_ASSERT_EQUAL(SIO_TRANSPORT_WEBSOCKETS, sio_client_transport(sio_client_get(lc.id)));
+
+    // server to client and back
+    loopback_echo(&lc, "loopback");
+    loopback_echo(&lc, "second frame");
+
+    // client to server, counted by the server and acknowledged
+    TEST_ASSERT_EQUAL(ESP_OK, sio_send_string(lc.id, "bench_sink", "1"));
+    TEST_ASSERT_EQUAL(ESP_OK, sio_send_string(lc.id, "bench_sink", "2"));
+    TEST_ASSERT_EQUAL(2, loopback_sync(&lc));
+
+    TEST_ASSERT_EQUAL(ESP_OK, sio_client_close(lc.id));
+    TEST_ASSERT_FALSE(sio_client_is_connected(lc.id));
+
+    // a close of our own is not a lost connection
+    vTaskDelay(pdMS_TO_TICKS(500));
+    TEST_ASSERT_EQUAL(0, lc.disconnects);
+
+    loopback_stop(&lc);
+    TEST_ASSERT_FALSE(sio_client_is_inited(lc.id));
+}
+
+static void test_websocket_upgrade_from_polling(void)
+{
+    loopback_client_t lc;
+    loopback_start(&lc, SIO_TRANSPORT_POLLING, true);
+
+    // the polling task probes and switches right after the handshake
+    sio_client_t *client = sio_client_get(lc.id);
+    for (int waited = 0; sio_client_transport(client) != SIO_TRANSPORT_WEBSOCKETS && waited < UPGRADE_TIMEOUT_MS; waited += 10)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL(SIO_TRANSPORT_WEBSOCKETS, sio_client_transport(client));
+
+    loopback_echo(&lc, "upgraded");
+    TEST_ASSERT_EQUAL(ESP_OK, sio_send_string(lc.id, "bench_sink", "1"));
+    TEST_ASSERT_EQUAL(1, loopback_sync(&lc));
+
+    TEST_ASSERT_EQUAL(ESP_OK, sio_client_close(lc.id));
+    TEST_ASSERT_FALSE(sio_client_is_connected(lc.id));
+    loopback_stop(&lc);
+}
+
+void test_websocket_cases(void)
+{
+    RUN_TEST(test_websocket_handshake_emit_close);
+    RUN_TEST(test_websocket_upgrade_from_polling);
+}
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Builds the host tests in both configurations and runs them against the stand-in server.
+
+    python3 run_tests.py              # build and run both
+    python3 run_tests.py --no-build   # run what was built last
+
+Needs an ESP-IDF environment (idf.py on the path) with linux target support.
+"""
+
+import argparse
+import os
+import socket
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+STAND_IN = os.path.join(HERE, "..", "..", "bench", "server", "sio_stand_in.py")
+
+# build directory, sdkconfig.defaults files on top of each other
+CONFIGS = [
+    ("build", ["sdkconfig.defaults"]),
+    ("build_shared_io", ["sdkconfig.defaults", "sdkconfig.shared_io"]),
+]
+
+
+def idf(build_dir, defaults, *args):
+    command = ["idf.py", "--preview", "-B", build_dir,
+               "-D", "SDKCONFIG=" + os.path.join(build_dir, "sdkconfig"),
+               "-D", "SDKCONFIG_DEFAULTS=" + ";".join(defaults)] + list(args)
+    subprocess.run(command, cwd=HERE, check=True)
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--no-build", action="store_true")
+    parser.add_argument("--timeout", type=int, default=300, help="seconds per configuration")
+    args = parser.parse_args()
+
+    if not args.no_build:
+        for build_dir, defaults in CONFIGS:
+            if not os.path.exists(os.path.join(HERE, build_dir, "CMakeCache.txt")):
+                idf(build_dir, defaults, "set-target", "linux")
+            idf(build_dir, defaults, "build")
+
+    port = free_port()
+    server = subprocess.Popen([sys.executable, STAND_IN, "--port", str(port)], stdout=subprocess.PIPE, text=True)
+    failed = []
+    try:
+        server.stdout.readline()  # "listening on ..."
+        env = dict(os.environ, SIO_TEST_SERVER="127.0.0.1:%d" % port)
+        for build_dir, _ in CONFIGS:
+            print("== %s" % build_dir, flush=True)
+            elf = os.path.join(HERE, build_dir, "sio_host_test.elf")
+            try:
+                result = subprocess.run([elf], env=env, timeout=args.timeout)
+                if result.returncode != 0:
+                    failed.append(build_dir)
+            except subprocess.TimeoutExpired:
+                print("%s timed out" % build_dir)
+                failed.append(build_dir)
+    finally:
+        server.terminate()
+        server.wait()
+
+    if failed:
+        print("failed: %s" % ", ".join(failed))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())